@@ -206,6 +206,11 @@
 #define PAR_PA_SHIFT		12
 #define PAR_PA_MASK		(BIT64(36) - 1)
 
+#define ID_AA64ISAR0_SHA2_SHIFT		12
+#define ID_AA64ISAR0_SHA2_MASK		0xf
+#define ID_AA64ISAR0_SHA2_SHA256	0x1
+#define ID_AA64ISAR0_SHA2_SHA512	0x2
+
 #ifndef ASM
 static inline void isb(void)
 {
@@ -297,6 +302,7 @@ DEFINE_U64_REG_READWRITE_FUNCS(tcr_el1)
 
 DEFINE_U64_REG_READ_FUNC(esr_el1)
 DEFINE_U64_REG_READ_FUNC(far_el1)
+DEFINE_U64_REG_READ_FUNC(id_aa64isar0_el1)
 DEFINE_U64_REG_READ_FUNC(mpidr_el1)
 DEFINE_U64_REG_READ_FUNC(par_el1)
 
@@ -41,6 +41,9 @@
 #define PTA_ALLOWED_FLAGS	PTA_MANDATORY_FLAGS
 #define PTA_DEFAULT_FLAGS	PTA_MANDATORY_FLAGS
 
+/* Number of output values of a pseudo TA fast call */
+#define PTA_FAST_CALL_NUM_OUT	5
+
 struct pseudo_ta_head {
 	TEE_UUID uuid;
 	const char *name;
@@ -55,6 +58,14 @@ struct pseudo_ta_head {
 	TEE_Result (*invoke_command_entry_point)(void *pSessionContext,
 			uint32_t nCommandID, uint32_t nParamTypes,
 			TEE_Param pParams[TEE_NUM_PARAMS]);
+	/*
+	 * Optional, serves the commands the pseudo TA exposes as fast
+	 * calls. Called without session or thread and with all exceptions
+	 * masked, it must complete in bounded time and must not sleep,
+	 * take mutexes or do RPC.
+	 */
+	TEE_Result (*fast_call_entry_point)(uint32_t nCommandID, uint32_t in,
+			uint32_t out[PTA_FAST_CALL_NUM_OUT]);
 };
 
 #define pseudo_ta_register(...) static const struct pseudo_ta_head __head \
@@ -80,5 +91,13 @@ static inline struct pseudo_ta_ctx *to_pseudo_ta_ctx(struct tee_ta_ctx *ctx)
 TEE_Result tee_ta_init_pseudo_ta_session(const TEE_UUID *uuid,
 			struct tee_ta_session *s);
 
+/*
+ * Serves command @cmd of pseudo TA @uuid as a fast call, the result of
+ * the command is returned in @res. Returns false if there's no such pseudo
+ * TA or if it doesn't serve fast calls.
+ */
+bool pseudo_ta_fast_call(const TEE_UUID *uuid, uint32_t cmd, uint32_t in,
+			 uint32_t out[PTA_FAST_CALL_NUM_OUT], TEE_Result *res);
+
 #endif /* KERNEL_PSEUDO_TA_H */
 
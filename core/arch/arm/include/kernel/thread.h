@@ -554,6 +554,13 @@ void thread_rpc_free_payload(uint64_t cookie);
 uint32_t thread_rpc_cmd(uint32_t cmd, size_t num_params,
 		struct optee_msg_param *params);
 
+/**
+ * Suspends the current standard call and lets normal world return to the
+ * caller of an asynchronous call, see OPTEE_SMC_CALL_WITH_ARG_ASYNC
+ * @ticket: ticket identifying the call
+ */
+void thread_rpc_async(uint64_t ticket);
+
 #endif /*ASM*/
 
 #endif /*KERNEL_THREAD_H*/
@@ -209,7 +209,10 @@ struct tee_pager_stats {
 };
 
 #ifdef CFG_WITH_PAGER
+/* Returns the statistics and resets the hit and zi_released counters */
 void tee_pager_get_stats(struct tee_pager_stats *stats);
+/* Returns the statistics without resetting them */
+void tee_pager_peek_stats(struct tee_pager_stats *stats);
 bool tee_pager_handle_fault(struct abort_info *ai);
 #else /*CFG_WITH_PAGER*/
 static inline bool tee_pager_handle_fault(struct abort_info *ai __unused)
@@ -221,6 +224,11 @@ static inline void tee_pager_get_stats(struct tee_pager_stats *stats)
 {
 	memset(stats, 0, sizeof(struct tee_pager_stats));
 }
+
+static inline void tee_pager_peek_stats(struct tee_pager_stats *stats)
+{
+	memset(stats, 0, sizeof(struct tee_pager_stats));
+}
 #endif /*CFG_WITH_PAGER*/
 
 #endif /*MM_TEE_PAGER_H*/
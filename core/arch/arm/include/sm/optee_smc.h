@@ -290,6 +290,12 @@
 #define OPTEE_SMC_SEC_CAP_HAVE_RESERVED_SHM	(1 << 0)
 /* Secure world can communicate via previously unregistered shared memory */
 #define OPTEE_SMC_SEC_CAP_UNREGISTERED_SHM	(1 << 1)
+/* Secure world supports OPTEE_MSG_CMD_INVOKE_BATCH */
+#define OPTEE_SMC_SEC_CAP_BATCHED_INVOKE	(1 << 2)
+/* Secure world supports OPTEE_SMC_CALL_WITH_ARG_ASYNC */
+#define OPTEE_SMC_SEC_CAP_ASYNC_CALLS		(1 << 3)
+/* Secure world supports OPTEE_SMC_CALL_PTA_FAST */
+#define OPTEE_SMC_SEC_CAP_PTA_FAST_CALL		(1 << 4)
 #define OPTEE_SMC_FUNCID_EXCHANGE_CAPABILITIES	9
 #define OPTEE_SMC_EXCHANGE_CAPABILITIES \
 	OPTEE_SMC_FAST_CALL_VAL(OPTEE_SMC_FUNCID_EXCHANGE_CAPABILITIES)
@@ -384,6 +390,83 @@
 #define OPTEE_SMC_BOOT_SECONDARY \
 	OPTEE_SMC_FAST_CALL_VAL(OPTEE_SMC_FUNCID_BOOT_SECONDARY)
 
+/*
+ * Call with struct optee_msg_arg as argument, completed asynchronously
+ *
+ * Same as OPTEE_SMC_CALL_WITH_ARG except that once the struct
+ * optee_msg_arg has been accepted the call is suspended and returns
+ * OPTEE_SMC_RETURN_RPC_ASYNC with a ticket identifying the call. The
+ * caller doesn't have to wait for the result. Normal world resumes the
+ * call with OPTEE_SMC_CALL_RETURN_FROM_RPC from any context, for instance
+ * a worker thread, and serves its RPCs as usual until OPTEE_SMC_RETURN_OK
+ * is returned. The struct optee_msg_arg must be left untouched until then.
+ *
+ * On completion the ticket is also queued for
+ * OPTEE_SMC_GET_ASYNC_COMPLETION and, if the platform has configured one,
+ * a non-secure SGI is raised as doorbell.
+ *
+ * Register usage and return values are the same as for
+ * OPTEE_SMC_CALL_WITH_ARG. Only available if
+ * OPTEE_SMC_SEC_CAP_ASYNC_CALLS is reported by
+ * OPTEE_SMC_EXCHANGE_CAPABILITIES.
+ */
+#define OPTEE_SMC_FUNCID_CALL_WITH_ARG_ASYNC	13
+#define OPTEE_SMC_CALL_WITH_ARG_ASYNC \
+	OPTEE_SMC_STD_CALL_VAL(OPTEE_SMC_FUNCID_CALL_WITH_ARG_ASYNC)
+
+/*
+ * Get the ticket of a completed asynchronous call
+ *
+ * Call register usage:
+ * a0	SMC Function ID, OPTEE_SMC_GET_ASYNC_COMPLETION
+ * a1-6	Not used
+ * a7	Hypervisor Client ID register
+ *
+ * Normal return register usage:
+ * a0	OPTEE_SMC_RETURN_OK
+ * a1	Upper 32 bits of a 64-bit ticket
+ * a2	Lower 32 bits of a 64-bit ticket, 0 if completions had to be
+ *	dropped and all outstanding asynchronous calls must be checked
+ * a3-7	Preserved
+ *
+ * Nothing completed return register usage:
+ * a0	OPTEE_SMC_RETURN_ENOTAVAIL
+ * a1-7	Preserved
+ */
+#define OPTEE_SMC_FUNCID_GET_ASYNC_COMPLETION	14
+#define OPTEE_SMC_GET_ASYNC_COMPLETION \
+	OPTEE_SMC_FAST_CALL_VAL(OPTEE_SMC_FUNCID_GET_ASYNC_COMPLETION)
+
+/*
+ * Invoke a command a pseudo TA exposes as fast call
+ *
+ * Only commands served by the fast_call_entry_point of a pseudo TA can be
+ * invoked this way. These are read-only queries with bounded execution
+ * time which don't need a session or a thread, all parameters are passed
+ * in registers.
+ *
+ * Call register usage:
+ * a0	SMC Function ID, OPTEE_SMC_CALL_PTA_FAST
+ * a1-4	UUID of the pseudo TA, same word layout as OPTEE_MSG_UID_0..3
+ * a5	Command ID
+ * a6	Input value
+ * a7	Hypervisor Client ID register
+ *
+ * Normal return register usage:
+ * a0	OPTEE_SMC_RETURN_OK
+ * a1	TEE_Result of the command
+ * a2-6	Output values, only valid if a1 is TEE_SUCCESS
+ * a7	Preserved
+ *
+ * Not available register usage:
+ * a0	OPTEE_SMC_RETURN_ENOTAVAIL, no such pseudo TA or it doesn't serve
+ *	fast calls
+ * a1-7	Preserved
+ */
+#define OPTEE_SMC_FUNCID_CALL_PTA_FAST	15
+#define OPTEE_SMC_CALL_PTA_FAST \
+	OPTEE_SMC_FAST_CALL_VAL(OPTEE_SMC_FUNCID_CALL_PTA_FAST)
+
 /*
  * Resume from RPC (for example after processing an IRQ)
  *
@@ -513,6 +596,24 @@
 #define OPTEE_SMC_RETURN_RPC_CMD \
 	OPTEE_SMC_RPC_VAL(OPTEE_SMC_RPC_FUNC_CMD)
 
+/*
+ * Asynchronous call accepted, see OPTEE_SMC_CALL_WITH_ARG_ASYNC
+ *
+ * "Call" register usage:
+ * a0	OPTEE_SMC_RETURN_RPC_ASYNC
+ * a1	Upper 32 bits of a 64-bit ticket identifying the call
+ * a2	Lower 32 bits of a 64-bit ticket identifying the call
+ * a3-7	Resume information, must be preserved
+ *
+ * "Return" register usage:
+ * a0	SMC Function ID, OPTEE_SMC_CALL_RETURN_FROM_RPC.
+ * a1-2	Not used
+ * a3-7	Preserved
+ */
+#define OPTEE_SMC_RPC_FUNC_ASYNC	6
+#define OPTEE_SMC_RETURN_RPC_ASYNC \
+	OPTEE_SMC_RPC_VAL(OPTEE_SMC_RPC_FUNC_ASYNC)
+
 /* Returned in a0 */
 #define OPTEE_SMC_RETURN_UNKNOWN_FUNCTION 0xFFFFFFFF
 
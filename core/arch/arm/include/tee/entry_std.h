@@ -35,4 +35,10 @@
 /* Standard call entry */
 void tee_entry_std(struct thread_smc_args *args);
 
+/*
+ * Returns the ticket of a completed asynchronous call, 0 if completions
+ * were dropped, or false if there's nothing to report
+ */
+bool tee_entry_std_get_async_completion(uint64_t *ticket);
+
 #endif /* TEE_ENTRY_STD_H */
@@ -213,6 +213,28 @@ err:
 
 service_init(verify_pseudo_tas_conformance);
 
+static const struct pseudo_ta_head *find_pseudo_ta(const TEE_UUID *uuid)
+{
+	const struct pseudo_ta_head *ta;
+
+	for (ta = &__start_ta_head_section; ta < &__stop_ta_head_section; ta++)
+		if (!memcmp(&ta->uuid, uuid, sizeof(TEE_UUID)))
+			return ta;
+	return NULL;
+}
+
+bool pseudo_ta_fast_call(const TEE_UUID *uuid, uint32_t cmd, uint32_t in,
+			 uint32_t out[PTA_FAST_CALL_NUM_OUT], TEE_Result *res)
+{
+	const struct pseudo_ta_head *ta = find_pseudo_ta(uuid);
+
+	if (!ta || !ta->fast_call_entry_point)
+		return false;
+
+	*res = ta->fast_call_entry_point(cmd, in, out);
+	return true;
+}
+
 /*-----------------------------------------------------------------------------
  * Initialises a session based on the UUID or ptr to the ta
  * Returns ptr to the session (ta_session) and a TEE_Result
@@ -226,14 +248,9 @@ TEE_Result tee_ta_init_pseudo_ta_session(const TEE_UUID *uuid,
 
 	DMSG("   Lookup for Static TA %pUl", (void *)uuid);
 
-	ta = &__start_ta_head_section;
-	while (true) {
-		if (ta >= &__stop_ta_head_section)
-			return TEE_ERROR_ITEM_NOT_FOUND;
-		if (memcmp(&ta->uuid, uuid, sizeof(TEE_UUID)) == 0)
-			break;
-		ta++;
-	}
+	ta = find_pseudo_ta(uuid);
+	if (!ta)
+		return TEE_ERROR_ITEM_NOT_FOUND;
 
 	/* Load a new TA and create a session */
 	DMSG("      Open %s", ta->name);
@@ -1232,6 +1232,16 @@ uint32_t thread_rpc_cmd(uint32_t cmd, size_t num_params,
 	return ret;
 }
 
+void thread_rpc_async(uint64_t ticket)
+{
+	uint32_t rpc_args[THREAD_RPC_NUM_ARGS] = {
+		OPTEE_SMC_RETURN_RPC_ASYNC
+	};
+
+	reg_pair_from_64(ticket, rpc_args + 1, rpc_args + 2);
+	thread_rpc(rpc_args);
+}
+
 static bool check_alloced_shm(paddr_t pa, size_t len, size_t align)
 {
 	if (pa & (align - 1))
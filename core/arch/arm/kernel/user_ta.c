@@ -247,7 +247,12 @@ static struct mobj *alloc_ta_mem(size_t size)
 #ifdef CFG_PAGED_USER_TA
 	return mobj_paged_alloc(size);
 #else
-	return mobj_mm_alloc(mobj_sec_ddr, size, &tee_mm_sec_ddr);
+	struct mobj *mobj = mobj_mm_alloc(mobj_sec_ddr, size, &tee_mm_sec_ddr);
+
+	/* Make room by dropping instances waiting in the preload pool */
+	while (!mobj && tee_ta_preload_evict_one())
+		mobj = mobj_mm_alloc(mobj_sec_ddr, size, &tee_mm_sec_ddr);
+	return mobj;
 #endif
 }
 
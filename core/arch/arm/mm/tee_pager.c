@@ -159,6 +159,11 @@ void tee_pager_get_stats(struct tee_pager_stats *stats)
 	pager_stats.zi_released = 0;
 }
 
+void tee_pager_peek_stats(struct tee_pager_stats *stats)
+{
+	*stats = pager_stats;
+}
+
 #else /* CFG_WITH_STATS */
 static inline void incr_ro_hits(void) { }
 static inline void incr_rw_hits(void) { }
@@ -171,6 +176,11 @@ void tee_pager_get_stats(struct tee_pager_stats *stats)
 {
 	memset(stats, 0, sizeof(struct tee_pager_stats));
 }
+
+void tee_pager_peek_stats(struct tee_pager_stats *stats)
+{
+	memset(stats, 0, sizeof(struct tee_pager_stats));
+}
 #endif /* CFG_WITH_STATS */
 
 static struct pgt pager_core_pgt;
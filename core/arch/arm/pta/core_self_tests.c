@@ -25,7 +25,9 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 #include <malloc.h>
+#include <mpa.h>
 #include <stdbool.h>
+#include <string.h>
 #include <trace.h>
 #include "core_self_tests.h"
 
@@ -39,12 +41,14 @@
 
 static int self_test_division(void);
 static int self_test_malloc(void);
+static int self_test_mpa_montgomery(void);
 
 /* exported entry points for some basic test */
 TEE_Result core_self_tests(uint32_t nParamTypes __unused,
 		TEE_Param pParams[TEE_NUM_PARAMS] __unused)
 {
-	if (self_test_division() || self_test_malloc()) {
+	if (self_test_division() || self_test_malloc() ||
+	    self_test_mpa_montgomery()) {
 		EMSG("some self_test_xxx failed! you should enable local LOG");
 		return TEE_ERROR_GENERIC;
 	}
@@ -250,3 +254,150 @@ static int self_test_malloc(void)
 
 	return ret;
 }
+
+#ifdef CFG_ARM64_core
+/*
+ * Compares __mpa_montgomery_mul_a64() with the C __mpa_montgomery_mul_c()
+ * on random moduli and operands and on edge cases: moduli with all words
+ * set, moduli just above a power of 2 and the operands 0, 1, n - 1 and
+ * all low words set.
+ */
+#define MONT_TEST_MAX_WORDS	128	/* 4096 bits */
+#define MONT_TEST_VAR_U32	mpa_StaticVarSizeInU32((MONT_TEST_MAX_WORDS + \
+						       2) * MPA_WORD_SIZE)
+
+static uint32_t mont_test_rng = 0x12345678;
+
+static uint32_t mont_test_rand(void)
+{
+	/* xorshift32 */
+	mont_test_rng ^= mont_test_rng << 13;
+	mont_test_rng ^= mont_test_rng >> 17;
+	mont_test_rng ^= mont_test_rng << 5;
+	return mont_test_rng;
+}
+
+/* Sets op to an s words long value below n, kind selects an edge case */
+static void mont_test_operand(mpanum op, const mpanum n, int s, int kind)
+{
+	int i;
+
+	mpa_wipe(op);
+	for (i = 0; i < s; i++) {
+		switch (kind) {
+		case 0:
+			op->d[i] = 0;
+			break;
+		case 1:
+			op->d[i] = !i;
+			break;
+		case 2:
+			op->d[i] = n->d[i] - !i;
+			break;
+		case 3:
+			op->d[i] = ~0u;
+			break;
+		default:
+			op->d[i] = mont_test_rand();
+			break;
+		}
+	}
+	/* Keep the top word below the one of n */
+	if (kind > 2)
+		op->d[s - 1] = 1 + op->d[s - 1] % (n->d[s - 1] - 1);
+	op->size = s;
+	while (op->size && !op->d[op->size - 1])
+		op->size--;
+}
+
+static int mont_test_one(mpanum t, mpanum ref, mpanum a, mpanum b,
+			 mpanum n, int s)
+{
+	uint64_t n_lsw = n->d[0] | ((uint64_t)n->d[1] << 32);
+	uint64_t inv = n_lsw;
+	mpa_word_t n_inv;
+	int i;
+
+	/* n^-1 mod 2^64 by Newton iteration, each step doubles the bits */
+	for (i = 0; i < 5; i++)
+		inv *= 2 - n_lsw * inv;
+	n_inv = (mpa_word_t)(0 - inv);
+
+	/* The kernel reads all s words of the operands */
+	mpa_wipe(t);
+	__mpa_montgomery_mul_a64(t->d, a->d, b->d, n->d, s / 2, 0 - inv);
+	__mpa_montgomery_mul_c(ref, a, b, n, n_inv);
+
+	for (i = 0; i < s; i++) {
+		if (t->d[i] != (i < __mpanum_size(ref) ? ref->d[i] : 0)) {
+			LOG("  %d words, word %d: 0x%x != 0x%x", s, i,
+			    (unsigned)t->d[i], (unsigned)ref->d[i]);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int self_test_mpa_montgomery(void)
+{
+	static const int sizes[] = { 2, 4, 6, 8, 32, 64, 96, 128 };
+	mpanum v[5] = { NULL };
+	mpanum n;
+	size_t k;
+	int ret = 0;
+	int s;
+	int i;
+	int j;
+	int m;
+
+	LOG("mpa Montgomery multiplication tests:");
+	for (i = 0; i < 5; i++) {
+		v[i] = malloc(MONT_TEST_VAR_U32 * sizeof(uint32_t));
+		if (!v[i]) {
+			ret = -1;
+			goto out;
+		}
+		mpa_init_static(v[i], MONT_TEST_VAR_U32);
+	}
+	n = v[4];
+
+	for (k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+		s = sizes[k];
+		for (m = 0; m < 3; m++) {
+			/* Random, all words set, 2^(32 * s - 1) + 1 */
+			mpa_wipe(n);
+			for (i = 0; i < s; i++) {
+				if (m == 0)
+					n->d[i] = mont_test_rand();
+				else if (m == 1)
+					n->d[i] = ~0u;
+			}
+			n->d[0] |= 1;
+			n->d[s - 1] |= 1u << (MPA_WORD_SIZE - 1);
+			n->size = s;
+
+			for (i = 0; i < 6; i++) {
+				for (j = 0; j < 6; j++) {
+					mont_test_operand(v[0], n, s, i);
+					mont_test_operand(v[1], n, s, j);
+					if (mont_test_one(v[2], v[3], v[0],
+							  v[1], n, s))
+						ret = -1;
+				}
+			}
+		}
+	}
+
+out:
+	for (i = 0; i < 5; i++)
+		free(v[i]);
+	LOG("  => test %s", ret ? "FAILED" : "ok");
+	LOG("");
+	return ret;
+}
+#else
+static int self_test_mpa_montgomery(void)
+{
+	return 0;
+}
+#endif /*CFG_ARM64_core*/
@@ -28,6 +28,7 @@
 #include <stdio.h>
 #include <trace.h>
 #include <kernel/pseudo_ta.h>
+#include <kernel/tee_ta_manager.h>
 #include <mm/tee_pager.h>
 #include <mm/tee_mm.h>
 #include <string.h>
@@ -98,8 +99,11 @@ static TEE_Result get_alloc_stats(uint32_t type, TEE_Param p[TEE_NUM_PARAMS])
 			break;
 
 		case 3:
+			/* Allocations from tee_mm_sec_ddr hold tee_ta_mutex */
+			mutex_lock(&tee_ta_mutex);
 			tee_mm_get_pool_stats(&tee_mm_sec_ddr, stats,
 					      !!p[0].value.b);
+			mutex_unlock(&tee_ta_mutex);
 			strlcpy(stats->desc, "Secure DDR", sizeof(stats->desc));
 			break;
 
@@ -137,6 +141,48 @@ static TEE_Result get_pager_stats(uint32_t type, TEE_Param p[TEE_NUM_PARAMS])
 	return TEE_SUCCESS;
 }
 
+static TEE_Result fast_get_alloc_stats(uint32_t pool_id,
+				       uint32_t out[PTA_FAST_CALL_NUM_OUT])
+{
+	struct malloc_stats stats;
+
+	/*
+	 * Only the heap, its stats are protected by a spinlock. The other
+	 * pools are protected by mutexes and are served by
+	 * STATS_CMD_ALLOC_STATS only.
+	 */
+	switch (pool_id) {
+	case 1:
+		malloc_get_stats(&stats);
+		break;
+	default:
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+
+	out[0] = stats.allocated;
+	out[1] = stats.max_allocated;
+	out[2] = stats.size;
+	out[3] = stats.num_alloc_fail;
+	out[4] = stats.biggest_alloc_fail;
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result fast_get_pager_stats(uint32_t out[PTA_FAST_CALL_NUM_OUT])
+{
+	struct tee_pager_stats stats;
+
+	/* zi_released is only reported by STATS_CMD_PAGER_STATS */
+	tee_pager_peek_stats(&stats);
+	out[0] = stats.npages;
+	out[1] = stats.npages_all;
+	out[2] = stats.ro_hits;
+	out[3] = stats.rw_hits;
+	out[4] = stats.hidden_hits;
+
+	return TEE_SUCCESS;
+}
+
 /*
  * Trusted Application Entry Points
  */
@@ -156,6 +202,26 @@ static TEE_Result invoke_command(void *psess __unused,
 	return TEE_ERROR_BAD_PARAMETERS;
 }
 
+/*
+ * Read-only variants of the commands above, the pool id is passed as input
+ * value to STATS_CMD_ALLOC_STATS, only the heap (pool 1) is supported, and
+ * the stats are never reset.
+ */
+static TEE_Result fast_call(uint32_t cmd, uint32_t in,
+			    uint32_t out[PTA_FAST_CALL_NUM_OUT])
+{
+	switch (cmd) {
+	case STATS_CMD_PAGER_STATS:
+		return fast_get_pager_stats(out);
+	case STATS_CMD_ALLOC_STATS:
+		return fast_get_alloc_stats(in, out);
+	default:
+		break;
+	}
+	return TEE_ERROR_BAD_PARAMETERS;
+}
+
 pseudo_ta_register(.uuid = STATS_UUID, .name = TA_NAME,
 		   .flags = PTA_DEFAULT_FLAGS,
-		   .invoke_command_entry_point = invoke_command);
+		   .invoke_command_entry_point = invoke_command,
+		   .fast_call_entry_point = fast_call);
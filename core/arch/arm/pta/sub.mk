@@ -11,4 +11,5 @@ endif
 
 ifeq ($(CFG_WITH_USER_TA),y)
 srcs-$(CFG_TEE_FS_KEY_MANAGER_TEST) += tee_fs_key_manager_tests.c
+srcs-$(CFG_TA_PRELOAD) += ta_preload.c
 endif
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2017, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <kernel/pseudo_ta.h>
+#include <kernel/tee_ta_manager.h>
+#include <pta_ta_preload.h>
+#include <tee/uuid.h>
+#include <trace.h>
+
+static TEE_Result get_uuid(uint32_t param_types,
+			   TEE_Param params[TEE_NUM_PARAMS], TEE_UUID *uuid)
+{
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_MEMREF_INPUT,
+					  TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE);
+
+	if (exp_pt != param_types ||
+	    params[0].memref.size != sizeof(TEE_UUID))
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	tee_uuid_from_octets(uuid, params[0].memref.buffer);
+	return TEE_SUCCESS;
+}
+
+static TEE_Result preload(uint32_t param_types,
+			  TEE_Param params[TEE_NUM_PARAMS])
+{
+	TEE_Result res;
+	TEE_UUID uuid;
+
+	res = get_uuid(param_types, params, &uuid);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	return tee_ta_preload(&uuid);
+}
+
+static TEE_Result evict(uint32_t param_types,
+			TEE_Param params[TEE_NUM_PARAMS])
+{
+	TEE_Result res;
+	TEE_UUID uuid;
+
+	res = get_uuid(param_types, params, &uuid);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	return tee_ta_preload_evict(&uuid);
+}
+
+static TEE_Result preload_platform(uint32_t param_types,
+				   TEE_Param params[TEE_NUM_PARAMS])
+{
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE);
+	const TEE_UUID *uuids;
+	size_t count;
+	size_t n;
+
+	if (exp_pt != param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	params[0].value.a = 0;
+	uuids = plat_get_ta_preload_list(&count);
+	for (n = 0; n < count; n++) {
+		if (tee_ta_preload(uuids + n) == TEE_SUCCESS)
+			params[0].value.a++;
+		else
+			EMSG("Failed to preload TA %pUl", (void *)(uuids + n));
+	}
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result get_stats(uint32_t param_types,
+			    TEE_Param params[TEE_NUM_PARAMS])
+{
+	uint32_t exp_pt = TEE_PARAM_TYPES(TEE_PARAM_TYPE_VALUE_OUTPUT,
+					  TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE,
+					  TEE_PARAM_TYPE_NONE);
+	size_t count;
+	size_t size;
+
+	if (exp_pt != param_types)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	tee_ta_preload_get_stats(&count, &size);
+	params[0].value.a = count;
+	params[0].value.b = size;
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result open_session(uint32_t param_types __unused,
+			       TEE_Param params[TEE_NUM_PARAMS] __unused,
+			       void **sess_ctx __unused)
+{
+	/* Only the normal world decides what to keep in the pool */
+	if (tee_ta_get_calling_session())
+		return TEE_ERROR_ACCESS_DENIED;
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result invoke_command(void *sess_ctx __unused, uint32_t cmd_id,
+				 uint32_t param_types,
+				 TEE_Param params[TEE_NUM_PARAMS])
+{
+	switch (cmd_id) {
+	case PTA_TA_PRELOAD_LOAD:
+		return preload(param_types, params);
+	case PTA_TA_PRELOAD_EVICT:
+		return evict(param_types, params);
+	case PTA_TA_PRELOAD_PLATFORM:
+		return preload_platform(param_types, params);
+	case PTA_TA_PRELOAD_GET_STATS:
+		return get_stats(param_types, params);
+	default:
+		break;
+	}
+	return TEE_ERROR_NOT_IMPLEMENTED;
+}
+
+pseudo_ta_register(.uuid = PTA_TA_PRELOAD_UUID, .name = "ta_preload",
+		   .flags = PTA_DEFAULT_FLAGS,
+		   .open_session_entry_point = open_session,
+		   .invoke_command_entry_point = invoke_command);
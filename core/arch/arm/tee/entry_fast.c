@@ -28,11 +28,14 @@
  */
 
 #include <tee/entry_fast.h>
+#include <tee/entry_std.h>
 #include <optee_msg.h>
 #include <sm/optee_smc.h>
 #include <kernel/generic_boot.h>
 #include <kernel/tee_l2cc_mutex.h>
 #include <kernel/misc.h>
+#include <kernel/pseudo_ta.h>
+#include <tee/uuid.h>
 #include <mm/core_mmu.h>
 
 static void tee_entry_get_shm_config(struct thread_smc_args *args)
@@ -98,7 +101,12 @@ static void tee_entry_exchange_capabilities(struct thread_smc_args *args)
 	}
 
 	args->a0 = OPTEE_SMC_RETURN_OK;
-	args->a1 = OPTEE_SMC_SEC_CAP_HAVE_RESERVED_SHM;
+	args->a1 = OPTEE_SMC_SEC_CAP_HAVE_RESERVED_SHM |
+		   OPTEE_SMC_SEC_CAP_BATCHED_INVOKE |
+		   OPTEE_SMC_SEC_CAP_PTA_FAST_CALL;
+#if defined(CFG_CORE_ASYNC_CALLS)
+	args->a1 |= OPTEE_SMC_SEC_CAP_ASYNC_CALLS;
+#endif
 }
 
 static void tee_entry_disable_shm_cache(struct thread_smc_args *args)
@@ -128,6 +136,48 @@ static void tee_entry_enable_shm_cache(struct thread_smc_args *args)
 		args->a0 = OPTEE_SMC_RETURN_EBUSY;
 }
 
+static void tee_entry_get_async_completion(struct thread_smc_args *args)
+{
+	uint64_t ticket;
+
+	if (!tee_entry_std_get_async_completion(&ticket)) {
+		args->a0 = OPTEE_SMC_RETURN_ENOTAVAIL;
+		return;
+	}
+
+	args->a0 = OPTEE_SMC_RETURN_OK;
+	args->a1 = ticket >> 32;
+	args->a2 = ticket;
+}
+
+static void tee_entry_call_pta_fast(struct thread_smc_args *args)
+{
+	uint32_t out[PTA_FAST_CALL_NUM_OUT] = { 0 };
+	uint32_t w[4] = { args->a1, args->a2, args->a3, args->a4 };
+	uint8_t octets[sizeof(TEE_UUID)];
+	TEE_UUID uuid;
+	TEE_Result res;
+	size_t n;
+
+	/* a1..a4 hold the UUID as big endian words, like OPTEE_MSG_UID_* */
+	for (n = 0; n < sizeof(octets); n++)
+		octets[n] = w[n / 4] >> (24 - (n % 4) * 8);
+	tee_uuid_from_octets(&uuid, octets);
+
+	if (!pseudo_ta_fast_call(&uuid, args->a5, args->a6, out, &res)) {
+		args->a0 = OPTEE_SMC_RETURN_ENOTAVAIL;
+		return;
+	}
+
+	args->a0 = OPTEE_SMC_RETURN_OK;
+	args->a1 = res;
+	args->a2 = out[0];
+	args->a3 = out[1];
+	args->a4 = out[2];
+	args->a5 = out[3];
+	args->a6 = out[4];
+}
+
 static void tee_entry_boot_secondary(struct thread_smc_args *args)
 {
 #if defined(CFG_BOOT_SECONDARY_REQUEST)
@@ -180,6 +230,12 @@ void tee_entry_fast(struct thread_smc_args *args)
 	case OPTEE_SMC_BOOT_SECONDARY:
 		tee_entry_boot_secondary(args);
 		break;
+	case OPTEE_SMC_GET_ASYNC_COMPLETION:
+		tee_entry_get_async_completion(args);
+		break;
+	case OPTEE_SMC_CALL_PTA_FAST:
+		tee_entry_call_pta_fast(args);
+		break;
 
 	default:
 		args->a0 = OPTEE_SMC_RETURN_UNKNOWN_FUNCTION;
@@ -194,7 +250,7 @@ size_t tee_entry_generic_get_api_call_count(void)
 	 * target has additional calls it will call this function and
 	 * add the number of calls the target has added.
 	 */
-	return 9;
+	return 11;
 }
 
 void __weak tee_entry_get_api_call_count(struct thread_smc_args *args)
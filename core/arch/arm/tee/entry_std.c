@@ -30,7 +30,10 @@
 #include <assert.h>
 #include <compiler.h>
 #include <initcall.h>
+#include <kernel/interrupt.h>
+#include <kernel/misc.h>
 #include <kernel/panic.h>
+#include <kernel/spinlock.h>
 #include <kernel/tee_misc.h>
 #include <mm/core_memprot.h>
 #include <mm/core_mmu.h>
@@ -52,6 +55,91 @@ TAILQ_HEAD_INITIALIZER(tee_open_sessions);
 
 static struct mobj *shm_mobj;
 
+#if defined(CFG_CORE_ASYNC_CALLS)
+/* Tickets of completed asynchronous calls not yet collected */
+#define ASYNC_RING_SIZE		(CFG_NUM_THREADS * 2)
+
+static unsigned int async_lock = SPINLOCK_UNLOCK;
+static uint64_t async_next_ticket = 1;
+static uint64_t async_ring[ASYNC_RING_SIZE];
+static size_t async_ring_head;
+static size_t async_ring_count;
+static bool async_ring_overflow;
+
+static uint64_t async_start(void)
+{
+	uint32_t exceptions = thread_mask_exceptions(THREAD_EXCP_ALL);
+	uint64_t ticket;
+
+	cpu_spin_lock(&async_lock);
+	ticket = async_next_ticket++;
+	cpu_spin_unlock(&async_lock);
+	thread_unmask_exceptions(exceptions);
+
+	/* Normal world resumes us when it has CPU time to spare */
+	thread_rpc_async(ticket);
+	return ticket;
+}
+
+static void async_complete(uint64_t ticket)
+{
+	uint32_t exceptions = thread_mask_exceptions(THREAD_EXCP_ALL);
+
+	cpu_spin_lock(&async_lock);
+	if (async_ring_count < ASYNC_RING_SIZE) {
+		async_ring[(async_ring_head + async_ring_count) %
+			   ASYNC_RING_SIZE] = ticket;
+		async_ring_count++;
+	} else {
+		async_ring_overflow = true;
+	}
+	cpu_spin_unlock(&async_lock);
+
+#if defined(CFG_CORE_ASYNC_NOTIF_SGI)
+	itr_raise_sgi(CFG_CORE_ASYNC_NOTIF_SGI, BIT(get_core_pos()));
+#endif
+	thread_unmask_exceptions(exceptions);
+}
+
+bool tee_entry_std_get_async_completion(uint64_t *ticket)
+{
+	uint32_t exceptions = thread_mask_exceptions(THREAD_EXCP_ALL);
+	bool rc = true;
+
+	cpu_spin_lock(&async_lock);
+	if (async_ring_overflow) {
+		/* Normal world has to check all outstanding calls anyway */
+		async_ring_overflow = false;
+		async_ring_count = 0;
+		*ticket = 0;
+	} else if (async_ring_count) {
+		*ticket = async_ring[async_ring_head];
+		async_ring_head = (async_ring_head + 1) % ASYNC_RING_SIZE;
+		async_ring_count--;
+	} else {
+		rc = false;
+	}
+	cpu_spin_unlock(&async_lock);
+	thread_unmask_exceptions(exceptions);
+
+	return rc;
+}
+#else
+static uint64_t async_start(void)
+{
+	return 0;
+}
+
+static void async_complete(uint64_t ticket __unused)
+{
+}
+
+bool tee_entry_std_get_async_completion(uint64_t *ticket __unused)
+{
+	return false;
+}
+#endif
+
 static TEE_Result set_mem_param(const struct optee_msg_param *param,
 				struct param_mem *mem)
 {
@@ -259,8 +347,7 @@ out:
 	smc_args->a0 = OPTEE_SMC_RETURN_OK;
 }
 
-static void entry_invoke_command(struct thread_smc_args *smc_args,
-				 struct optee_msg_arg *arg, uint32_t num_params)
+static void invoke_command(struct optee_msg_arg *arg, uint32_t num_params)
 {
 	TEE_Result res;
 	struct optee_msg_param *params = OPTEE_MSG_GET_PARAMS(arg);
@@ -288,6 +375,51 @@ static void entry_invoke_command(struct thread_smc_args *smc_args,
 out:
 	arg->ret = res;
 	arg->ret_origin = err_orig;
+}
+
+static void entry_invoke_command(struct thread_smc_args *smc_args,
+				 struct optee_msg_arg *arg, uint32_t num_params)
+{
+	invoke_command(arg, num_params);
+	smc_args->a0 = OPTEE_SMC_RETURN_OK;
+}
+
+static void entry_invoke_batch(struct thread_smc_args *smc_args,
+			       struct optee_msg_arg *arg, uint32_t num_params)
+{
+	TEE_Result res = TEE_SUCCESS;
+	struct optee_msg_arg *sub_arg = (void *)OPTEE_MSG_GET_PARAMS(arg);
+	uint32_t num_invokes = arg->func;
+	size_t num_slots = num_params;
+	uint32_t sub_num_params;
+	size_t n;
+
+	/* Each invocation is a struct optee_msg_arg stored in a param slot */
+	COMPILE_TIME_ASSERT(sizeof(struct optee_msg_arg) ==
+			    sizeof(struct optee_msg_param));
+
+	for (n = 0; n < num_invokes; n++) {
+		/* Read once, normal world may update it under our feet */
+		sub_num_params = sub_arg->num_params;
+		if (!num_slots || sub_num_params >= num_slots) {
+			res = TEE_ERROR_BAD_PARAMETERS;
+			break;
+		}
+
+		if (sub_arg->cmd == OPTEE_MSG_CMD_INVOKE_COMMAND) {
+			invoke_command(sub_arg, sub_num_params);
+		} else {
+			sub_arg->ret = TEE_ERROR_BAD_PARAMETERS;
+			sub_arg->ret_origin = TEE_ORIGIN_TEE;
+		}
+
+		num_slots -= sub_num_params + 1;
+		sub_arg = (void *)(OPTEE_MSG_GET_PARAMS(sub_arg) +
+				   sub_num_params);
+	}
+
+	arg->ret = res;
+	arg->ret_origin = TEE_ORIGIN_TEE;
 	smc_args->a0 = OPTEE_SMC_RETURN_OK;
 }
 
@@ -323,8 +455,13 @@ void tee_entry_std(struct thread_smc_args *smc_args)
 	paddr_t parg;
 	struct optee_msg_arg *arg = NULL;	/* fix gcc warning */
 	uint32_t num_params;
+	bool async = false;
+	uint64_t ticket = 0;
 
-	if (smc_args->a0 != OPTEE_SMC_CALL_WITH_ARG) {
+#if defined(CFG_CORE_ASYNC_CALLS)
+	async = smc_args->a0 == OPTEE_SMC_CALL_WITH_ARG_ASYNC;
+#endif
+	if (smc_args->a0 != OPTEE_SMC_CALL_WITH_ARG && !async) {
 		EMSG("Unknown SMC 0x%" PRIx64, (uint64_t)smc_args->a0);
 		DMSG("Expected 0x%x\n", OPTEE_SMC_CALL_WITH_ARG);
 		smc_args->a0 = OPTEE_SMC_RETURN_EBADCMD;
@@ -346,6 +483,9 @@ void tee_entry_std(struct thread_smc_args *smc_args)
 		return;
 	}
 
+	if (async)
+		ticket = async_start();
+
 	thread_set_irq(true);	/* Enable IRQ for STD calls */
 	switch (arg->cmd) {
 	case OPTEE_MSG_CMD_OPEN_SESSION:
@@ -360,10 +500,16 @@ void tee_entry_std(struct thread_smc_args *smc_args)
 	case OPTEE_MSG_CMD_CANCEL:
 		entry_cancel(smc_args, arg, num_params);
 		break;
+	case OPTEE_MSG_CMD_INVOKE_BATCH:
+		entry_invoke_batch(smc_args, arg, num_params);
+		break;
 	default:
 		EMSG("Unknown cmd 0x%x\n", arg->cmd);
 		smc_args->a0 = OPTEE_SMC_RETURN_EBADCMD;
 	}
+
+	if (async)
+		async_complete(ticket);
 }
 
 static TEE_Result default_mobj_init(void)
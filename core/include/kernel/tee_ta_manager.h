@@ -107,11 +107,17 @@ struct tee_ta_ctx {
 	uint32_t ref_count;	/* Reference counter for multi session TA */
 	bool busy;		/* context is busy and cannot be entered */
 	struct condvar busy_cv;	/* CV used when context is busy */
+#if defined(CFG_TA_PRELOAD)
+	bool preloaded;		/* Loaded in advance, not yet used by a session */
+#endif
 };
 
 struct tee_ta_session {
 	TAILQ_ENTRY(tee_ta_session) link;
 	TAILQ_ENTRY(tee_ta_session) link_tsd;
+	LIST_ENTRY(tee_ta_session) link_hash;	/* Session ID hash chain */
+	/* List the session is linked in */
+	struct tee_ta_session_head *open_sessions;
 	struct tee_ta_ctx *ctx;	/* TA context */
 	TEE_Identity clnt_id;	/* Identify of client */
 	bool cancel;		/* True if TAF is cancelled */
@@ -133,6 +139,12 @@ extern struct tee_ta_ctx_head tee_ctxes;
 
 extern struct mutex tee_ta_mutex;
 
+/*
+ * Drops what's cached for @uuid once its last context has been removed
+ * from tee_ctxes. Requires tee_ta_mutex to be held.
+ */
+void tee_ta_flush_caches(const TEE_UUID *uuid);
+
 TEE_Result tee_ta_open_session(TEE_ErrorOrigin *err,
 			       struct tee_ta_session **sess,
 			       struct tee_ta_session_head *open_sessions,
@@ -180,6 +192,40 @@ void tee_ta_put_session(struct tee_ta_session *sess);
 
 void tee_ta_dump_current(void);
 
+#if defined(CFG_TA_PRELOAD)
+/*
+ * tee_ta_preload() - load a user TA instance ahead of its first session
+ * @uuid:	UUID of the TA
+ *
+ * The instance is kept in the preload pool until a session to @uuid
+ * claims it or it's evicted to free secure memory.
+ */
+TEE_Result tee_ta_preload(const TEE_UUID *uuid);
+
+/* Destroys all instances of @uuid still waiting in the preload pool */
+TEE_Result tee_ta_preload_evict(const TEE_UUID *uuid);
+
+/* Requires tee_ta_mutex to be held */
+struct tee_ta_ctx *tee_ta_preload_claim(const TEE_UUID *uuid);
+bool tee_ta_preload_evict_one(void);
+
+void tee_ta_preload_get_stats(size_t *count, size_t *size);
+
+/* UUIDs preloaded by PTA_TA_PRELOAD_PLATFORM, overridden by platforms */
+const TEE_UUID *plat_get_ta_preload_list(size_t *count);
+#else
+static inline struct tee_ta_ctx *tee_ta_preload_claim(
+			const TEE_UUID *uuid __unused)
+{
+	return NULL;
+}
+
+static inline bool tee_ta_preload_evict_one(void)
+{
+	return false;
+}
+#endif
+
 #if defined(CFG_TA_GPROF_SUPPORT)
 void tee_ta_gprof_sample_pc(vaddr_t pc);
 void tee_ta_update_session_utime_suspend(void);
@@ -163,7 +163,8 @@ struct optee_msg_param {
  * struct optee_msg_arg - call argument
  * @cmd: Command, one of OPTEE_MSG_CMD_* or OPTEE_MSG_RPC_CMD_*
  * @func: Trusted Application function, specific to the Trusted Application,
- *	     used if cmd == OPTEE_MSG_CMD_INVOKE_COMMAND
+ *	     used if cmd == OPTEE_MSG_CMD_INVOKE_COMMAND, or number of
+ *	     invocations if cmd == OPTEE_MSG_CMD_INVOKE_BATCH
  * @session: In parameter for all OPTEE_MSG_CMD_* except
  *	     OPTEE_MSG_CMD_OPEN_SESSION where it's an output parameter instead
  * @cancel_id: Cancellation id, a unique value to identify this request
@@ -322,6 +323,20 @@ struct optee_msg_arg {
  * [in] param[0].u.rmem.shm_ref		holds shared memory reference
  * [in] param[0].u.rmem.offs		0
  * [in] param[0].u.rmem.size		0
+ *
+ * OPTEE_MSG_CMD_INVOKE_BATCH invokes several commands, possibly on
+ * different sessions, in a single call. struct optee_msg_arg::func holds
+ * the number of invocations and struct optee_msg_arg::num_params the
+ * number of struct optee_msg_param sized slots following the argument.
+ * The slots hold the invocations back to back, each one formatted as a
+ * struct optee_msg_arg with cmd OPTEE_MSG_CMD_INVOKE_COMMAND followed by
+ * its own params, exactly as it would have been passed alone. The
+ * invocations are executed in order and their results are written back
+ * in place, a failing invocation doesn't stop the following ones.
+ * struct optee_msg_arg::ret of the outer argument only reports if the
+ * batch itself was well formed. Support is indicated with
+ * OPTEE_SMC_SEC_CAP_BATCHED_INVOKE when optee_smc.h is bearer of this
+ * protocol.
  */
 #define OPTEE_MSG_CMD_OPEN_SESSION	0
 #define OPTEE_MSG_CMD_INVOKE_COMMAND	1
@@ -329,6 +344,7 @@ struct optee_msg_arg {
 #define OPTEE_MSG_CMD_CANCEL		3
 #define OPTEE_MSG_CMD_REGISTER_SHM	4
 #define OPTEE_MSG_CMD_UNREGISTER_SHM	5
+#define OPTEE_MSG_CMD_INVOKE_BATCH	6
 #define OPTEE_MSG_FUNCID_CALL_WITH_ARG	0x0004
 
 /*****************************************************************************
@@ -60,6 +60,13 @@ struct tee_file_operations {
 			     bool overwrite);
 	TEE_Result (*remove)(const char *name);
 	TEE_Result (*truncate)(struct tee_file_handle *fh, size_t size);
+	/*
+	 * Optional, updates of the file between begin_transaction() and
+	 * end_transaction() are committed together by end_transaction(),
+	 * or discarded if commit is false.
+	 */
+	TEE_Result (*begin_transaction)(struct tee_file_handle *fh);
+	TEE_Result (*end_transaction)(struct tee_file_handle *fh, bool commit);
 
 	TEE_Result (*opendir)(const char *name, struct tee_fs_dir **d);
 	TEE_Result (*readdir)(struct tee_fs_dir *d, struct tee_fs_dirent **ent);
@@ -46,24 +46,11 @@
 
 #define BLOCK_FILE_SIZE		(1 << BLOCK_FILE_SHIFT)
 
-#define NUM_BLOCKS_PER_FILE	1024
-
 enum tee_fs_file_type {
 	META_FILE,
 	BLOCK_FILE
 };
 
-struct tee_fs_file_info {
-	uint64_t length;
-	uint32_t backup_version_table[NUM_BLOCKS_PER_FILE / 32];
-};
-
-struct tee_fs_file_meta {
-	struct tee_fs_file_info info;
-	uint8_t encrypted_fek[TEE_FS_KM_FEK_SIZE];
-	uint32_t counter;
-};
-
 struct common_header {
 	uint8_t iv[TEE_FS_KM_IV_LEN];
 	uint8_t tag[TEE_FS_KM_MAX_TAG_LEN];
@@ -78,6 +65,18 @@ struct block_header {
 	struct common_header common;
 };
 
+/*
+ * File encryption key in clear text, kept by an open file so that the FEK
+ * is only unwrapped once. The contexts are allocated when first needed and
+ * reused for each block. Must be wiped with tee_fs_key_clear().
+ */
+struct tee_fs_key {
+	uint8_t fek[TEE_FS_KM_FEK_SIZE];
+	void *essiv_ctx;	/* AES-ECB keyed with the ESSIV salt */
+	void *cipher_ctx;
+	void *authenc_ctx;
+};
+
 size_t tee_fs_get_header_size(enum tee_fs_file_type type);
 TEE_Result tee_fs_generate_fek(uint8_t *encrypted_fek, int fek_size);
 TEE_Result tee_fs_encrypt_file(enum tee_fs_file_type file_type,
@@ -89,6 +88,21 @@ TEE_Result tee_fs_decrypt_file(enum tee_fs_file_type file_type,
 		uint8_t *plaintext, size_t *plaintext_size,
 		uint8_t *encrypted_fek);
 TEE_Result tee_fs_crypt_block(uint8_t *out, const uint8_t *in, size_t size,
-			      uint16_t blk_idx, const uint8_t *encrypted_fek,
+			      uint16_t blk_idx, struct tee_fs_key *key,
 			      TEE_OperationMode mode);
+
+/* Unwraps an encrypted FEK, must be called in the context of the owning TA */
+TEE_Result tee_fs_key_init(struct tee_fs_key *key,
+			   const uint8_t *encrypted_fek);
+void tee_fs_key_clear(struct tee_fs_key *key);
+
+/*
+ * Authenticated encryption or decryption of size bytes with the file
+ * encryption key. When encrypting a new IV is generated, iv and tag are
+ * output, when decrypting they are input. aad may be NULL if aad_size is 0.
+ */
+TEE_Result tee_fs_authenc(TEE_OperationMode mode, struct tee_fs_key *key,
+			  uint8_t *iv, uint8_t *tag, const void *aad,
+			  size_t aad_size, const void *in, size_t size,
+			  void *out);
 #endif
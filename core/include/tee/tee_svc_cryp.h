@@ -65,6 +65,8 @@ TEE_Result syscall_hash_update(unsigned long state, const void *chunk,
 			size_t chunk_size);
 TEE_Result syscall_hash_final(unsigned long state, const void *chunk,
 			size_t chunk_size, void *hash, uint64_t *hash_len);
+TEE_Result syscall_hash_final_batch(struct utee_hash_final_op *ops,
+			size_t num_ops);
 
 TEE_Result syscall_cipher_init(unsigned long state, const void *iv,
 			size_t iv_len);
@@ -80,6 +80,15 @@ TEE_Result syscall_storage_obj_seek(unsigned long obj, int32_t offset,
 
 void tee_svc_storage_close_all_enum(struct user_ta_ctx *utc);
 
+/* Drops what's cached for a TA, called when no instance of it is left */
+#ifdef CFG_WITH_USER_TA
+void tee_svc_storage_flush_cache(const TEE_UUID *uuid);
+#else
+static inline void tee_svc_storage_flush_cache(const TEE_UUID *uuid __unused)
+{
+}
+#endif
+
 void tee_svc_storage_init(void);
 
 char *tee_svc_storage_create_filename(struct tee_ta_session *sess,
@@ -52,20 +52,36 @@
 #include <utee_types.h>
 #include <util.h>
 
-/* This mutex protects the critical section in tee_ta_init_session */
+/*
+ * This mutex protects tee_ctxes, the ref_count of the contexts and the
+ * critical section in tee_ta_init_session
+ */
 struct mutex tee_ta_mutex = MUTEX_INITIALIZER;
+/*
+ * This mutex protects the session table, the open_sessions lists and the
+ * reference and lock state of each session
+ */
+static struct mutex tee_ta_sess_mutex = MUTEX_INITIALIZER;
+/* This mutex protects ctx->busy and the single-instance lock */
+static struct mutex tee_ta_busy_mutex = MUTEX_INITIALIZER;
 static struct condvar tee_ta_cv = CONDVAR_INITIALIZER;
 static int tee_ta_single_instance_thread = THREAD_ID_INVALID;
 static size_t tee_ta_single_instance_count;
 struct tee_ta_ctx_head tee_ctxes = TAILQ_HEAD_INITIALIZER(tee_ctxes);
 
+/* Sessions indexed by session ID, must be a power of 2 */
+#define SESS_HASH_SIZE	64
+
+LIST_HEAD(tee_ta_sess_bucket, tee_ta_session);
+static struct tee_ta_sess_bucket sess_hash[SESS_HASH_SIZE];
+
 static void lock_single_instance(void)
 {
-	/* Requires tee_ta_mutex to be held */
+	/* Requires tee_ta_busy_mutex to be held */
 	if (tee_ta_single_instance_thread != thread_get_id()) {
 		/* Wait until the single-instance lock is available. */
 		while (tee_ta_single_instance_thread != THREAD_ID_INVALID)
-			condvar_wait(&tee_ta_cv, &tee_ta_mutex);
+			condvar_wait(&tee_ta_cv, &tee_ta_busy_mutex);
 
 		tee_ta_single_instance_thread = thread_get_id();
 		assert(tee_ta_single_instance_count == 0);
@@ -76,7 +92,7 @@ static void lock_single_instance(void)
 
 static void unlock_single_instance(void)
 {
-	/* Requires tee_ta_mutex to be held */
+	/* Requires tee_ta_busy_mutex to be held */
 	assert(tee_ta_single_instance_thread == thread_get_id());
 	assert(tee_ta_single_instance_count > 0);
 
@@ -89,7 +105,7 @@ static void unlock_single_instance(void)
 
 static bool has_single_instance_lock(void)
 {
-	/* Requires tee_ta_mutex to be held */
+	/* Requires tee_ta_busy_mutex to be held */
 	return tee_ta_single_instance_thread == thread_get_id();
 }
 
@@ -97,7 +113,7 @@ static bool tee_ta_try_set_busy(struct tee_ta_ctx *ctx)
 {
 	bool rc = true;
 
-	mutex_lock(&tee_ta_mutex);
+	mutex_lock(&tee_ta_busy_mutex);
 
 	if (ctx->flags & TA_FLAG_SINGLE_INSTANCE)
 		lock_single_instance();
@@ -119,13 +135,13 @@ static bool tee_ta_try_set_busy(struct tee_ta_ctx *ctx)
 		 * wait for the TA to become available.
 		 */
 		while (ctx->busy)
-			condvar_wait(&ctx->busy_cv, &tee_ta_mutex);
+			condvar_wait(&ctx->busy_cv, &tee_ta_busy_mutex);
 	}
 
 	/* Either it's already true or we should set it to true */
 	ctx->busy = true;
 
-	mutex_unlock(&tee_ta_mutex);
+	mutex_unlock(&tee_ta_busy_mutex);
 	return rc;
 }
 
@@ -137,7 +153,7 @@ static void tee_ta_set_busy(struct tee_ta_ctx *ctx)
 
 static void tee_ta_clear_busy(struct tee_ta_ctx *ctx)
 {
-	mutex_lock(&tee_ta_mutex);
+	mutex_lock(&tee_ta_busy_mutex);
 
 	assert(ctx->busy);
 	ctx->busy = false;
@@ -146,7 +162,7 @@ static void tee_ta_clear_busy(struct tee_ta_ctx *ctx)
 	if (ctx->flags & TA_FLAG_SINGLE_INSTANCE)
 		unlock_single_instance();
 
-	mutex_unlock(&tee_ta_mutex);
+	mutex_unlock(&tee_ta_busy_mutex);
 }
 
 static void dec_session_ref_count(struct tee_ta_session *s)
@@ -159,7 +175,7 @@ static void dec_session_ref_count(struct tee_ta_session *s)
 
 void tee_ta_put_session(struct tee_ta_session *s)
 {
-	mutex_lock(&tee_ta_mutex);
+	mutex_lock(&tee_ta_sess_mutex);
 
 	if (s->lock_thread == thread_get_id()) {
 		s->lock_thread = THREAD_ID_INVALID;
@@ -167,7 +183,13 @@ void tee_ta_put_session(struct tee_ta_session *s)
 	}
 	dec_session_ref_count(s);
 
-	mutex_unlock(&tee_ta_mutex);
+	mutex_unlock(&tee_ta_sess_mutex);
+}
+
+static struct tee_ta_sess_bucket *sess_bucket(uint32_t id)
+{
+	/* Session IDs are heap addresses, the lowest bits are always 0 */
+	return sess_hash + (((id >> 4) ^ (id >> 10)) & (SESS_HASH_SIZE - 1));
 }
 
 static struct tee_ta_session *find_session(uint32_t id,
@@ -175,8 +197,8 @@ static struct tee_ta_session *find_session(uint32_t id,
 {
 	struct tee_ta_session *s;
 
-	TAILQ_FOREACH(s, open_sessions, link) {
-		if ((vaddr_t)s == id)
+	LIST_FOREACH(s, sess_bucket(id), link_hash) {
+		if ((vaddr_t)s == id && s->open_sessions == open_sessions)
 			return s;
 	}
 	return NULL;
@@ -187,7 +209,7 @@ struct tee_ta_session *tee_ta_get_session(uint32_t id, bool exclusive,
 {
 	struct tee_ta_session *s;
 
-	mutex_lock(&tee_ta_mutex);
+	mutex_lock(&tee_ta_sess_mutex);
 
 	while (true) {
 		s = find_session(id, open_sessions);
@@ -204,7 +226,7 @@ struct tee_ta_session *tee_ta_get_session(uint32_t id, bool exclusive,
 		assert(s->lock_thread != thread_get_id());
 
 		while (s->lock_thread != THREAD_ID_INVALID && !s->unlink)
-			condvar_wait(&s->lock_cv, &tee_ta_mutex);
+			condvar_wait(&s->lock_cv, &tee_ta_sess_mutex);
 
 		if (s->unlink) {
 			dec_session_ref_count(s);
@@ -216,14 +238,26 @@ struct tee_ta_session *tee_ta_get_session(uint32_t id, bool exclusive,
 		break;
 	}
 
-	mutex_unlock(&tee_ta_mutex);
+	mutex_unlock(&tee_ta_sess_mutex);
 	return s;
 }
 
+static void tee_ta_link_session(struct tee_ta_session *s,
+			struct tee_ta_session_head *open_sessions)
+{
+	mutex_lock(&tee_ta_sess_mutex);
+
+	s->open_sessions = open_sessions;
+	TAILQ_INSERT_TAIL(open_sessions, s, link);
+	LIST_INSERT_HEAD(sess_bucket((vaddr_t)s), s, link_hash);
+
+	mutex_unlock(&tee_ta_sess_mutex);
+}
+
 static void tee_ta_unlink_session(struct tee_ta_session *s,
 			struct tee_ta_session_head *open_sessions)
 {
-	mutex_lock(&tee_ta_mutex);
+	mutex_lock(&tee_ta_sess_mutex);
 
 	assert(s->ref_count >= 1);
 	assert(s->lock_thread == thread_get_id());
@@ -233,11 +267,12 @@ static void tee_ta_unlink_session(struct tee_ta_session *s,
 	condvar_broadcast(&s->lock_cv);
 
 	while (s->ref_count != 1)
-		condvar_wait(&s->refc_cv, &tee_ta_mutex);
+		condvar_wait(&s->refc_cv, &tee_ta_sess_mutex);
 
 	TAILQ_REMOVE(open_sessions, s, link);
+	LIST_REMOVE(s, link_hash);
 
-	mutex_unlock(&tee_ta_mutex);
+	mutex_unlock(&tee_ta_sess_mutex);
 }
 
 /*
@@ -256,6 +291,12 @@ static struct tee_ta_ctx *tee_ta_context_find(const TEE_UUID *uuid)
 	return NULL;
 }
 
+void tee_ta_flush_caches(const TEE_UUID *uuid)
+{
+	if (!tee_ta_context_find(uuid))
+		tee_svc_storage_flush_cache(uuid);
+}
+
 /* check if requester (client ID) matches session initial client */
 static TEE_Result check_client(struct tee_ta_session *s, const TEE_Identity *id)
 {
@@ -361,6 +402,7 @@ TEE_Result tee_ta_close_session(struct tee_ta_session *csess,
 		DMSG("   ... Destroy TA ctx");
 
 		TAILQ_REMOVE(&tee_ctxes, ctx, link);
+		tee_ta_flush_caches(&ctx->uuid);
 		mutex_unlock(&tee_ta_mutex);
 
 		condvar_destroy(&ctx->busy_cv);
@@ -432,7 +474,16 @@ static TEE_Result tee_ta_init_session(TEE_ErrorOrigin *err,
 
 
 	mutex_lock(&tee_ta_mutex);
-	TAILQ_INSERT_TAIL(open_sessions, s, link);
+
+	/* Look for an instance waiting in the preload pool */
+	ctx = tee_ta_preload_claim(uuid);
+	if (ctx) {
+		DMSG("   ... Use preloaded TA %pUl", (void *)&ctx->uuid);
+		ctx->ref_count++;
+		s->ctx = ctx;
+		res = TEE_SUCCESS;
+		goto out;
+	}
 
 	/* Look for already loaded TA */
 	ctx = tee_ta_context_find(uuid);
@@ -451,13 +502,15 @@ static TEE_Result tee_ta_init_session(TEE_ErrorOrigin *err,
 	res = tee_ta_init_user_ta_session(uuid, s);
 
 out:
+	mutex_unlock(&tee_ta_mutex);
+
 	if (res == TEE_SUCCESS) {
+		/* Only visible to tee_ta_get_session() once fully set up */
+		tee_ta_link_session(s, open_sessions);
 		*sess = s;
 	} else {
-		TAILQ_REMOVE(open_sessions, s, link);
 		free(s);
 	}
-	mutex_unlock(&tee_ta_mutex);
 	return res;
 }
 
@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2017, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <compiler.h>
+#include <kernel/mutex.h>
+#include <kernel/tee_ta_manager.h>
+#include <kernel/user_ta.h>
+#include <mm/mobj.h>
+#include <mm/pgt_cache.h>
+#include <string.h>
+#include <trace.h>
+
+/*
+ * Pool of user TA instances loaded before any client asked for them.
+ *
+ * A preloaded instance is an ordinary context in tee_ctxes with
+ * ref_count == 0 and ctx->preloaded set. The first session opened
+ * towards its UUID takes it over instead of loading the TA through
+ * tee-supplicant. Instances still waiting in the pool are evicted,
+ * oldest first, when the pool exceeds CFG_TA_PRELOAD_MAX_SIZE or when
+ * a TA load runs out of secure DDR.
+ *
+ * Everything here is protected by tee_ta_mutex.
+ */
+
+/* Secure memory held by instances waiting in the pool */
+static size_t preload_size;
+static size_t preload_count;
+
+static size_t ctx_mem_size(struct tee_ta_ctx *ctx)
+{
+	struct user_ta_ctx *utc = to_user_ta_ctx(ctx);
+
+	return utc->mobj_code->size + utc->mobj_stack->size;
+}
+
+static struct tee_ta_ctx *find_preloaded(const TEE_UUID *uuid)
+{
+	struct tee_ta_ctx *ctx;
+
+	TAILQ_FOREACH(ctx, &tee_ctxes, link) {
+		if (!ctx->preloaded)
+			continue;
+		if (!uuid || !memcmp(&ctx->uuid, uuid, sizeof(TEE_UUID)))
+			return ctx;
+	}
+
+	return NULL;
+}
+
+static void unpool(struct tee_ta_ctx *ctx)
+{
+	ctx->preloaded = false;
+	preload_size -= ctx_mem_size(ctx);
+	preload_count--;
+}
+
+static void destroy_preloaded(struct tee_ta_ctx *ctx)
+{
+	DMSG("   ... Evict preloaded TA %pUl", (void *)&ctx->uuid);
+
+	unpool(ctx);
+	TAILQ_REMOVE(&tee_ctxes, ctx, link);
+	tee_ta_flush_caches(&ctx->uuid);
+	condvar_destroy(&ctx->busy_cv);
+	pgt_flush_ctx(ctx);
+	ctx->ops->destroy(ctx);
+}
+
+struct tee_ta_ctx *tee_ta_preload_claim(const TEE_UUID *uuid)
+{
+	struct tee_ta_ctx *ctx = find_preloaded(uuid);
+
+	if (ctx)
+		unpool(ctx);
+	return ctx;
+}
+
+bool tee_ta_preload_evict_one(void)
+{
+	struct tee_ta_ctx *ctx = find_preloaded(NULL);
+
+	if (!ctx)
+		return false;
+	destroy_preloaded(ctx);
+	return true;
+}
+
+TEE_Result tee_ta_preload(const TEE_UUID *uuid)
+{
+	TEE_Result res = TEE_SUCCESS;
+	struct tee_ta_session s = { .ctx = NULL };
+	struct tee_ta_ctx *ctx;
+
+	mutex_lock(&tee_ta_mutex);
+
+	/*
+	 * A single instance TA that is already loaded will be reused by
+	 * the next session anyway, and one waiting instance is enough for
+	 * the others.
+	 */
+	TAILQ_FOREACH(ctx, &tee_ctxes, link) {
+		if (memcmp(&ctx->uuid, uuid, sizeof(TEE_UUID)))
+			continue;
+		if (ctx->preloaded || (ctx->flags & TA_FLAG_SINGLE_INSTANCE))
+			goto out;
+	}
+
+	res = tee_ta_init_user_ta_session(uuid, &s);
+	if (res != TEE_SUCCESS)
+		goto out;
+
+	ctx = s.ctx;
+	ctx->ref_count = 0;
+	ctx->preloaded = true;
+	preload_size += ctx_mem_size(ctx);
+	preload_count++;
+
+	/* New instances are at the tail, so older ones go first */
+	while (preload_size > CFG_TA_PRELOAD_MAX_SIZE) {
+		struct tee_ta_ctx *victim = find_preloaded(NULL);
+
+		if (victim == ctx)
+			res = TEE_ERROR_OUT_OF_MEMORY;
+		destroy_preloaded(victim);
+	}
+
+	DMSG("   ... Preloaded TA %pUl, pool %zu bytes", (void *)uuid,
+	     preload_size);
+out:
+	mutex_unlock(&tee_ta_mutex);
+	return res;
+}
+
+TEE_Result tee_ta_preload_evict(const TEE_UUID *uuid)
+{
+	TEE_Result res = TEE_ERROR_ITEM_NOT_FOUND;
+	struct tee_ta_ctx *ctx;
+
+	mutex_lock(&tee_ta_mutex);
+	while ((ctx = find_preloaded(uuid))) {
+		destroy_preloaded(ctx);
+		res = TEE_SUCCESS;
+	}
+	mutex_unlock(&tee_ta_mutex);
+
+	return res;
+}
+
+void tee_ta_preload_get_stats(size_t *count, size_t *size)
+{
+	mutex_lock(&tee_ta_mutex);
+	*count = preload_count;
+	*size = preload_size;
+	mutex_unlock(&tee_ta_mutex);
+}
+
+__weak const TEE_UUID *plat_get_ta_preload_list(size_t *count)
+{
+	*count = 0;
+	return NULL;
+}
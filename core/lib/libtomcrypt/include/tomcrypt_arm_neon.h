@@ -37,5 +37,7 @@ struct tomcrypt_arm_neon_state {
 void tomcrypt_arm_neon_enable(struct tomcrypt_arm_neon_state *state);
 /* Disables neon instructions after a call to tomcrypt_arm_neon_enable() */
 void tomcrypt_arm_neon_disable(struct tomcrypt_arm_neon_state *state);
+/* Returns non-zero if the CPU implements the ARMv8.2 SHA512 instructions */
+int tomcrypt_arm_sha512_supported(void);
 
 #endif /*TOMCRYPT_ARM_NEON_H*/
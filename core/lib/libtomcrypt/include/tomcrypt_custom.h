@@ -199,6 +199,9 @@
 #ifdef CFG_CRYPTO_SHA512
 #define LTC_SHA512
 #endif
+#ifdef CFG_CRYPTO_SHA512_ARM64_CE
+#define LTC_SHA512_ARM64_CE
+#endif
 
 #define LTC_NO_MACS
 
@@ -211,9 +214,15 @@
 #ifdef CFG_CRYPTO_CCM
    #define LTC_CCM_MODE
 #endif
+#ifdef CFG_CRYPTO_CCM_ARM64_CE
+   #define LTC_CCM_ARM64_CE
+#endif
 #ifdef CFG_CRYPTO_GCM
    #define LTC_GCM_MODE
 #endif
+#ifdef CFG_CRYPTO_GCM_ARM64_CE
+   #define LTC_GCM_PMULL
+#endif
 
 #define LTC_NO_PK
 
@@ -239,6 +248,14 @@
    /* do we want fixed point ECC */
    /* #define LTC_MECC_FP */
 
+   /* comb tables for the base point of the standard curves */
+   #define LTC_ECC_FIXED_BASE
+
+   #ifdef CFG_CRYPTO_ECC_P256
+   /* dedicated P-256 implementation */
+   #define LTC_ECC_P256
+   #endif
+
    /* Timing Resistant */
    #define LTC_ECC_TIMING_RESISTANT
 
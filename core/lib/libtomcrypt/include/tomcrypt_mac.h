@@ -275,6 +275,11 @@ int ccm_memory(int cipher,
 
 int ccm_test(void);
 
+#ifdef LTC_CCM_ARM64_CE
+int ccm_ce_process(ccm_state *ccm, const unsigned char *in,
+                   unsigned char *out, unsigned long blocks, int direction);
+#endif
+
 #endif /* LTC_CCM_MODE */
 
 #if defined(LRW_MODE) || defined(LTC_GCM_MODE)
@@ -323,6 +328,13 @@ __attribute__ ((aligned (16)))
 
 void gcm_mult_h(gcm_state *gcm, unsigned char *I);
 
+#ifdef LTC_GCM_PMULL
+void gcm_ce_ghash(gcm_state *gcm, unsigned char *I, const unsigned char *in,
+                  unsigned long blocks);
+int gcm_ce_process(gcm_state *gcm, const unsigned char *in,
+                   unsigned char *out, unsigned long blocks, int direction);
+#endif
+
 int gcm_init(gcm_state *gcm, int cipher,
              const unsigned char *key, int keylen);
 
@@ -321,6 +321,23 @@ int  ecc_verify_hash(const unsigned char *sig,  unsigned long siglen,
                      const unsigned char *hash, unsigned long hashlen, 
                      int *stat, ecc_key *key);
 
+#ifdef LTC_ECC_P256
+/* fixed size P-256, values are ECC_P256_SIZE bytes big endian */
+#define ECC_P256_SIZE 32
+
+int ecc_p256_make_key(prng_state *prng, int wprng, unsigned char *k,
+		      unsigned char *x, unsigned char *y);
+int ecc_p256_sign_hash_raw(const unsigned char *in, unsigned long inlen,
+			   const unsigned char *k, unsigned char *r,
+			   unsigned char *s, prng_state *prng, int wprng);
+int ecc_p256_verify_hash_raw(const unsigned char *r, const unsigned char *s,
+			     const unsigned char *hash, unsigned long hashlen,
+			     const unsigned char *x, const unsigned char *y,
+			     int *stat);
+int ecc_p256_shared_secret(const unsigned char *k, const unsigned char *x,
+			   const unsigned char *y, unsigned char *out);
+#endif
+
 /* low level functions */
 ecc_point *ltc_ecc_new_point(void);
 void       ltc_ecc_del_point(ecc_point *p);
@@ -352,6 +369,12 @@ void ltc_ecc_fp_tablelock(int lock);
 /* R = kG */
 int ltc_ecc_mulmod(void *k, ecc_point *G, ecc_point *R, void *modulus, int map);
 
+#ifdef LTC_ECC_FIXED_BASE
+/* R = kG with G the base point of dp, CRYPT_NOP if dp has no table */
+int ltc_ecc_fixed_base_mulmod(void *k, const ltc_ecc_set_type *dp,
+			      ecc_point *R, void *modulus);
+#endif
+
 #ifdef LTC_ECC_SHAMIR
 /* kA*A + kB*B = C */
 int ltc_ecc_mul2add(ecc_point *A, void *kA,
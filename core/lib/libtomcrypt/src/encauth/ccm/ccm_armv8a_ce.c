@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2017, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * CCM for ARMv8 with Crypto Extensions, the CBC-MAC and CTR encryption of
+ * whole blocks are done by a single routine.
+ */
+
+#include "tomcrypt.h"
+#include "tomcrypt_arm_neon.h"
+
+#ifdef LTC_CCM_ARM64_CE
+
+typedef unsigned char u8;
+
+/* Prototypes for assembly functions */
+void ce_aes_ccm_encrypt(u8 out[], u8 const in[], u8 const rk[], int rounds,
+			int blocks, u8 mac[], u8 ctr[]);
+void ce_aes_ccm_decrypt(u8 out[], u8 const in[], u8 const rk[], int rounds,
+			int blocks, u8 mac[], u8 ctr[]);
+
+/*
+ * Expects ccm->x == 16 and ccm->CTRlen == 16, that is a full PAD waiting
+ * to be encrypted and a used up key stream, both still hold on return.
+ */
+int ccm_ce_process(ccm_state *ccm, const unsigned char *in,
+		   unsigned char *out, unsigned long blocks, int direction)
+{
+	struct tomcrypt_arm_neon_state state;
+	u8 *rk;
+	int Nr;
+
+	/* The assembly routine knows only about the CE AES key schedule */
+	if (cipher_descriptor[ccm->cipher] != &aes_desc)
+		return CRYPT_NOP;
+	if (!blocks)
+		return CRYPT_OK;
+
+	Nr = ccm->K.rijndael.Nr;
+	rk = (u8 *)ccm->K.rijndael.eK;
+
+	tomcrypt_arm_neon_enable(&state);
+	if (direction == CCM_ENCRYPT)
+		ce_aes_ccm_encrypt(out, in, rk, Nr, blocks, ccm->PAD, ccm->ctr);
+	else
+		ce_aes_ccm_decrypt(out, in, rk, Nr, blocks, ccm->PAD, ccm->ctr);
+	tomcrypt_arm_neon_disable(&state);
+
+	return CRYPT_OK;
+}
+
+#endif /* LTC_CCM_ARM64_CE */
@@ -54,8 +54,12 @@ int ccm_process(ccm_state *ccm,
                 unsigned char *ct,
                 int direction)
 {
-   unsigned char  y, z, b;
+   unsigned long  y;
+   unsigned char  z, b;
    int err;
+#ifdef LTC_CCM_ARM64_CE
+   unsigned long  blocks;
+#endif
 
    LTC_ARGCHK(ccm != NULL);
 
@@ -77,6 +81,25 @@ int ccm_process(ccm_state *ccm,
       y = 0;
 
       for (; y < ptlen; y++) {
+#ifdef LTC_CCM_ARM64_CE
+         /* whole blocks while both the MAC and the CTR are block aligned */
+         if (ccm->x == 16 && ccm->CTRlen == 16 && ptlen - y >= 16) {
+            blocks = (ptlen - y) / 16;
+            if (direction == CCM_ENCRYPT) {
+               err = ccm_ce_process(ccm, pt + y, ct + y, blocks, direction);
+            } else {
+               err = ccm_ce_process(ccm, ct + y, pt + y, blocks, direction);
+            }
+            if (err == CRYPT_OK) {
+               y += blocks * 16;
+               if (y == ptlen) {
+                  break;
+               }
+            } else if (err != CRYPT_NOP) {
+               return err;
+            }
+         }
+#endif
          /* increment the ctr? */
          if (ccm->CTRlen == 16) {
             for (z = 15; z > 15-ccm->L; z--) {
@@ -4,5 +4,9 @@ srcs-y += ccm_add_aad.c
 srcs-y += ccm_process.c
 srcs-y += ccm_done.c
 srcs-y += ccm_reset.c
+ifeq ($(CFG_CRYPTO_CCM_ARM64_CE),y)
+srcs-y += ccm_armv8a_ce.c
+srcs-y += ccm_armv8a_ce_a64.S
+endif
 # srcs-y += ccm_memory.c
 # srcs-y += ccm_test.c
@@ -115,7 +115,14 @@ int gcm_add_aad(gcm_state *gcm,
    }
 
    x = 0;
-#ifdef LTC_FAST
+#ifdef LTC_GCM_PMULL
+   if (gcm->buflen == 0) {
+      x = adatalen & ~15;
+      gcm_ce_ghash(gcm, gcm->X, adata, x / 16);
+      gcm->totlen += x * CONST64(8);
+      adata += x;
+   }
+#elif defined(LTC_FAST)
    if (gcm->buflen == 0) {
       for (x = 0; x < (adatalen & ~15); x += 16) {
           for (y = 0; y < 16; y += sizeof(LTC_FAST_TYPE)) {
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2017, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * GCM for ARMv8 with Crypto Extensions, GHASH is computed with 64x64
+ * polynomial multiplication (PMULL) and, when the cipher is AES, the
+ * CTR encryption is interleaved with the GHASH of the previous block.
+ */
+
+#include "tomcrypt.h"
+#include "tomcrypt_arm_neon.h"
+
+#ifdef LTC_GCM_PMULL
+
+typedef unsigned char u8;
+
+/* Prototypes for assembly functions */
+void ce_gcm_ghash(u8 dg[], u8 const h[], u8 const src[], int blocks);
+void ce_aes_gcm_encrypt(u8 out[], u8 const in[], u8 const rk[], int rounds,
+			int blocks, u8 ctr[], u8 ks[], u8 dg[], u8 const h[]);
+void ce_aes_gcm_decrypt(u8 out[], u8 const in[], u8 const rk[], int rounds,
+			int blocks, u8 ctr[], u8 ks[], u8 dg[], u8 const h[]);
+
+void gcm_ce_ghash(gcm_state *gcm, unsigned char *I, const unsigned char *in,
+		  unsigned long blocks)
+{
+	struct tomcrypt_arm_neon_state state;
+
+	if (!blocks)
+		return;
+
+	tomcrypt_arm_neon_enable(&state);
+	ce_gcm_ghash(I, gcm->H, in, blocks);
+	tomcrypt_arm_neon_disable(&state);
+}
+
+int gcm_ce_process(gcm_state *gcm, const unsigned char *in,
+		   unsigned char *out, unsigned long blocks, int direction)
+{
+	struct tomcrypt_arm_neon_state state;
+	u8 *rk;
+	int Nr;
+
+	/* The interleaved routine knows only about the CE AES key schedule */
+	if (cipher_descriptor[gcm->cipher] != &aes_desc)
+		return CRYPT_NOP;
+	if (!blocks)
+		return CRYPT_OK;
+
+	Nr = gcm->K.rijndael.Nr;
+	rk = (u8 *)gcm->K.rijndael.eK;
+
+	tomcrypt_arm_neon_enable(&state);
+	if (direction == GCM_ENCRYPT)
+		ce_aes_gcm_encrypt(out, in, rk, Nr, blocks, gcm->Y, gcm->buf,
+				   gcm->X, gcm->H);
+	else
+		ce_aes_gcm_decrypt(out, in, rk, Nr, blocks, gcm->Y, gcm->buf,
+				   gcm->X, gcm->H);
+	tomcrypt_arm_neon_disable(&state);
+
+	gcm->pttotlen += blocks * CONST64(128);
+
+	return CRYPT_OK;
+}
+
+#endif /* LTC_GCM_PMULL */
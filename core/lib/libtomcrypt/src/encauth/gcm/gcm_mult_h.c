@@ -50,6 +50,11 @@
  */
 void gcm_mult_h(gcm_state *gcm, unsigned char *I)
 {
+#ifdef LTC_GCM_PMULL
+   static const unsigned char zero[16];
+
+   gcm_ce_ghash(gcm, I, zero, 1);
+#else
    unsigned char T[16];
 #ifdef LTC_GCM_TABLES
    int x;
@@ -78,6 +83,7 @@ void gcm_mult_h(gcm_state *gcm, unsigned char *I)
    gcm_gf_mult(gcm->H, I, T); 
 #endif
    XMEMCPY(I, T, 16);
+#endif /* LTC_GCM_PMULL */
 }
 #endif
 
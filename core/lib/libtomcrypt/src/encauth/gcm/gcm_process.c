@@ -102,10 +102,24 @@ int gcm_process(gcm_state *gcm,
    }
 
    x = 0;
+#ifdef LTC_GCM_PMULL
+   if (gcm->buflen == 0) {
+      if (direction == GCM_ENCRYPT) {
+         err = gcm_ce_process(gcm, pt, ct, ptlen / 16, direction);
+      } else {
+         err = gcm_ce_process(gcm, ct, pt, ptlen / 16, direction);
+      }
+      if (err == CRYPT_OK) {
+         x = ptlen & ~15;
+      } else if (err != CRYPT_NOP) {
+         return err;
+      }
+   }
+#endif
 #ifdef LTC_FAST
    if (gcm->buflen == 0) {
       if (direction == GCM_ENCRYPT) { 
-         for (x = 0; x < (ptlen & ~15); x += 16) {
+         for (; x < (ptlen & ~15); x += 16) {
              /* ctr encrypt */
              for (y = 0; y < 16; y += sizeof(LTC_FAST_TYPE)) {
                  *((LTC_FAST_TYPE*)(&ct[x + y])) = *((LTC_FAST_TYPE*)(&pt[x+y])) ^ *((LTC_FAST_TYPE*)(&gcm->buf[y]));
@@ -123,7 +137,7 @@ int gcm_process(gcm_state *gcm,
              }
          }
       } else {
-         for (x = 0; x < (ptlen & ~15); x += 16) {
+         for (; x < (ptlen & ~15); x += 16) {
              /* ctr encrypt */
              for (y = 0; y < 16; y += sizeof(LTC_FAST_TYPE)) {
                  *((LTC_FAST_TYPE*)(&gcm->X[y])) ^= *((LTC_FAST_TYPE*)(&ct[x+y]));
@@ -7,4 +7,8 @@ srcs-y += gcm_memory.c
 srcs-y += gcm_mult_h.c
 srcs-y += gcm_process.c
 srcs-y += gcm_reset.c
+ifeq ($(CFG_CRYPTO_GCM_ARM64_CE),y)
+srcs-y += gcm_armv8a_ce.c
+srcs-y += gcm_armv8a_ce_a64.S
+endif
 # srcs-y += gcm_test.c
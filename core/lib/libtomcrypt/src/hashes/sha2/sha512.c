@@ -36,6 +36,9 @@
  * Tom St Denis, tomstdenis@gmail.com, http://libtom.org
  */
 #include "tomcrypt.h"
+#ifdef LTC_SHA512_ARM64_CE
+#include "tomcrypt_arm_neon.h"
+#endif
 
 /**
    @param sha512.c
@@ -194,6 +197,33 @@ static int sha512_compress(hash_state * md, unsigned char *buf)
 }
 #endif
 
+#ifdef LTC_SHA512_ARM64_CE
+/* Implemented in assembly */
+int sha512_ce_transform(ulong64 *state, unsigned char *buf, int blocks);
+#endif
+
+static int sha512_compress_nblocks(hash_state *md, unsigned char *buf, int blocks)
+{
+    int err;
+#ifdef LTC_SHA512_ARM64_CE
+    struct tomcrypt_arm_neon_state state;
+
+    if (tomcrypt_arm_sha512_supported()) {
+        tomcrypt_arm_neon_enable(&state);
+        sha512_ce_transform(md->sha512.state, buf, blocks);
+        tomcrypt_arm_neon_disable(&state);
+        return CRYPT_OK;
+    }
+#endif
+
+    for (; blocks > 0; blocks--, buf += 128) {
+        if ((err = sha512_compress(md, buf)) != CRYPT_OK) {
+            return err;
+        }
+    }
+    return CRYPT_OK;
+}
+
 /**
    Initialize the hash state
    @param md   The hash state you wish to initialize
@@ -222,7 +252,7 @@ int sha512_init(hash_state * md)
    @param inlen  The length of the data (octets)
    @return CRYPT_OK if successful
 */
-HASH_PROCESS(sha512_process, sha512_compress, sha512, 128)
+HASH_PROCESS_NBLOCKS(sha512_process, sha512_compress_nblocks, sha512, 128)
 
 /**
    Terminate the hash to get the digest
@@ -255,7 +285,7 @@ int sha512_done(hash_state * md, unsigned char *out)
         while (md->sha512.curlen < 128) {
             md->sha512.buf[md->sha512.curlen++] = (unsigned char)0;
         }
-        sha512_compress(md, md->sha512.buf);
+        sha512_compress_nblocks(md, md->sha512.buf, 1);
         md->sha512.curlen = 0;
     }
 
@@ -269,7 +299,7 @@ int sha512_done(hash_state * md, unsigned char *out)
 
     /* store length */
     STORE64H(md->sha512.length, md->sha512.buf+120);
-    sha512_compress(md, md->sha512.buf);
+    sha512_compress_nblocks(md, md->sha512.buf, 1);
 
     /* copy output */
     for (i = 0; i < 8; i++) {
@@ -15,3 +15,6 @@ endif
 
 srcs-$(CFG_CRYPTO_SHA384) += sha384.c
 srcs-$(CFG_CRYPTO_SHA512) += sha512.c
+ifeq ($(CFG_CRYPTO_SHA512),y)
+srcs-$(CFG_CRYPTO_SHA512_ARM64_CE) += sha512_armv8a_ce_a64.S
+endif
@@ -125,7 +125,7 @@ int xts_decrypt(const unsigned char *ct, unsigned long ptlen, unsigned char *pt,
 
 	   /* use accelerated decryption for whole blocks */
 	   if ((err = desc->accel_xts_decrypt(ct, pt, lim, tweak, &xts->key1,
-					      &xts->key2) != CRYPT_OK)) {
+					      &xts->key2)) != CRYPT_OK) {
 	      return err;
 	   }
 	   ct += lim * 16;
@@ -127,7 +127,7 @@ int xts_encrypt(const unsigned char *pt, unsigned long ptlen, unsigned char *ct,
 
       /* use accelerated encryption for whole blocks */
       if ((err = desc->accel_xts_encrypt(pt, ct, lim, tweak, &xts->key1,
-					 &xts->key2) != CRYPT_OK)) {
+					 &xts->key2)) != CRYPT_OK) {
 	 return err;
       }
       ct += lim * 16;
@@ -559,14 +559,29 @@ static int exptmod(void *a, void *b, void *c, void *d)
 	mod(a, c, d_tmp);
 
 
-	mpa_exp_mod((mpanum) d,
-			(const mpanum) d_tmp,
-			(const mpanum) b,
-			(const mpanum) c,
-			((mpa_fmm_context)c_mont)->r_ptr,
-			((mpa_fmm_context)c_mont)->r2_ptr,
-			((mpa_fmm_context)c_mont)->n_inv,
-			external_mem_pool);
+	/*
+	 * Exponents of at most 32 bits are public ones, such as the RSA
+	 * public exponent, secret exponents (RSA d, dP, dQ and DH/DSA
+	 * private keys) are always much larger.
+	 */
+	if (mpa_highest_bit_index((const mpanum) b) < 32)
+		mpa_exp_mod_public((mpanum) d,
+				(const mpanum) d_tmp,
+				(const mpanum) b,
+				(const mpanum) c,
+				((mpa_fmm_context)c_mont)->r_ptr,
+				((mpa_fmm_context)c_mont)->r2_ptr,
+				((mpa_fmm_context)c_mont)->n_inv,
+				external_mem_pool);
+	else
+		mpa_exp_mod((mpanum) d,
+				(const mpanum) d_tmp,
+				(const mpanum) b,
+				(const mpanum) c,
+				((mpa_fmm_context)c_mont)->r_ptr,
+				((mpa_fmm_context)c_mont)->r2_ptr,
+				((mpa_fmm_context)c_mont)->n_inv,
+				external_mem_pool);
 	montgomery_deinit(c_mont);
 	if (memguard) {
 		deinit(d_tmp);
@@ -0,0 +1,925 @@
+/*
+ * Copyright (c) 2017, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * NIST P-256 with fixed size field elements.
+ *
+ * Field elements are eight 32-bit limbs, least significant first, always
+ * fully reduced modulo p. Products are reduced with the fast reduction
+ * for the Solinas prime p (FIPS 186-4, D.2.3) instead of a generic
+ * modular reduction. Scalars modulo the group order n use Montgomery
+ * multiplication on the same limb size.
+ *
+ * Everything involving the private key or the nonce runs in constant
+ * time: no branch or memory access depends on secret data. Signature
+ * verification only handles public data and uses a faster variable time
+ * double scalar multiplication.
+ *
+ * Inputs that the functions below don't handle, such as a hash larger
+ * than 32 bytes or a private key not in [1, n - 1], return CRYPT_NOP so
+ * the caller can use the generic ltc_ecc_* code instead.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "tomcrypt.h"
+
+#ifdef LTC_ECC_P256
+
+#define P256_LIMBS	8
+#define P256_WINDOW	4
+#define P256_TABLE_SIZE	(1 << P256_WINDOW)
+
+typedef uint32_t p256_int[P256_LIMBS];
+
+/* Jacobian coordinates, z == 0 is the point at infinity */
+struct p256_point {
+	p256_int x;
+	p256_int y;
+	p256_int z;
+};
+
+static const p256_int p256_p = {
+	0xffffffff, 0xffffffff, 0xffffffff, 0x00000000,
+	0x00000000, 0x00000000, 0x00000001, 0xffffffff
+};
+
+static const p256_int p256_b = {
+	0x27d2604b, 0x3bce3c3e, 0xcc53b0f6, 0x651d06b0,
+	0x769886bc, 0xb3ebbd55, 0xaa3a93e7, 0x5ac635d8
+};
+
+static const p256_int p256_gx = {
+	0xd898c296, 0xf4a13945, 0x2deb33a0, 0x77037d81,
+	0x63a440f2, 0xf8bce6e5, 0xe12c4247, 0x6b17d1f2
+};
+
+static const p256_int p256_gy = {
+	0x37bf51f5, 0xcbb64068, 0x6b315ece, 0x2bce3357,
+	0x7c0f9e16, 0x8ee7eb4a, 0xfe1a7f9b, 0x4fe342e2
+};
+
+static const p256_int p256_n = {
+	0xfc632551, 0xf3b9cac2, 0xa7179e84, 0xbce6faad,
+	0xffffffff, 0xffffffff, 0x00000000, 0xffffffff
+};
+
+/* 2^512 mod n */
+static const p256_int p256_n_r2 = {
+	0xbe79eea2, 0x83244c95, 0x49bd6fa6, 0x4699799c,
+	0x2b6bec59, 0x2845b239, 0xf3d95620, 0x66e12d94
+};
+
+/* 2^256 mod n, 1 in Montgomery form */
+static const p256_int p256_n_one = {
+	0x039cdaaf, 0x0c46353d, 0x58e8617b, 0x43190552,
+	0x00000000, 0x00000000, 0xffffffff, 0x00000000
+};
+
+/* -n^-1 mod 2^32 */
+#define P256_N0INV	0xee00bc4f
+
+static const p256_int p256_one = { 1 };
+
+/* Returns 0xffffffff if bit is 1 and 0 if bit is 0 */
+static uint32_t mask_from_bit(uint32_t bit)
+{
+	return 0 - bit;
+}
+
+/* Returns 0xffffffff if v == 0 and 0 otherwise */
+static uint32_t mask_is_zero_word(uint32_t v)
+{
+	return mask_from_bit(((v | (0 - v)) >> 31) ^ 1);
+}
+
+static uint32_t mask_is_zero(const p256_int a)
+{
+	uint32_t v = 0;
+	size_t i;
+
+	for (i = 0; i < P256_LIMBS; i++)
+		v |= a[i];
+	return mask_is_zero_word(v);
+}
+
+static uint32_t mask_is_equal(const p256_int a, const p256_int b)
+{
+	p256_int t;
+	size_t i;
+
+	for (i = 0; i < P256_LIMBS; i++)
+		t[i] = a[i] ^ b[i];
+	return mask_is_zero(t);
+}
+
+/* r = a if mask is all ones, unchanged if mask is 0 */
+static void int_cmov(p256_int r, const p256_int a, uint32_t mask)
+{
+	size_t i;
+
+	for (i = 0; i < P256_LIMBS; i++)
+		r[i] ^= mask & (r[i] ^ a[i]);
+}
+
+/* r = a + b, returns the carry */
+static uint32_t int_add(p256_int r, const p256_int a, const p256_int b)
+{
+	uint64_t t = 0;
+	size_t i;
+
+	for (i = 0; i < P256_LIMBS; i++) {
+		t += (uint64_t)a[i] + b[i];
+		r[i] = (uint32_t)t;
+		t >>= 32;
+	}
+	return (uint32_t)t;
+}
+
+/* r = a - b, returns the borrow */
+static uint32_t int_sub(p256_int r, const p256_int a, const p256_int b)
+{
+	int64_t t = 0;
+	size_t i;
+
+	for (i = 0; i < P256_LIMBS; i++) {
+		t += (int64_t)a[i] - b[i];
+		r[i] = (uint32_t)t;
+		t >>= 32;
+	}
+	return (uint32_t)t & 1;
+}
+
+/* r = a - m if a >= m, or if carry is set; r = a otherwise */
+static void mod_sub_once(p256_int r, const p256_int a, uint32_t carry,
+			 const p256_int m)
+{
+	p256_int t;
+	uint32_t borrow = int_sub(t, a, m);
+
+	memcpy(r, a, sizeof(p256_int));
+	int_cmov(r, t, mask_from_bit(carry | (borrow ^ 1)));
+}
+
+/* r = a + b mod m, a and b less than m */
+static void mod_add(p256_int r, const p256_int a, const p256_int b,
+		    const p256_int m)
+{
+	uint32_t carry = int_add(r, a, b);
+
+	mod_sub_once(r, r, carry, m);
+}
+
+/* r = a - b mod m, a and b less than m */
+static void mod_sub(p256_int r, const p256_int a, const p256_int b,
+		    const p256_int m)
+{
+	p256_int t;
+	uint32_t borrow = int_sub(r, a, b);
+
+	int_add(t, r, m);
+	int_cmov(r, t, mask_from_bit(borrow));
+}
+
+static void int_from_bytes(p256_int r, const unsigned char *in)
+{
+	size_t i;
+
+	for (i = 0; i < P256_LIMBS; i++)
+		LOAD32H(r[i], in + (P256_LIMBS - 1 - i) * 4);
+}
+
+static void int_to_bytes(unsigned char *out, const p256_int a)
+{
+	size_t i;
+
+	for (i = 0; i < P256_LIMBS; i++)
+		STORE32H(a[i], out + (P256_LIMBS - 1 - i) * 4);
+}
+
+/* Returns 1 if a < m */
+static int int_is_less(const p256_int a, const p256_int m)
+{
+	p256_int t;
+
+	return int_sub(t, a, m);
+}
+
+static unsigned int int_get_bit(const p256_int a, unsigned int n)
+{
+	return (a[n / 32] >> (n % 32)) & 1;
+}
+
+static void fe_add(p256_int r, const p256_int a, const p256_int b)
+{
+	mod_add(r, a, b, p256_p);
+}
+
+static void fe_sub(p256_int r, const p256_int a, const p256_int b)
+{
+	mod_sub(r, a, b, p256_p);
+}
+
+/*
+ * r = c mod p where c is a 512-bit product, using
+ * c = s1 + 2 * s2 + 2 * s3 + s4 + s5 - s6 - s7 - s8 - s9 mod p
+ * with the s1 ... s9 of FIPS 186-4, D.2.3.
+ */
+static void fe_reduce(p256_int r, const uint32_t c[2 * P256_LIMBS])
+{
+	int64_t c0 = c[0], c1 = c[1], c2 = c[2], c3 = c[3];
+	int64_t c4 = c[4], c5 = c[5], c6 = c[6], c7 = c[7];
+	int64_t c8 = c[8], c9 = c[9], c10 = c[10], c11 = c[11];
+	int64_t c12 = c[12], c13 = c[13], c14 = c[14], c15 = c[15];
+	int64_t l[P256_LIMBS];
+	int64_t acc;
+	int64_t top;
+	size_t i;
+	size_t n;
+
+	l[0] = c0 + c8 + c9 - c11 - c12 - c13 - c14;
+	l[1] = c1 + c9 + c10 - c12 - c13 - c14 - c15;
+	l[2] = c2 + c10 + c11 - c13 - c14 - c15;
+	l[3] = c3 + 2 * c11 + 2 * c12 + c13 - c15 - c8 - c9;
+	l[4] = c4 + 2 * c12 + 2 * c13 + c14 - c9 - c10;
+	l[5] = c5 + 2 * c13 + 2 * c14 + c15 - c10 - c11;
+	l[6] = c6 + 3 * c14 + 2 * c15 + c13 - c8 - c9;
+	l[7] = c7 + 3 * c15 + c8 - c10 - c11 - c12 - c13;
+
+	acc = 0;
+	for (i = 0; i < P256_LIMBS; i++) {
+		acc += l[i];
+		r[i] = (uint32_t)acc;
+		acc >>= 32;
+	}
+	top = acc;
+
+	/*
+	 * Fold top * 2^256 = top * (2^224 - 2^192 - 2^96 + 1) mod p back
+	 * in. The first round leaves top in [-1, 1], the second one 0.
+	 */
+	for (n = 0; n < 2; n++) {
+		acc = 0;
+		for (i = 0; i < P256_LIMBS; i++) {
+			acc += r[i];
+			if (i == 0 || i == 7)
+				acc += top;
+			if (i == 3 || i == 6)
+				acc -= top;
+			r[i] = (uint32_t)acc;
+			acc >>= 32;
+		}
+		top = acc;
+	}
+
+	mod_sub_once(r, r, 0, p256_p);
+}
+
+static void fe_mul(p256_int r, const p256_int a, const p256_int b)
+{
+	uint32_t c[2 * P256_LIMBS] = { 0 };
+	uint64_t t;
+	size_t i;
+	size_t j;
+
+	for (i = 0; i < P256_LIMBS; i++) {
+		t = 0;
+		for (j = 0; j < P256_LIMBS; j++) {
+			t += (uint64_t)a[i] * b[j] + c[i + j];
+			c[i + j] = (uint32_t)t;
+			t >>= 32;
+		}
+		c[i + P256_LIMBS] = (uint32_t)t;
+	}
+	fe_reduce(r, c);
+}
+
+static void fe_sqr(p256_int r, const p256_int a)
+{
+	fe_mul(r, a, a);
+}
+
+/* r = a^(p - 2) = a^-1 mod p, the exponent is public */
+static void fe_inv(p256_int r, const p256_int a)
+{
+	p256_int e;
+	p256_int t;
+	int i;
+
+	memcpy(e, p256_p, sizeof(e));
+	e[0] -= 2;
+	memcpy(t, p256_one, sizeof(t));
+	for (i = 255; i >= 0; i--) {
+		fe_sqr(t, t);
+		if (int_get_bit(e, i))
+			fe_mul(t, t, a);
+	}
+	memcpy(r, t, sizeof(t));
+}
+
+/*
+ * Montgomery multiplication modulo n, r = a * b / 2^256 mod n with a and
+ * b less than n
+ */
+static void sc_mont_mul(p256_int r, const p256_int a, const p256_int b)
+{
+	uint32_t t[P256_LIMBS + 2] = { 0 };
+	uint64_t s;
+	uint32_t m;
+	size_t i;
+	size_t j;
+
+	for (i = 0; i < P256_LIMBS; i++) {
+		s = 0;
+		for (j = 0; j < P256_LIMBS; j++) {
+			s += (uint64_t)a[j] * b[i] + t[j];
+			t[j] = (uint32_t)s;
+			s >>= 32;
+		}
+		s += t[P256_LIMBS];
+		t[P256_LIMBS] = (uint32_t)s;
+		t[P256_LIMBS + 1] = (uint32_t)(s >> 32);
+
+		m = t[0] * P256_N0INV;
+		s = (uint64_t)m * p256_n[0] + t[0];
+		s >>= 32;
+		for (j = 1; j < P256_LIMBS; j++) {
+			s += (uint64_t)m * p256_n[j] + t[j];
+			t[j - 1] = (uint32_t)s;
+			s >>= 32;
+		}
+		s += t[P256_LIMBS];
+		t[P256_LIMBS - 1] = (uint32_t)s;
+		t[P256_LIMBS] = t[P256_LIMBS + 1] + (uint32_t)(s >> 32);
+	}
+	mod_sub_once(r, t, t[P256_LIMBS], p256_n);
+}
+
+/* r = a * b mod n */
+static void sc_mul(p256_int r, const p256_int a, const p256_int b)
+{
+	sc_mont_mul(r, a, b);
+	sc_mont_mul(r, r, p256_n_r2);
+}
+
+/* r = a^(n - 2) = a^-1 mod n, the exponent is public */
+static void sc_inv(p256_int r, const p256_int a)
+{
+	p256_int e;
+	p256_int am;
+	p256_int t;
+	int i;
+
+	memcpy(e, p256_n, sizeof(e));
+	e[0] -= 2;
+	sc_mont_mul(am, a, p256_n_r2);
+	memcpy(t, p256_n_one, sizeof(t));
+	for (i = 255; i >= 0; i--) {
+		sc_mont_mul(t, t, t);
+		if (int_get_bit(e, i))
+			sc_mont_mul(t, t, am);
+	}
+	sc_mont_mul(r, t, p256_one);
+	zeromem(am, sizeof(am));
+	zeromem(t, sizeof(t));
+}
+
+static void point_cmov(struct p256_point *r, const struct p256_point *a,
+		       uint32_t mask)
+{
+	int_cmov(r->x, a->x, mask);
+	int_cmov(r->y, a->y, mask);
+	int_cmov(r->z, a->z, mask);
+}
+
+/* r = 2 * a, "dbl-2001-b" for a = -3 */
+static void point_double(struct p256_point *r, const struct p256_point *a)
+{
+	p256_int delta;
+	p256_int gamma;
+	p256_int beta;
+	p256_int alpha;
+	p256_int t1;
+	p256_int t2;
+
+	fe_sqr(delta, a->z);
+	fe_sqr(gamma, a->y);
+	fe_mul(beta, a->x, gamma);
+
+	/* alpha = 3 * (x - delta) * (x + delta) */
+	fe_sub(t1, a->x, delta);
+	fe_add(t2, a->x, delta);
+	fe_mul(alpha, t1, t2);
+	fe_add(t1, alpha, alpha);
+	fe_add(alpha, t1, alpha);
+
+	/* z3 = (y + z)^2 - gamma - delta */
+	fe_add(t1, a->y, a->z);
+	fe_sqr(t1, t1);
+	fe_sub(t1, t1, gamma);
+	fe_sub(r->z, t1, delta);
+
+	/* x3 = alpha^2 - 8 * beta */
+	fe_add(beta, beta, beta);
+	fe_add(beta, beta, beta);
+	fe_add(t2, beta, beta);
+	fe_sqr(t1, alpha);
+	fe_sub(r->x, t1, t2);
+
+	/* y3 = alpha * (4 * beta - x3) - 8 * gamma^2 */
+	fe_sub(t1, beta, r->x);
+	fe_mul(t1, alpha, t1);
+	fe_sqr(gamma, gamma);
+	fe_add(gamma, gamma, gamma);
+	fe_add(gamma, gamma, gamma);
+	fe_add(gamma, gamma, gamma);
+	fe_sub(r->y, t1, gamma);
+}
+
+/*
+ * r = a + b, "add-2007-bl". The result is only meaningful if a and b are
+ * different and neither is the point at infinity. Returns a mask which
+ * is all ones if a and b have the same x coordinate.
+ */
+static uint32_t point_add(struct p256_point *r, const struct p256_point *a,
+			  const struct p256_point *b)
+{
+	p256_int z1z1;
+	p256_int z2z2;
+	p256_int u1;
+	p256_int u2;
+	p256_int s1;
+	p256_int s2;
+	p256_int h;
+	p256_int i;
+	p256_int j;
+	p256_int rr;
+	p256_int v;
+	p256_int t;
+
+	fe_sqr(z1z1, a->z);
+	fe_sqr(z2z2, b->z);
+	fe_mul(u1, a->x, z2z2);
+	fe_mul(u2, b->x, z1z1);
+	fe_mul(s1, a->y, b->z);
+	fe_mul(s1, s1, z2z2);
+	fe_mul(s2, b->y, a->z);
+	fe_mul(s2, s2, z1z1);
+
+	fe_sub(h, u2, u1);
+	fe_add(i, h, h);
+	fe_sqr(i, i);
+	fe_mul(j, h, i);
+	fe_sub(rr, s2, s1);
+	fe_add(rr, rr, rr);
+	fe_mul(v, u1, i);
+
+	/* z3 = ((z1 + z2)^2 - z1z1 - z2z2) * h */
+	fe_add(t, a->z, b->z);
+	fe_sqr(t, t);
+	fe_sub(t, t, z1z1);
+	fe_sub(t, t, z2z2);
+	fe_mul(r->z, t, h);
+
+	/* x3 = rr^2 - j - 2 * v */
+	fe_sqr(t, rr);
+	fe_sub(t, t, j);
+	fe_sub(t, t, v);
+	fe_sub(r->x, t, v);
+
+	/* y3 = rr * (v - x3) - 2 * s1 * j */
+	fe_sub(t, v, r->x);
+	fe_mul(t, rr, t);
+	fe_mul(s1, s1, j);
+	fe_add(s1, s1, s1);
+	fe_sub(r->y, t, s1);
+
+	return mask_is_zero(h);
+}
+
+static void point_to_affine(p256_int x, p256_int y,
+			    const struct p256_point *a)
+{
+	p256_int zinv;
+	p256_int t;
+
+	fe_inv(zinv, a->z);
+	fe_sqr(t, zinv);
+	fe_mul(x, a->x, t);
+	fe_mul(t, t, zinv);
+	fe_mul(y, a->y, t);
+}
+
+/* Returns 1 if (x, y) with x, y < p is on the curve */
+static int point_is_on_curve(const p256_int x, const p256_int y)
+{
+	p256_int lhs;
+	p256_int rhs;
+	p256_int t;
+
+	/* y^2 = x^3 - 3 * x + b */
+	fe_sqr(lhs, y);
+	fe_sqr(rhs, x);
+	fe_mul(rhs, rhs, x);
+	fe_add(t, x, x);
+	fe_add(t, t, x);
+	fe_sub(rhs, rhs, t);
+	fe_add(rhs, rhs, p256_b);
+	return mask_is_equal(lhs, rhs) & 1;
+}
+
+/* Loads an affine point, returns 0 if it isn't a valid curve point */
+static int point_from_bytes(struct p256_point *r, const unsigned char *x,
+			    const unsigned char *y)
+{
+	int_from_bytes(r->x, x);
+	int_from_bytes(r->y, y);
+	memcpy(r->z, p256_one, sizeof(p256_int));
+	return int_is_less(r->x, p256_p) && int_is_less(r->y, p256_p) &&
+	       point_is_on_curve(r->x, r->y);
+}
+
+/*
+ * r = k * a in constant time, with 0 < k < n and a not the point at
+ * infinity. Fixed 4-bit window, the table entry is read with a masked
+ * scan of the whole table.
+ */
+static void point_mul(struct p256_point *r, const p256_int k,
+		      const struct p256_point *a)
+{
+	struct p256_point table[P256_TABLE_SIZE];
+	struct p256_point acc;
+	struct p256_point sel;
+	struct p256_point t;
+	uint32_t is_inf;
+	uint32_t digit;
+	uint32_t nz;
+	size_t n;
+	int i;
+
+	memset(table, 0, sizeof(table[0]));
+	table[1] = *a;
+	point_double(&table[2], a);
+	for (n = 3; n < P256_TABLE_SIZE; n++)
+		point_add(&table[n], &table[n - 1], a);
+
+	memset(&acc, 0, sizeof(acc));
+	for (i = 256 / P256_WINDOW - 1; i >= 0; i--) {
+		for (n = 0; n < P256_WINDOW; n++)
+			point_double(&acc, &acc);
+
+		digit = (k[i * P256_WINDOW / 32] >>
+			 ((i * P256_WINDOW) % 32)) & (P256_TABLE_SIZE - 1);
+		memset(&sel, 0, sizeof(sel));
+		for (n = 1; n < P256_TABLE_SIZE; n++)
+			point_cmov(&sel, &table[n],
+				   mask_is_zero_word(n ^ digit));
+
+		/*
+		 * Neither acc == sel nor acc == -sel can happen with k < n,
+		 * only the point at infinity needs handling.
+		 */
+		is_inf = mask_is_zero(acc.z);
+		nz = ~mask_is_zero_word(digit);
+		point_add(&t, &acc, &sel);
+		point_cmov(&t, &sel, is_inf);
+		point_cmov(&acc, &t, nz);
+	}
+
+	*r = acc;
+	zeromem(table, sizeof(table));
+	zeromem(&acc, sizeof(acc));
+	zeromem(&sel, sizeof(sel));
+	zeromem(&t, sizeof(t));
+}
+
+/* r = a + b for public points, handles all the special cases */
+static void point_add_vartime(struct p256_point *r,
+			      const struct p256_point *a,
+			      const struct p256_point *b)
+{
+	struct p256_point t;
+
+	if (mask_is_zero(a->z)) {
+		*r = *b;
+		return;
+	}
+	if (mask_is_zero(b->z)) {
+		*r = *a;
+		return;
+	}
+	if (point_add(&t, a, b)) {
+		/* Same x, so a == b or a == -b */
+		if (mask_is_zero(t.x) && mask_is_zero(t.y))
+			point_double(r, a);
+		else
+			memset(r, 0, sizeof(*r));
+		return;
+	}
+	*r = t;
+}
+
+/* r = u1 * G + u2 * q for public scalars, Shamir's trick */
+static void point_mul2_vartime(struct p256_point *r, const p256_int u1,
+			       const p256_int u2, const struct p256_point *q)
+{
+	struct p256_point table[4];
+	struct p256_point acc;
+	unsigned int idx;
+	int i;
+
+	memset(&table[0], 0, sizeof(table[0]));
+	memcpy(table[1].x, p256_gx, sizeof(p256_int));
+	memcpy(table[1].y, p256_gy, sizeof(p256_int));
+	memcpy(table[1].z, p256_one, sizeof(p256_int));
+	table[2] = *q;
+	point_add_vartime(&table[3], &table[1], &table[2]);
+
+	memset(&acc, 0, sizeof(acc));
+	for (i = 255; i >= 0; i--) {
+		point_double(&acc, &acc);
+		idx = int_get_bit(u1, i) | (int_get_bit(u2, i) << 1);
+		if (idx)
+			point_add_vartime(&acc, &acc, &table[idx]);
+	}
+	*r = acc;
+}
+
+static void base_point(struct p256_point *g)
+{
+	memcpy(g->x, p256_gx, sizeof(p256_int));
+	memcpy(g->y, p256_gy, sizeof(p256_int));
+	memcpy(g->z, p256_one, sizeof(p256_int));
+}
+
+/* Loads a scalar, returns 0 unless 0 < k < n */
+static int scalar_from_bytes(p256_int r, const unsigned char *in)
+{
+	int_from_bytes(r, in);
+	return !(mask_is_zero(r) & 1) && int_is_less(r, p256_n);
+}
+
+/* Draws a scalar uniformly in [1, n - 1] */
+static int scalar_random(p256_int r, prng_state *prng, int wprng)
+{
+	unsigned char buf[ECC_P256_SIZE];
+	int err = CRYPT_OK;
+
+	do {
+		if (prng_descriptor[wprng]->read(buf, sizeof(buf), prng) !=
+		    sizeof(buf)) {
+			err = CRYPT_ERROR_READPRNG;
+			break;
+		}
+	} while (!scalar_from_bytes(r, buf));
+
+	zeromem(buf, sizeof(buf));
+	return err;
+}
+
+/* Loads a hash of at most 32 bytes as a scalar modulo n */
+static void hash_to_scalar(p256_int e, const unsigned char *in,
+			   unsigned long inlen)
+{
+	unsigned char buf[ECC_P256_SIZE] = { 0 };
+
+	memcpy(buf + sizeof(buf) - inlen, in, inlen);
+	int_from_bytes(e, buf);
+	mod_sub_once(e, e, 0, p256_n);
+}
+
+/**
+  Make a P-256 key pair
+  @param prng     An active PRNG state
+  @param wprng    The index of the PRNG desired
+  @param k        [out] The private key, ECC_P256_SIZE bytes big endian
+  @param x        [out] The public key x coordinate
+  @param y        [out] The public key y coordinate
+  @return CRYPT_OK if successful
+*/
+int ecc_p256_make_key(prng_state *prng, int wprng, unsigned char *k,
+		      unsigned char *x, unsigned char *y)
+{
+	struct p256_point q;
+	struct p256_point g;
+	p256_int d;
+	p256_int qx;
+	p256_int qy;
+	int err;
+
+	LTC_ARGCHK(k != NULL);
+	LTC_ARGCHK(x != NULL);
+	LTC_ARGCHK(y != NULL);
+
+	if ((err = prng_is_valid(wprng)) != CRYPT_OK)
+		return err;
+	if ((err = scalar_random(d, prng, wprng)) != CRYPT_OK)
+		return err;
+
+	base_point(&g);
+	point_mul(&q, d, &g);
+	point_to_affine(qx, qy, &q);
+
+	int_to_bytes(k, d);
+	int_to_bytes(x, qx);
+	int_to_bytes(y, qy);
+	zeromem(d, sizeof(d));
+	return CRYPT_OK;
+}
+
+/**
+  Sign a hash with P-256
+  @param in       The hash to sign
+  @param inlen    The length of the hash, at most ECC_P256_SIZE
+  @param k        The private key, ECC_P256_SIZE bytes big endian
+  @param r        [out] The "r" part of the signature, ECC_P256_SIZE bytes
+  @param s        [out] The "s" part of the signature, ECC_P256_SIZE bytes
+  @param prng     An active PRNG state
+  @param wprng    The index of the PRNG desired
+  @return CRYPT_OK if successful, CRYPT_NOP if the input isn't supported
+*/
+int ecc_p256_sign_hash_raw(const unsigned char *in, unsigned long inlen,
+			   const unsigned char *k, unsigned char *r,
+			   unsigned char *s, prng_state *prng, int wprng)
+{
+	struct p256_point g;
+	struct p256_point p;
+	p256_int d;
+	p256_int e;
+	p256_int nonce;
+	p256_int px;
+	p256_int py;
+	p256_int sr;
+	p256_int ss;
+	int err;
+
+	LTC_ARGCHK(in != NULL);
+	LTC_ARGCHK(k != NULL);
+	LTC_ARGCHK(r != NULL);
+	LTC_ARGCHK(s != NULL);
+
+	if (inlen > ECC_P256_SIZE)
+		return CRYPT_NOP;
+	if ((err = prng_is_valid(wprng)) != CRYPT_OK)
+		return err;
+	if (!scalar_from_bytes(d, k)) {
+		err = CRYPT_NOP;
+		goto out;
+	}
+	hash_to_scalar(e, in, inlen);
+	base_point(&g);
+
+	for (;;) {
+		if ((err = scalar_random(nonce, prng, wprng)) != CRYPT_OK)
+			goto out;
+
+		/* r = x1 mod n */
+		point_mul(&p, nonce, &g);
+		point_to_affine(px, py, &p);
+		mod_sub_once(sr, px, 0, p256_n);
+		if (mask_is_zero(sr))
+			continue;
+
+		/* s = (e + r * d) / nonce */
+		sc_mul(ss, sr, d);
+		mod_add(ss, ss, e, p256_n);
+		sc_inv(nonce, nonce);
+		sc_mul(ss, ss, nonce);
+		if (!mask_is_zero(ss))
+			break;
+	}
+
+	int_to_bytes(r, sr);
+	int_to_bytes(s, ss);
+	err = CRYPT_OK;
+out:
+	zeromem(d, sizeof(d));
+	zeromem(nonce, sizeof(nonce));
+	zeromem(&p, sizeof(p));
+	return err;
+}
+
+/**
+  Verify a P-256 signature
+  @param r        The "r" part of the signature, ECC_P256_SIZE bytes
+  @param s        The "s" part of the signature, ECC_P256_SIZE bytes
+  @param hash     The hash that was signed
+  @param hashlen  The length of the hash, at most ECC_P256_SIZE
+  @param x        The public key x coordinate, ECC_P256_SIZE bytes
+  @param y        The public key y coordinate, ECC_P256_SIZE bytes
+  @param stat     [out] 1 if the signature is valid, 0 otherwise
+  @return CRYPT_OK if the signature could be checked, even if it isn't
+          valid, CRYPT_NOP if the input isn't supported
+*/
+int ecc_p256_verify_hash_raw(const unsigned char *r, const unsigned char *s,
+			     const unsigned char *hash, unsigned long hashlen,
+			     const unsigned char *x, const unsigned char *y,
+			     int *stat)
+{
+	struct p256_point q;
+	struct p256_point p;
+	p256_int sr;
+	p256_int ss;
+	p256_int e;
+	p256_int w;
+	p256_int u1;
+	p256_int u2;
+	p256_int px;
+	p256_int py;
+
+	LTC_ARGCHK(r != NULL);
+	LTC_ARGCHK(s != NULL);
+	LTC_ARGCHK(hash != NULL);
+	LTC_ARGCHK(x != NULL);
+	LTC_ARGCHK(y != NULL);
+	LTC_ARGCHK(stat != NULL);
+
+	*stat = 0;
+	if (hashlen > ECC_P256_SIZE)
+		return CRYPT_NOP;
+	if (!scalar_from_bytes(sr, r) || !scalar_from_bytes(ss, s))
+		return CRYPT_INVALID_PACKET;
+	if (!point_from_bytes(&q, x, y))
+		return CRYPT_INVALID_ARG;
+	hash_to_scalar(e, hash, hashlen);
+
+	/* u1 = e / s, u2 = r / s */
+	sc_inv(w, ss);
+	sc_mul(u1, e, w);
+	sc_mul(u2, sr, w);
+
+	point_mul2_vartime(&p, u1, u2, &q);
+	if (mask_is_zero(p.z))
+		return CRYPT_OK;
+	point_to_affine(px, py, &p);
+	mod_sub_once(px, px, 0, p256_n);
+	if (mask_is_equal(px, sr))
+		*stat = 1;
+	return CRYPT_OK;
+}
+
+/**
+  Compute a P-256 ECDH shared secret, the x coordinate of k * (x, y)
+  @param k        The private key, ECC_P256_SIZE bytes big endian
+  @param x        The public key x coordinate, ECC_P256_SIZE bytes
+  @param y        The public key y coordinate, ECC_P256_SIZE bytes
+  @param out      [out] The shared secret, ECC_P256_SIZE bytes
+  @return CRYPT_OK if successful, CRYPT_NOP if the input isn't supported
+*/
+int ecc_p256_shared_secret(const unsigned char *k, const unsigned char *x,
+			   const unsigned char *y, unsigned char *out)
+{
+	struct p256_point q;
+	struct p256_point p;
+	p256_int d;
+	p256_int px;
+	p256_int py;
+	int err = CRYPT_OK;
+
+	LTC_ARGCHK(k != NULL);
+	LTC_ARGCHK(x != NULL);
+	LTC_ARGCHK(y != NULL);
+	LTC_ARGCHK(out != NULL);
+
+	if (!point_from_bytes(&q, x, y))
+		return CRYPT_INVALID_ARG;
+	if (!scalar_from_bytes(d, k)) {
+		err = CRYPT_NOP;
+		goto out;
+	}
+
+	point_mul(&p, d, &q);
+	point_to_affine(px, py, &p);
+	int_to_bytes(out, px);
+out:
+	zeromem(d, sizeof(d));
+	zeromem(&p, sizeof(p));
+	zeromem(px, sizeof(px));
+	return err;
+}
+
+#endif /* LTC_ECC_P256 */
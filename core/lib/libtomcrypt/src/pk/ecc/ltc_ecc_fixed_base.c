@@ -0,0 +1,407 @@
+/*
+ * Copyright (c) 2017, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Fixed-base comb multiplication for the base point of the curves in
+ * ltc_ecc_sets[], used when generating keys (and thus also for the
+ * ephemeral key of each ECDSA signature).
+ *
+ * With COMB_TEETH teeth and d = ceil(bits / COMB_TEETH) columns, entry i
+ * of the table is T[i] = C + sum(2^(j * d) * G) for each bit j set in i,
+ * with C = 2^(COMB_TEETH * d) * G so that no entry is the point at
+ * infinity. Summing the entries selected by the d columns, doubling in
+ * between, gives k * G + (2^d - 1) * C, which a last addition of
+ * -(2^d - 1) * C (entry COMB_ENTRIES) corrects. A multiplication is then
+ * d doublings and d mixed additions instead of one doubling and one
+ * addition per bit for ltc_ecc_mulmod().
+ *
+ * The tables are computed on first use and kept in the core heap as
+ * affine points in Montgomery form. The sequence of point operations is
+ * the same for all scalars, as there's neither a zero column to skip nor
+ * a first column to special-case, and the table entry is read by
+ * scanning the whole table, as in ltc_ecc_mulmod_timing.c.
+ */
+
+#include <kernel/mutex.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tomcrypt.h"
+
+#if defined(LTC_MECC) && defined(LTC_ECC_FIXED_BASE)
+
+#define COMB_TEETH	4
+#define COMB_ENTRIES	(1 << COMB_TEETH)
+/* The table entries and -(2^d - 1) * C */
+#define COMB_POINTS	(COMB_ENTRIES + 1)
+#define COMB_MAX_CURVES	8
+
+/*
+ * Indexed like ltc_ecc_sets[], COMB_POINTS entries of x || y with
+ * dp->size bytes each
+ */
+static unsigned char *comb_tables[COMB_MAX_CURVES];
+static struct mutex comb_mu = MUTEX_INITIALIZER;
+
+static int comb_columns(const ltc_ecc_set_type *dp)
+{
+	return (dp->size * 8 + COMB_TEETH - 1) / COMB_TEETH;
+}
+
+/* Writes a as a big endian number of exactly len bytes */
+static int export_fixed(void *a, unsigned char *out, unsigned long len)
+{
+	unsigned long n = mp_unsigned_bin_size(a);
+
+	if (n > len)
+		return CRYPT_BUFFER_OVERFLOW;
+	memset(out, 0, len - n);
+	return mp_to_unsigned_bin(a, out + len - n);
+}
+
+/* P = 2^n * P */
+static int dbl_n(ecc_point *P, int n, void *modulus, void *mp)
+{
+	int err = CRYPT_OK;
+
+	while (n-- && err == CRYPT_OK)
+		err = ltc_mp.ecc_ptdbl(P, P, modulus, mp);
+	return err;
+}
+
+static int copy_point(ecc_point *src, ecc_point *dst)
+{
+	int err;
+
+	if ((err = mp_copy(src->x, dst->x)) != CRYPT_OK)
+		return err;
+	if ((err = mp_copy(src->y, dst->y)) != CRYPT_OK)
+		return err;
+	return mp_copy(src->z, dst->z);
+}
+
+/* Converts P from Montgomery projective to Montgomery affine */
+static int to_affine(ecc_point *P, void *modulus, void *mp, void *mu)
+{
+	int err;
+
+	/* Can't happen with the curves of ltc_ecc_sets[] */
+	if (mp_iszero(P->z))
+		return CRYPT_ERROR;
+
+	err = ltc_ecc_map(P, modulus, mp);
+	if (err == CRYPT_OK)
+		err = mp_mulmod(P->x, mu, modulus, P->x);
+	if (err == CRYPT_OK)
+		err = mp_mulmod(P->y, mu, modulus, P->y);
+	return err;
+}
+
+static int build_table(const ltc_ecc_set_type *dp, unsigned char *points)
+{
+	ecc_point *T[COMB_POINTS] = { NULL };
+	ecc_point *C;
+	ecc_point *E;
+	unsigned long size = dp->size;
+	int cols = comb_columns(dp);
+	void *modulus = NULL;
+	void *mu = NULL;
+	void *mp = NULL;
+	int err;
+	int i;
+
+	if ((err = mp_init_multi(&modulus, &mu, NULL)) != CRYPT_OK)
+		return err;
+	if ((err = mp_read_radix(modulus, (char *)dp->prime, 16)) != CRYPT_OK)
+		goto out;
+	if ((err = mp_montgomery_setup(modulus, &mp)) != CRYPT_OK)
+		goto out;
+	if ((err = mp_montgomery_normalization(mu, modulus)) != CRYPT_OK)
+		goto out;
+
+	for (i = 0; i < COMB_POINTS; i++) {
+		T[i] = ltc_ecc_new_point();
+		if (!T[i]) {
+			err = CRYPT_MEM;
+			goto out;
+		}
+	}
+	C = T[0];
+	E = T[COMB_ENTRIES];
+
+	/* T[1] = G in Montgomery form */
+	if ((err = mp_read_radix(T[1]->x, (char *)dp->Gx, 16)) != CRYPT_OK)
+		goto out;
+	if ((err = mp_read_radix(T[1]->y, (char *)dp->Gy, 16)) != CRYPT_OK)
+		goto out;
+	if ((err = mp_mulmod(T[1]->x, mu, modulus, T[1]->x)) != CRYPT_OK)
+		goto out;
+	if ((err = mp_mulmod(T[1]->y, mu, modulus, T[1]->y)) != CRYPT_OK)
+		goto out;
+	if ((err = mp_copy(mu, T[1]->z)) != CRYPT_OK)
+		goto out;
+
+	/* T[2^j] = 2^(j * d) * G, then C = 2^(COMB_TEETH * d) * G */
+	for (i = 2; i <= COMB_ENTRIES; i <<= 1) {
+		ecc_point *P = i == COMB_ENTRIES ? C : T[i];
+
+		if ((err = copy_point(T[i / 2], P)) != CRYPT_OK)
+			goto out;
+		if ((err = dbl_n(P, cols, modulus, mp)) != CRYPT_OK)
+			goto out;
+	}
+
+	/* T[i] = T[i - 2^j] + T[2^j] with 2^j the highest bit of i */
+	for (i = 3; i < COMB_ENTRIES; i++) {
+		int hi = 1;
+
+		while (hi * 2 <= i)
+			hi *= 2;
+		if (hi == i)
+			continue;
+		err = ltc_mp.ecc_ptadd(T[i - hi], T[hi], T[i], modulus, mp);
+		if (err != CRYPT_OK)
+			goto out;
+	}
+
+	/* E = (2^d - 1) * C = 2^d * C + -C */
+	if ((err = copy_point(C, E)) != CRYPT_OK)
+		goto out;
+	if ((err = dbl_n(E, cols, modulus, mp)) != CRYPT_OK)
+		goto out;
+	if ((err = mp_sub(modulus, C->y, C->y)) != CRYPT_OK)
+		goto out;
+	err = ltc_mp.ecc_ptadd(E, C, E, modulus, mp);
+	if (err != CRYPT_OK)
+		goto out;
+	if ((err = mp_sub(modulus, C->y, C->y)) != CRYPT_OK)
+		goto out;
+
+	/* Offset the entries by C */
+	for (i = 1; i < COMB_ENTRIES; i++) {
+		err = ltc_mp.ecc_ptadd(T[i], C, T[i], modulus, mp);
+		if (err != CRYPT_OK)
+			goto out;
+	}
+
+	for (i = 0; i < COMB_POINTS; i++) {
+		unsigned char *p = points + i * 2 * size;
+
+		if ((err = to_affine(T[i], modulus, mp, mu)) != CRYPT_OK)
+			goto out;
+		/* The last entry is subtracted */
+		if (i == COMB_ENTRIES &&
+		    (err = mp_sub(modulus, T[i]->y, T[i]->y)) != CRYPT_OK)
+			goto out;
+		if ((err = export_fixed(T[i]->x, p, size)) != CRYPT_OK)
+			goto out;
+		if ((err = export_fixed(T[i]->y, p + size, size)) != CRYPT_OK)
+			goto out;
+	}
+
+out:
+	for (i = COMB_POINTS - 1; i >= 0; i--)
+		ltc_ecc_del_point(T[i]);
+	if (mp)
+		mp_montgomery_free(mp);
+	mp_clear_multi(modulus, mu, NULL);
+	return err;
+}
+
+/*
+ * Returns the table for dp, computing it if needed, or NULL if dp isn't
+ * one of ltc_ecc_sets[]
+ */
+static const unsigned char *get_table(const ltc_ecc_set_type *dp)
+{
+	unsigned char *points = NULL;
+	size_t n;
+
+	for (n = 0; n < COMB_MAX_CURVES && ltc_ecc_sets[n].size; n++)
+		if (dp == &ltc_ecc_sets[n])
+			break;
+	if (n == COMB_MAX_CURVES || !ltc_ecc_sets[n].size)
+		return NULL;
+
+	mutex_lock(&comb_mu);
+
+	if (comb_tables[n])
+		goto out;
+
+	points = malloc(COMB_POINTS * 2 * dp->size);
+	if (!points)
+		goto out;
+	if (build_table(dp, points) != CRYPT_OK) {
+		free(points);
+		points = NULL;
+		goto out;
+	}
+	comb_tables[n] = points;
+out:
+	points = comb_tables[n];
+	mutex_unlock(&comb_mu);
+	return points;
+}
+
+/* Bit n of the big endian number k of len bytes */
+static unsigned int get_bit(const unsigned char *k, unsigned long len, int n)
+{
+	if ((unsigned long)n >= len * 8)
+		return 0;
+	return (k[len - 1 - n / 8] >> (n % 8)) & 1;
+}
+
+/*
+ * Copies entry idx of the table to out, reading every entry so the
+ * memory access pattern doesn't depend on idx.
+ */
+static void select_entry(const unsigned char *points, unsigned long size,
+			 unsigned int idx, unsigned char *out)
+{
+	unsigned int mask;
+	unsigned int diff;
+	unsigned long b;
+	unsigned int i;
+
+	memset(out, 0, 2 * size);
+	for (i = 0; i < COMB_ENTRIES; i++) {
+		diff = i ^ idx;
+		/* mask is 0xff if diff is 0, else 0 */
+		mask = ((diff | (0 - diff)) >> (sizeof(diff) * 8 - 1)) - 1;
+		mask &= 0xff;
+		for (b = 0; b < 2 * size; b++)
+			out[b] |= points[i * 2 * size + b] & mask;
+	}
+}
+
+/**
+   Perform a point multiplication with the base point of a curve
+   @param k        The scalar to multiply by, less than the order
+   @param dp       The curve, the base point is dp->Gx, dp->Gy
+   @param R        [out] Destination for kG, mapped to affine
+   @param modulus  The modulus of the field the ECC curve is in
+   @return CRYPT_OK on success, CRYPT_NOP if there's no table for the
+	   curve or k is 0 and the caller has to use ecc_ptmul instead
+*/
+int ltc_ecc_fixed_base_mulmod(void *k, const ltc_ecc_set_type *dp,
+			      ecc_point *R, void *modulus)
+{
+	unsigned char kbuf[ECC_MAXSIZE];
+	unsigned char qbuf[2 * ECC_MAXSIZE];
+	unsigned long size = dp->size;
+	const unsigned char *points;
+	const unsigned char *p;
+	ecc_point *acc = NULL;
+	ecc_point Q = { NULL, NULL, NULL };
+	unsigned int idx;
+	void *mp = NULL;
+	int cols;
+	int err;
+	int i;
+	int j;
+
+	LTC_ARGCHK(k       != NULL);
+	LTC_ARGCHK(dp      != NULL);
+	LTC_ARGCHK(R       != NULL);
+	LTC_ARGCHK(modulus != NULL);
+
+	/* k * G is the point at infinity, left to ecc_ptmul */
+	if (size > ECC_MAXSIZE || mp_iszero(k))
+		return CRYPT_NOP;
+	points = get_table(dp);
+	if (!points)
+		return CRYPT_NOP;
+	if ((err = export_fixed(k, kbuf, size)) != CRYPT_OK)
+		return err;
+
+	if ((err = mp_init_multi(&Q.x, &Q.y, NULL)) != CRYPT_OK)
+		goto out;
+	acc = ltc_ecc_new_point();
+	if (!acc) {
+		err = CRYPT_MEM;
+		goto out;
+	}
+	if ((err = mp_montgomery_setup(modulus, &mp)) != CRYPT_OK)
+		goto out;
+
+	cols = comb_columns(dp);
+	for (i = cols - 1; i >= 0; i--) {
+		idx = 0;
+		for (j = 0; j < COMB_TEETH; j++)
+			idx |= get_bit(kbuf, size, i + j * cols) << j;
+
+		select_entry(points, size, idx, qbuf);
+		if ((err = mp_read_unsigned_bin(Q.x, qbuf, size)) != CRYPT_OK ||
+		    (err = mp_read_unsigned_bin(Q.y, qbuf + size, size)) !=
+		    CRYPT_OK)
+			goto out;
+
+		if (i == cols - 1) {
+			/* acc = Q */
+			if ((err = mp_copy(Q.x, acc->x)) != CRYPT_OK ||
+			    (err = mp_copy(Q.y, acc->y)) != CRYPT_OK ||
+			    (err = mp_montgomery_normalization(acc->z,
+							       modulus)) !=
+			    CRYPT_OK)
+				goto out;
+			continue;
+		}
+
+		if ((err = ltc_mp.ecc_ptdbl(acc, acc, modulus, mp)) !=
+		    CRYPT_OK)
+			goto out;
+		err = ltc_mp.ecc_ptadd(acc, &Q, acc, modulus, mp);
+		if (err != CRYPT_OK)
+			goto out;
+	}
+
+	/* acc = k * G + (2^d - 1) * C, subtract the latter */
+	p = points + COMB_ENTRIES * 2 * size;
+	if ((err = mp_read_unsigned_bin(Q.x, (unsigned char *)p,
+					size)) != CRYPT_OK ||
+	    (err = mp_read_unsigned_bin(Q.y, (unsigned char *)p + size,
+					size)) != CRYPT_OK)
+		goto out;
+	if ((err = ltc_mp.ecc_ptadd(acc, &Q, acc, modulus, mp)) != CRYPT_OK)
+		goto out;
+
+	if ((err = mp_copy(acc->x, R->x)) != CRYPT_OK ||
+	    (err = mp_copy(acc->y, R->y)) != CRYPT_OK ||
+	    (err = mp_copy(acc->z, R->z)) != CRYPT_OK)
+		goto out;
+	err = ltc_ecc_map(R, modulus, mp);
+
+out:
+	if (mp)
+		mp_montgomery_free(mp);
+	ltc_ecc_del_point(acc);
+	mp_clear_multi(Q.x, Q.y, NULL);
+	zeromem(kbuf, sizeof(kbuf));
+	zeromem(qbuf, sizeof(qbuf));
+	return err;
+}
+
+#endif
@@ -45,6 +45,9 @@
 #include <tomcrypt_arm_neon.h>
 #include <kernel/thread.h>
 #endif
+#if defined(CFG_CRYPTO_SHA512_ARM64_CE)
+#include <arm.h>
+#endif
 
 #if !defined(CFG_WITH_SOFTWARE_PRNG)
 
@@ -1606,6 +1609,85 @@ static TEE_Result ecc_get_keysize(uint32_t curve, uint32_t algo,
 	return TEE_SUCCESS;
 }
 
+#if defined(LTC_ECC_P256)
+/* Writes a as ECC_P256_SIZE bytes big endian, false if it doesn't fit */
+static bool p256_export(struct bignum *a, uint8_t *out)
+{
+	size_t n = mp_unsigned_bin_size(a);
+
+	if (n > ECC_P256_SIZE)
+		return false;
+	memset(out, 0, ECC_P256_SIZE - n);
+	mp_to_unsigned_bin(a, out + ECC_P256_SIZE - n);
+	return true;
+}
+
+static int p256_gen_key(struct ecc_keypair *key)
+{
+	struct tee_ltc_prng *prng = tee_ltc_get_prng();
+	uint8_t d[ECC_P256_SIZE];
+	uint8_t x[ECC_P256_SIZE];
+	uint8_t y[ECC_P256_SIZE];
+	int ltc_res;
+
+	ltc_res = ecc_p256_make_key(&prng->state, prng->index, d, x, y);
+	if (ltc_res == CRYPT_OK) {
+		mp_read_unsigned_bin(key->d, d, sizeof(d));
+		mp_read_unsigned_bin(key->x, x, sizeof(x));
+		mp_read_unsigned_bin(key->y, y, sizeof(y));
+	}
+	zeromem(d, sizeof(d));
+	return ltc_res;
+}
+
+/* sig has room for 2 * ECC_P256_SIZE bytes */
+static int p256_sign(struct ecc_keypair *key, const uint8_t *msg,
+		     size_t msg_len, uint8_t *sig)
+{
+	struct tee_ltc_prng *prng = tee_ltc_get_prng();
+	uint8_t d[ECC_P256_SIZE];
+	int ltc_res;
+
+	if (!p256_export(key->d, d))
+		return CRYPT_NOP;
+	ltc_res = ecc_p256_sign_hash_raw(msg, msg_len, d, sig,
+					 sig + ECC_P256_SIZE, &prng->state,
+					 prng->index);
+	zeromem(d, sizeof(d));
+	return ltc_res;
+}
+
+/* sig is 2 * ECC_P256_SIZE bytes */
+static int p256_verify(struct ecc_public_key *key, const uint8_t *msg,
+		       size_t msg_len, const uint8_t *sig, int *stat)
+{
+	uint8_t x[ECC_P256_SIZE];
+	uint8_t y[ECC_P256_SIZE];
+
+	if (!p256_export(key->x, x) || !p256_export(key->y, y))
+		return CRYPT_NOP;
+	return ecc_p256_verify_hash_raw(sig, sig + ECC_P256_SIZE, msg, msg_len,
+					x, y, stat);
+}
+
+/* secret has room for ECC_P256_SIZE bytes */
+static int p256_shared_secret(struct ecc_keypair *private_key,
+			      struct ecc_public_key *public_key,
+			      uint8_t *secret)
+{
+	uint8_t d[ECC_P256_SIZE];
+	uint8_t x[ECC_P256_SIZE];
+	uint8_t y[ECC_P256_SIZE];
+	int ltc_res = CRYPT_NOP;
+
+	if (p256_export(private_key->d, d) && p256_export(public_key->x, x) &&
+	    p256_export(public_key->y, y))
+		ltc_res = ecc_p256_shared_secret(d, x, y, secret);
+	zeromem(d, sizeof(d));
+	return ltc_res;
+}
+#endif /* LTC_ECC_P256 */
+
 static TEE_Result gen_ecc_key(struct ecc_keypair *key)
 {
 	TEE_Result res;
@@ -1620,6 +1702,14 @@ static TEE_Result gen_ecc_key(struct ecc_keypair *key)
 		return res;
 	}
 
+#if defined(LTC_ECC_P256)
+	if (key->curve == TEE_ECC_CURVE_NIST_P256) {
+		if (p256_gen_key(key) != CRYPT_OK)
+			return TEE_ERROR_BAD_PARAMETERS;
+		return TEE_SUCCESS;
+	}
+#endif
+
 	/* Generate the ECC key */
 	ltc_res = ecc_make_key(&prng->state, prng->index,
 			       key_size_bytes, &ltc_tmp_key);
@@ -1755,6 +1845,21 @@ static TEE_Result ecc_sign(uint32_t algo, struct ecc_keypair *key,
 		goto err;
 	}
 
+#if defined(LTC_ECC_P256)
+	if (key->curve == TEE_ECC_CURVE_NIST_P256) {
+		ltc_res = p256_sign(key, msg, msg_len, sig);
+		if (ltc_res != CRYPT_NOP) {
+			if (ltc_res == CRYPT_OK) {
+				*sig_len = 2 * ECC_P256_SIZE;
+				res = TEE_SUCCESS;
+			} else {
+				res = TEE_ERROR_GENERIC;
+			}
+			goto err;
+		}
+	}
+#endif
+
 	ltc_res = mp_init_multi(&r, &s, NULL);
 	if (ltc_res != CRYPT_OK) {
 		res = TEE_ERROR_OUT_OF_MEMORY;
@@ -1815,6 +1920,19 @@ static TEE_Result ecc_verify(uint32_t algo, struct ecc_public_key *key,
 		goto out;
 	}
 
+#if defined(LTC_ECC_P256)
+	if (key->curve == TEE_ECC_CURVE_NIST_P256) {
+		ltc_res = p256_verify(key, msg, msg_len, sig, &ltc_stat);
+		if (ltc_res != CRYPT_NOP) {
+			if ((ltc_res == CRYPT_OK) && (ltc_stat == 1))
+				res = TEE_SUCCESS;
+			else
+				res = TEE_ERROR_GENERIC;
+			goto out;
+		}
+	}
+#endif
+
 	mp_read_unsigned_bin(r, (uint8_t *)sig, sig_len/2);
 	mp_read_unsigned_bin(s, (uint8_t *)sig + sig_len/2, sig_len/2);
 
@@ -1859,6 +1977,22 @@ static TEE_Result do_ecc_shared_secret(struct ecc_keypair *private_key,
 	if (res != TEE_SUCCESS)
 		goto out;
 
+#if defined(LTC_ECC_P256)
+	if (private_key->curve == TEE_ECC_CURVE_NIST_P256 &&
+	    *secret_len >= ECC_P256_SIZE) {
+		ltc_res = p256_shared_secret(private_key, public_key, secret);
+		if (ltc_res != CRYPT_NOP) {
+			if (ltc_res == CRYPT_OK) {
+				*secret_len = ECC_P256_SIZE;
+				res = TEE_SUCCESS;
+			} else {
+				res = TEE_ERROR_BAD_PARAMETERS;
+			}
+			goto out;
+		}
+	}
+#endif
+
 	ltc_res = ecc_shared_secret(&ltc_private_key, &ltc_public_key,
 				    secret, secret_len);
 	if (ltc_res == CRYPT_OK)
@@ -3064,6 +3198,19 @@ void tomcrypt_arm_neon_disable(struct tomcrypt_arm_neon_state *state)
 }
 #endif
 
+#if defined(CFG_CRYPTO_SHA512_ARM64_CE)
+int tomcrypt_arm_sha512_supported(void)
+{
+	static int supported = -1;
+
+	if (supported < 0)
+		supported = ((read_id_aa64isar0_el1() >>
+			      ID_AA64ISAR0_SHA2_SHIFT) &
+			     ID_AA64ISAR0_SHA2_MASK) >= ID_AA64ISAR0_SHA2_SHA512;
+	return supported;
+}
+#endif
+
 #if defined(CFG_CRYPTO_SHA256)
 TEE_Result hash_sha256_check(const uint8_t *hash, const uint8_t *data,
 		size_t data_size)
@@ -32,6 +32,8 @@ CFG_CRYPTO_DSA ?= y
 CFG_CRYPTO_RSA ?= y
 CFG_CRYPTO_DH ?= y
 CFG_CRYPTO_ECC ?= y
+# Dedicated P-256 implementation used instead of the generic ECC code
+CFG_CRYPTO_ECC_P256 ?= y
 
 # Authenticated encryption
 CFG_CRYPTO_CCM ?= y
@@ -54,8 +56,11 @@ CFG_CRYPTO_SHA256_ARM32_CE ?= $(CFG_CRYPTO_SHA256)
 endif
 ifeq ($(CFG_ARM64_core),y)
 CFG_CRYPTO_AES_ARM64_CE ?= $(CFG_CRYPTO_AES)
+CFG_CRYPTO_CCM_ARM64_CE ?= $(CFG_CRYPTO_CCM)
+CFG_CRYPTO_GCM_ARM64_CE ?= $(CFG_CRYPTO_GCM)
 CFG_CRYPTO_SHA1_ARM64_CE ?= $(CFG_CRYPTO_SHA1)
 CFG_CRYPTO_SHA256_ARM64_CE ?= $(CFG_CRYPTO_SHA256)
+CFG_CRYPTO_SHA512_ARM64_CE ?= $(CFG_CRYPTO_SHA512)
 endif
 endif
 
@@ -73,9 +78,18 @@ endif
 ifeq ($(CFG_CRYPTO_SHA1_ARM64_CE),y)
 $(call force,CFG_WITH_VFP,y,required by CFG_CRYPTO_SHA1_ARM64_CE)
 endif
+ifeq ($(CFG_CRYPTO_SHA512_ARM64_CE),y)
+$(call force,CFG_WITH_VFP,y,required by CFG_CRYPTO_SHA512_ARM64_CE)
+endif
 ifeq ($(CFG_CRYPTO_AES_ARM64_CE),y)
 $(call force,CFG_WITH_VFP,y,required by CFG_CRYPTO_AES_ARM64_CE)
 endif
+ifeq ($(CFG_CRYPTO_CCM_ARM64_CE),y)
+$(call force,CFG_WITH_VFP,y,required by CFG_CRYPTO_CCM_ARM64_CE)
+endif
+ifeq ($(CFG_CRYPTO_GCM_ARM64_CE),y)
+$(call force,CFG_WITH_VFP,y,required by CFG_CRYPTO_GCM_ARM64_CE)
+endif
 
 cryp-enable-all-depends = $(call cfg-enable-all-depends,$(strip $(1)),$(foreach v,$(2),CFG_CRYPTO_$(v)))
 $(eval $(call cryp-enable-all-depends,CFG_REE_FS, AES ECB CTR HMAC SHA256 GCM))
@@ -99,11 +113,16 @@ $(eval $(call cryp-dep-one, CMAC, AES))
 $(eval $(call cryp-dep-one, CBC_MAC, AES DES))
 $(eval $(call cryp-dep-one, CCM, AES))
 $(eval $(call cryp-dep-one, GCM, AES))
+# The interleaved AES-CCM and AES-GCM routines use the CE AES key schedule
+$(eval $(call cryp-dep-all, CCM_ARM64_CE, CCM AES_ARM64_CE))
+$(eval $(call cryp-dep-all, GCM_ARM64_CE, GCM AES_ARM64_CE))
 # If no AES cipher mode is left, disable AES
 $(eval $(call cryp-dep-one, AES, ECB CBC CTR CTS XTS))
 # If no DES cipher mode is left, disable DES
 $(eval $(call cryp-dep-one, DES, ECB CBC))
 
+$(eval $(call cryp-dep-one, ECC_P256, ECC))
+
 # dsa_make_params() needs all three SHA-2 algorithms.
 # Disable DSA if any is missing.
 $(eval $(call cryp-dep-all, DSA, SHA256 SHA384 SHA512))
@@ -416,47 +416,106 @@ TEE_Result tee_fs_decrypt_file(enum tee_fs_file_type file_type,
 			cipher, cipher_size, plaintext, plaintext_size);
 }
 
-static TEE_Result sha256(uint8_t *out, size_t out_size, const uint8_t *in,
-			 size_t in_size)
+TEE_Result tee_fs_key_init(struct tee_fs_key *key,
+			   const uint8_t *encrypted_fek)
+{
+	TEE_Result res;
+
+	memset(key, 0, sizeof(*key));
+	memcpy(key->fek, encrypted_fek, TEE_FS_KM_FEK_SIZE);
+	res = fek_crypt(TEE_MODE_DECRYPT, key->fek, TEE_FS_KM_FEK_SIZE);
+	if (res != TEE_SUCCESS)
+		memset(key->fek, 0, sizeof(key->fek));
+	return res;
+}
+
+void tee_fs_key_clear(struct tee_fs_key *key)
+{
+	if (key->essiv_ctx)
+		crypto_ops.cipher.final(key->essiv_ctx, TEE_ALG_AES_ECB_NOPAD);
+	free(key->essiv_ctx);
+	free(key->cipher_ctx);
+	free(key->authenc_ctx);
+	memset(key, 0, sizeof(*key));
+}
+
+static TEE_Result get_ctx(void **ctx, TEE_Result (*get_ctx_size)(uint32_t,
+								size_t *),
+			  uint32_t algo)
 {
 	TEE_Result res;
-	uint8_t *ctx = NULL;
 	size_t ctx_size;
-	uint32_t algo = TEE_ALG_SHA256;
 
-	res = crypto_ops.hash.get_ctx_size(algo, &ctx_size);
+	if (*ctx)
+		return TEE_SUCCESS;
+
+	res = get_ctx_size(algo, &ctx_size);
 	if (res != TEE_SUCCESS)
 		return res;
 
-	ctx = malloc(ctx_size);
-	if (!ctx)
+	*ctx = malloc(ctx_size);
+	if (!*ctx)
 		return TEE_ERROR_OUT_OF_MEMORY;
+	return TEE_SUCCESS;
+}
 
-	res = crypto_ops.hash.init(ctx, algo);
+TEE_Result tee_fs_authenc(TEE_OperationMode mode, struct tee_fs_key *key,
+			  uint8_t *iv, uint8_t *tag, const void *aad,
+			  size_t aad_size, const void *in, size_t size,
+			  void *out)
+{
+	TEE_Result res;
+	size_t out_size = size;
+	size_t tag_len = TEE_FS_KM_MAX_TAG_LEN;
+	uint32_t algo = TEE_FS_KM_AUTH_ENC_ALG;
+	void *ctx;
+
+	if (mode == TEE_MODE_ENCRYPT) {
+		res = generate_iv(iv, TEE_FS_KM_IV_LEN);
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+
+	res = get_ctx(&key->authenc_ctx, crypto_ops.authenc.get_ctx_size,
+		      algo);
 	if (res != TEE_SUCCESS)
-		goto out;
+		return res;
+	ctx = key->authenc_ctx;
 
-	res = crypto_ops.hash.update(ctx, algo, in, in_size);
+	res = crypto_ops.authenc.init(ctx, algo, mode, key->fek,
+				      sizeof(key->fek), iv, TEE_FS_KM_IV_LEN,
+				      TEE_FS_KM_MAX_TAG_LEN, aad_size, size);
 	if (res != TEE_SUCCESS)
-		goto out;
+		return res;
 
-	res = crypto_ops.hash.final(ctx, algo, out, out_size);
+	if (aad_size) {
+		res = crypto_ops.authenc.update_aad(ctx, algo, mode, aad,
+						    aad_size);
+		if (res != TEE_SUCCESS)
+			goto out;
+	}
+
+	if (mode == TEE_MODE_ENCRYPT)
+		res = crypto_ops.authenc.enc_final(ctx, algo, in, size, out,
+						   &out_size, tag, &tag_len);
+	else
+		res = crypto_ops.authenc.dec_final(ctx, algo, in, size, out,
+						   &out_size, tag, tag_len);
 
 out:
-	free(ctx);
+	crypto_ops.authenc.final(ctx, algo);
 	return res;
 }
 
-static TEE_Result aes_ecb(uint8_t out[TEE_AES_BLOCK_SIZE],
-			  const uint8_t in[TEE_AES_BLOCK_SIZE],
-			  const uint8_t *key, size_t key_size)
+static TEE_Result sha256(uint8_t *out, size_t out_size, const uint8_t *in,
+			 size_t in_size)
 {
 	TEE_Result res;
 	uint8_t *ctx = NULL;
 	size_t ctx_size;
-	uint32_t algo = TEE_ALG_AES_ECB_NOPAD;
+	uint32_t algo = TEE_ALG_SHA256;
 
-	res = crypto_ops.cipher.get_ctx_size(algo, &ctx_size);
+	res = crypto_ops.hash.get_ctx_size(algo, &ctx_size);
 	if (res != TEE_SUCCESS)
 		return res;
 
@@ -464,88 +523,94 @@ static TEE_Result aes_ecb(uint8_t out[TEE_AES_BLOCK_SIZE],
 	if (!ctx)
 		return TEE_ERROR_OUT_OF_MEMORY;
 
-	res = crypto_ops.cipher.init(ctx, algo, TEE_MODE_ENCRYPT, key,
-				     key_size, NULL, 0, NULL, 0);
+	res = crypto_ops.hash.init(ctx, algo);
 	if (res != TEE_SUCCESS)
 		goto out;
 
-	res = crypto_ops.cipher.update(ctx, algo, TEE_MODE_ENCRYPT, true, in,
-				       TEE_AES_BLOCK_SIZE, out);
+	res = crypto_ops.hash.update(ctx, algo, in, in_size);
 	if (res != TEE_SUCCESS)
 		goto out;
 
-	crypto_ops.cipher.final(ctx, algo);
-	res = TEE_SUCCESS;
+	res = crypto_ops.hash.final(ctx, algo, out, out_size);
 
 out:
 	free(ctx);
 	return res;
 }
 
-static TEE_Result essiv(uint8_t iv[TEE_AES_BLOCK_SIZE],
-			const uint8_t fek[TEE_FS_KM_FEK_SIZE],
+/*
+ * The ESSIV salt is SHA-256(FEK), the AES-ECB context keyed with it is
+ * kept in the key and reused for each block.
+ */
+static TEE_Result essiv(uint8_t iv[TEE_AES_BLOCK_SIZE], struct tee_fs_key *key,
 			uint16_t blk_idx)
 {
 	TEE_Result res;
 	uint8_t sha[TEE_SHA256_HASH_SIZE];
 	uint8_t pad_blkid[TEE_AES_BLOCK_SIZE] = { 0, };
+	uint32_t algo = TEE_ALG_AES_ECB_NOPAD;
 
-	res = sha256(sha, sizeof(sha), fek, TEE_FS_KM_FEK_SIZE);
-	if (res != TEE_SUCCESS)
-		return res;
+	if (!key->essiv_ctx) {
+		res = get_ctx(&key->essiv_ctx, crypto_ops.cipher.get_ctx_size,
+			      algo);
+		if (res != TEE_SUCCESS)
+			return res;
+
+		res = sha256(sha, sizeof(sha), key->fek, TEE_FS_KM_FEK_SIZE);
+		if (res == TEE_SUCCESS)
+			res = crypto_ops.cipher.init(key->essiv_ctx, algo,
+						     TEE_MODE_ENCRYPT, sha, 16,
+						     NULL, 0, NULL, 0);
+		memset(sha, 0, sizeof(sha));
+		if (res != TEE_SUCCESS) {
+			free(key->essiv_ctx);
+			key->essiv_ctx = NULL;
+			return res;
+		}
+	}
 
 	pad_blkid[0] = (blk_idx & 0xFF);
 	pad_blkid[1] = (blk_idx & 0xFF00) >> 8;
 
-	return aes_ecb(iv, pad_blkid, sha, 16);
+	return crypto_ops.cipher.update(key->essiv_ctx, algo, TEE_MODE_ENCRYPT,
+					false, pad_blkid, TEE_AES_BLOCK_SIZE,
+					iv);
 }
 
 /*
  * Encryption/decryption of RPMB FS file data. This is AES CBC with ESSIV.
  */
 TEE_Result tee_fs_crypt_block(uint8_t *out, const uint8_t *in, size_t size,
-			      uint16_t blk_idx, const uint8_t *encrypted_fek,
+			      uint16_t blk_idx, struct tee_fs_key *key,
 			      TEE_OperationMode mode)
 {
 	TEE_Result res;
-	uint8_t fek[TEE_FS_KM_FEK_SIZE];
 	uint8_t iv[TEE_AES_BLOCK_SIZE];
-	uint8_t *ctx;
-	size_t ctx_size;
+	void *ctx;
 	uint32_t algo = TEE_ALG_AES_CBC_NOPAD;
 
 	DMSG("%scrypt block #%u", (mode == TEE_MODE_ENCRYPT) ? "En" : "De",
 	     blk_idx);
 
-	/* Decrypt FEK */
-	memcpy(fek, encrypted_fek, TEE_FS_KM_FEK_SIZE);
-	res = fek_crypt(TEE_MODE_DECRYPT, fek, TEE_FS_KM_FEK_SIZE);
+	/* Compute initialization vector for this block */
+	res = essiv(iv, key, blk_idx);
 	if (res != TEE_SUCCESS)
 		return res;
 
-	/* Compute initialization vector for this block */
-	res = essiv(iv, fek, blk_idx);
-
 	/* Run AES CBC */
-	res = crypto_ops.cipher.get_ctx_size(algo, &ctx_size);
+	res = get_ctx(&key->cipher_ctx, crypto_ops.cipher.get_ctx_size, algo);
 	if (res != TEE_SUCCESS)
 		return res;
-	ctx = malloc(ctx_size);
-	if (!ctx)
-		return TEE_ERROR_OUT_OF_MEMORY;
+	ctx = key->cipher_ctx;
 
-	res = crypto_ops.cipher.init(ctx, algo, mode, fek, sizeof(fek), NULL,
-				     0, iv, TEE_AES_BLOCK_SIZE);
+	res = crypto_ops.cipher.init(ctx, algo, mode, key->fek,
+				     sizeof(key->fek), NULL, 0, iv,
+				     TEE_AES_BLOCK_SIZE);
 	if (res != TEE_SUCCESS)
-		goto exit;
+		return res;
 	res = crypto_ops.cipher.update(ctx, algo, mode, true, in, size, out);
-	if (res != TEE_SUCCESS)
-		goto exit;
 
 	crypto_ops.cipher.final(ctx, algo);
-
-exit:
-	free(ctx);
 	return res;
 }
 
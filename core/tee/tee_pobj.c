@@ -31,9 +31,44 @@
 #include <tee/tee_pobj.h>
 #include <trace.h>
 
-static TAILQ_HEAD(tee_pobjs, tee_pobj) tee_pobjs =
-		TAILQ_HEAD_INITIALIZER(tee_pobjs);
-static struct mutex pobjs_mutex = MUTEX_INITIALIZER;
+/*
+ * Open persistent objects are hashed on TA UUID and object ID, each bucket
+ * has its own mutex protecting the list and the refcnt of its objects.
+ * Must be a power of 2.
+ */
+#define POBJ_NUM_BUCKETS	32
+
+struct pobj_bucket {
+	LIST_HEAD(, tee_pobj) pobjs;
+	struct mutex mutex;
+};
+
+static struct pobj_bucket pobj_buckets[POBJ_NUM_BUCKETS] = {
+	[0 ... POBJ_NUM_BUCKETS - 1] = { .mutex = MUTEX_INITIALIZER },
+};
+
+/* FNV-1a */
+static uint32_t hash_bytes(uint32_t h, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	size_t n;
+
+	for (n = 0; n < len; n++) {
+		h ^= p[n];
+		h *= 16777619;
+	}
+	return h;
+}
+
+static struct pobj_bucket *get_bucket(const TEE_UUID *uuid,
+				      const void *obj_id, uint32_t obj_id_len)
+{
+	uint32_t h = 2166136261;
+
+	h = hash_bytes(h, uuid, sizeof(TEE_UUID));
+	h = hash_bytes(h, obj_id, obj_id_len);
+	return pobj_buckets + (h & (POBJ_NUM_BUCKETS - 1));
+}
 
 static TEE_Result tee_pobj_check_access(uint32_t oflags, uint32_t nflags)
 {
@@ -83,19 +118,21 @@ TEE_Result tee_pobj_get(TEE_UUID *uuid, void *obj_id, uint32_t obj_id_len,
 			uint32_t flags, const struct tee_file_operations *fops,
 			struct tee_pobj **obj)
 {
+	struct pobj_bucket *b = get_bucket(uuid, obj_id, obj_id_len);
 	struct tee_pobj *o;
 	TEE_Result res;
 
 	*obj = NULL;
 
-	mutex_lock(&pobjs_mutex);
+	mutex_lock(&b->mutex);
 	/* Check if file is open */
-	TAILQ_FOREACH(o, &tee_pobjs, link) {
+	LIST_FOREACH(o, &b->pobjs, link) {
 		if ((obj_id_len == o->obj_id_len) &&
 		    (memcmp(obj_id, o->obj_id, obj_id_len) == 0) &&
 		    (memcmp(uuid, &o->uuid, sizeof(TEE_UUID)) == 0) &&
 		    (fops == o->fops)) {
 			*obj = o;
+			break;
 		}
 	}
 
@@ -129,28 +166,31 @@ TEE_Result tee_pobj_get(TEE_UUID *uuid, void *obj_id, uint32_t obj_id_len,
 	memcpy(o->obj_id, obj_id, obj_id_len);
 	o->obj_id_len = obj_id_len;
 
-	TAILQ_INSERT_TAIL(&tee_pobjs, o, link);
+	LIST_INSERT_HEAD(&b->pobjs, o, link);
 	*obj = o;
 
 	res = TEE_SUCCESS;
 out:
-	mutex_unlock(&pobjs_mutex);
+	mutex_unlock(&b->mutex);
 	return res;
 }
 
 TEE_Result tee_pobj_release(struct tee_pobj *obj)
 {
+	struct pobj_bucket *b;
+
 	if (obj == NULL)
 		return TEE_ERROR_BAD_PARAMETERS;
 
-	mutex_lock(&pobjs_mutex);
+	b = get_bucket(&obj->uuid, obj->obj_id, obj->obj_id_len);
+	mutex_lock(&b->mutex);
 	obj->refcnt--;
 	if (obj->refcnt == 0) {
-		TAILQ_REMOVE(&tee_pobjs, obj, link);
+		LIST_REMOVE(obj, link);
 		free(obj->obj_id);
 		free(obj);
 	}
-	mutex_unlock(&pobjs_mutex);
+	mutex_unlock(&b->mutex);
 
 	return TEE_SUCCESS;
 }
@@ -160,31 +200,49 @@ TEE_Result tee_pobj_rename(struct tee_pobj *obj, void *obj_id,
 {
 	TEE_Result res = TEE_SUCCESS;
 	void *new_obj_id = NULL;
+	struct pobj_bucket *ob;
+	struct pobj_bucket *nb;
 
 	if (obj == NULL || obj_id == NULL)
 		return TEE_ERROR_BAD_PARAMETERS;
 
-	mutex_lock(&pobjs_mutex);
-	if (obj->refcnt != 1) {
-		res = TEE_ERROR_BAD_STATE;
-		goto exit;
+	new_obj_id = malloc(obj_id_len);
+	if (new_obj_id == NULL)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	memcpy(new_obj_id, obj_id, obj_id_len);
+
+	/* Lock both buckets in address order to avoid deadlocks */
+	ob = get_bucket(&obj->uuid, obj->obj_id, obj->obj_id_len);
+	nb = get_bucket(&obj->uuid, obj_id, obj_id_len);
+	if (ob == nb) {
+		mutex_lock(&ob->mutex);
+	} else if (ob < nb) {
+		mutex_lock(&ob->mutex);
+		mutex_lock(&nb->mutex);
+	} else {
+		mutex_lock(&nb->mutex);
+		mutex_lock(&ob->mutex);
 	}
 
-	new_obj_id = malloc(obj_id_len);
-	if (new_obj_id == NULL) {
-		res = TEE_ERROR_OUT_OF_MEMORY;
+	if (obj->refcnt != 1) {
+		res = TEE_ERROR_BAD_STATE;
 		goto exit;
 	}
-	memcpy(new_obj_id, obj_id, obj_id_len);
 
 	/* update internal data */
 	free(obj->obj_id);
 	obj->obj_id = new_obj_id;
 	obj->obj_id_len = obj_id_len;
 	new_obj_id = NULL;
+	if (ob != nb) {
+		LIST_REMOVE(obj, link);
+		LIST_INSERT_HEAD(&nb->pobjs, obj, link);
+	}
 
 exit:
-	mutex_unlock(&pobjs_mutex);
+	mutex_unlock(&nb->mutex);
+	if (ob != nb)
+		mutex_unlock(&ob->mutex);
 	free(new_obj_id);
 	return res;
 }
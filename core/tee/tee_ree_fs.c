@@ -45,102 +45,174 @@
 #include <utee_defines.h>
 #include <util.h>
 
+
 /*
  * This file implements the tee_file_operations structure for a secure
  * filesystem based on single file in normal world.
  *
- * All fields in the REE file are duplicated with two versions 0 and 1. The
- * active meta-data block is selected by the lowest bit in the
- * meta-counter.  The active file block is selected by corresponding bit
- * number in struct tee_fs_file_info.backup_version_table.
- *
- * The atomicity of each operation is ensured by updating meta-counter when
- * everything in the secondary blocks (both meta-data and file-data blocks)
- * are successfully written.  The main purpose of the code below is to
- * perform block encryption and authentication of the file data, and
- * properly handle seeking through the file. One file (in the sense of
- * struct tee_file_operations) maps to one file in the REE filesystem, and
- * has the following structure:
- *
- * [ 4 bytes meta-counter]
- * [ meta-data version 0][ meta-data version 1 ]
- * [ Block 0 version 0 ][ Block 0 version 1 ]
- * [ Block 1 version 0 ][ Block 1 version 1 ]
- * ...
- * [ Block n version 0 ][ Block n version 1 ]
+ * The file data is stored in blocks of BLOCK_SIZE bytes, each encrypted
+ * and authenticated with AES-GCM using the file encryption key (FEK). The
+ * IV and tag of a block are stored in a node of a hash tree, there's one
+ * node per block. Nodes are numbered as in a binary heap: node 1 is the
+ * root and node n has the children 2n and 2n + 1. Node n holds the IV and
+ * tag of block n - 1 and the hashes of the images of its children. The
+ * hash of the root node image is stored in the head of the file which is
+ * encrypted and authenticated with the FEK.
  *
- * One meta-data block is built up as:
- * [ struct meta_header | struct tee_fs_get_header_size ]
+ * A block is verified by checking the nodes on the path from the root to
+ * its node, so reading a part of a file only needs O(log n) nodes. Nodes
+ * are cached once verified.
  *
- * One data block is built up as:
- * [ struct block_header | BLOCK_FILE_SIZE bytes ]
+ * Heads, nodes and blocks all have two versions 0 and 1. The head with
+ * the highest counter is active, the active version of the root node is
+ * recorded in the head, of other nodes in their parent and of a block in
+ * its node. Updates are written to the inactive versions and committed by
+ * writing a new head, so the file is always found in the state of the
+ * last commit. One file (in the sense of struct tee_file_operations) maps
+ * to one file in the REE filesystem, and has the following structure:
  *
- * struct meta_header and struct block_header are defined in
- * tee_fs_key_manager.h.
+ * [ head version 0 ][ head version 1 ]
+ * [ node 1 version 0 ][ node 1 version 1 ]
+ * [ block 0 version 0 ][ block 0 version 1 ]
+ * [ node 2 version 0 ][ node 2 version 1 ]
+ * [ block 1 version 0 ][ block 1 version 1 ]
+ * ...
+ * [ node n + 1 version 0 ][ node n + 1 version 1 ]
+ * [ block n version 0 ][ block n version 1 ]
  *
+ * Each head starts with REE_FS_MAGIC and REE_FS_VERSION in clear. A file
+ * where no head carries them was written with an earlier format (or a
+ * later one). A file of the previous format is converted when it's opened,
+ * see migrate_legacy_file(), any other file is reported with
+ * TEE_ERROR_STORAGE_NOT_AVAILABLE instead of TEE_ERROR_CORRUPT_OBJECT so
+ * that it's left alone rather than removed as corrupt.
  */
 
+#define REE_FS_MAGIC	0x53464552 /* "REFS" */
+#define REE_FS_VERSION	1
+
 #define BLOCK_SHIFT	12
 
 #define BLOCK_SIZE	(1 << BLOCK_SHIFT)
 
-#define MAX_FILE_SIZE	(BLOCK_SIZE * NUM_BLOCKS_PER_FILE)
+#define MAX_FILE_SIZE	INT32_MAX
 
-struct tee_fs_fd {
-	uint32_t meta_counter;
-	struct tee_fs_file_meta meta;
-	tee_fs_off_t pos;
+/* Bits in struct node_image.flags */
+#define NODE_FLAG_BLOCK_VERS		BIT32(0)
+#define NODE_FLAG_CHILD_VERS(n)		BIT32(1 + (n))
+
+struct node_image {
+	uint8_t child_hash[2][TEE_SHA256_HASH_SIZE];
+	uint8_t iv[TEE_FS_KM_IV_LEN];
+	uint8_t tag[TEE_FS_KM_MAX_TAG_LEN];
 	uint32_t flags;
-	bool is_new_file;
+};
+
+/* Encrypted part of struct head_image */
+struct head_info {
+	uint64_t length;
+	uint8_t root_hash[TEE_SHA256_HASH_SIZE];
+	uint32_t root_vers;
+};
+
+/* magic, version, encrypted_fek and counter are authenticated as AAD */
+struct head_image {
+	uint32_t magic;
+	uint32_t version;
+	uint8_t encrypted_fek[TEE_FS_KM_FEK_SIZE];
+	uint32_t counter;
+	uint8_t iv[TEE_FS_KM_IV_LEN];
+	uint8_t tag[TEE_FS_KM_MAX_TAG_LEN];
+	uint8_t info[sizeof(struct head_info)];
+};
+
+struct node {
+	size_t id;
+	bool dirty;		/* Image to be written at next commit */
+	bool block_updated;	/* Block updated since last commit */
+	struct node *parent;
+	struct node *child[2];
+	struct node_image img;
+};
+
+/*
+ * State of an opened file, shared by all handles of the file so that
+ * they see each other's updates. info is from the active head, length
+ * includes updates which aren't committed yet. The cached nodes also
+ * include such updates. Within a transaction (see
+ * ree_fs_begin_transaction()) updates are kept until the transaction
+ * ends.
+ */
+struct tee_fs_fd {
 	int fd;
+	char *name;		/* NULL once removed or replaced */
+	size_t refcount;
+	struct mutex mutex;	/* Serializes operations on this file */
+	uint8_t encrypted_fek[TEE_FS_KM_FEK_SIZE];
+	struct tee_fs_key key;
+	uint32_t counter;
+	unsigned int head_vers;
+	struct head_info info;
+	size_t length;
+	struct node *root;
+	bool dirty;
+	bool in_transaction;
+	SLIST_ENTRY(tee_fs_fd) link;
+};
+
+/* One per open of a file, this is the struct tee_file_handle */
+struct ree_fs_handle {
+	struct tee_fs_fd *fdp;
+	tee_fs_off_t pos;
+	bool in_transaction;	/* fdp->mutex is held until it ends */
 };
 
-static inline int pos_to_block_num(int position)
+static size_t pos_to_block_num(size_t position)
 {
 	return position >> BLOCK_SHIFT;
 }
 
-static inline int get_last_block_num(size_t size)
+static size_t get_num_blocks(size_t length)
 {
-	return pos_to_block_num(size - 1);
+	return pos_to_block_num(length + BLOCK_SIZE - 1);
 }
 
-static bool get_backup_version_of_block(struct tee_fs_file_meta *meta,
-					size_t block_num)
+/*
+ * Serializes creation, opening, renaming and removal of files and
+ * protects ree_fs_open_files, operations on an opened file are serialized
+ * with the mutex in struct tee_fs_fd instead.
+ */
+static struct mutex ree_fs_dir_mutex = MUTEX_INITIALIZER;
+static SLIST_HEAD(, tee_fs_fd) ree_fs_open_files =
+	SLIST_HEAD_INITIALIZER(ree_fs_open_files);
+
+/* Called with ree_fs_dir_mutex held */
+static struct tee_fs_fd *find_open_file(const char *name)
 {
-	uint32_t index = (block_num / 32);
-	uint32_t block_mask = 1 << (block_num % 32);
+	struct tee_fs_fd *fdp;
 
-	return !!(meta->info.backup_version_table[index] & block_mask);
+	SLIST_FOREACH(fdp, &ree_fs_open_files, link)
+		if (!strcmp(fdp->name, name))
+			return fdp;
+	return NULL;
 }
 
-static inline void toggle_backup_version_of_block(
-		struct tee_fs_file_meta *meta,
-		size_t block_num)
+/*
+ * Called with ree_fs_dir_mutex held when a name is removed or replaced.
+ * Handles which are still open keep the file they have, later opens of
+ * the name get the file now found under it.
+ */
+static void unlink_open_file(const char *name)
 {
-	uint32_t index = (block_num / 32);
-	uint32_t block_mask = 1 << (block_num % 32);
+	struct tee_fs_fd *fdp = find_open_file(name);
 
-	meta->info.backup_version_table[index] ^= block_mask;
+	if (fdp) {
+		SLIST_REMOVE(&ree_fs_open_files, fdp, tee_fs_fd, link);
+		free(fdp->name);
+		fdp->name = NULL;
+	}
 }
 
-struct block_operations {
-
-	/*
-	 * Read a block from REE File System which is corresponding
-	 * to the given block_num.
-	 */
-	struct block *(*read)(struct tee_fs_fd *fdp, int block_num);
-
-	/*
-	 * Write the given block to REE File System
-	 */
-	int (*write)(struct tee_fs_fd *fdp, struct block *b,
-			struct tee_fs_file_meta *new_meta);
-};
-
-static struct mutex ree_fs_mutex = MUTEX_INITIALIZER;
-
 static TEE_Result ree_fs_opendir_rpc(const char *name, struct tee_fs_dir **d)
 
 {
@@ -159,296 +231,799 @@ static TEE_Result ree_fs_readdir_rpc(struct tee_fs_dir *d,
 	return tee_fs_rpc_readdir(OPTEE_MSG_RPC_CMD_FS, d, ent);
 }
 
-static size_t meta_size(void)
+static tee_fs_off_t head_pos_raw(unsigned int vers)
 {
-	return tee_fs_get_header_size(META_FILE) +
-	       sizeof(struct tee_fs_file_meta);
+	return vers * sizeof(struct head_image);
 }
 
-static size_t meta_pos_raw(struct tee_fs_fd *fdp, bool active)
+static tee_fs_off_t node_pos_raw(size_t id, unsigned int vers)
 {
-	size_t offs = sizeof(uint32_t);
+	tee_fs_off_t pair_size = 2 * (sizeof(struct node_image) + BLOCK_SIZE);
 
-	if ((fdp->meta_counter & 1) == active)
-		offs += meta_size();
-	return offs;
+	return 2 * sizeof(struct head_image) + (id - 1) * pair_size +
+	       vers * sizeof(struct node_image);
 }
 
-static size_t block_size_raw(void)
+static tee_fs_off_t block_pos_raw(size_t id, unsigned int vers)
 {
-	return tee_fs_get_header_size(BLOCK_FILE) + BLOCK_SIZE;
+	return node_pos_raw(id, 2) + vers * BLOCK_SIZE;
 }
 
-static size_t block_pos_raw(struct tee_fs_file_meta *meta, size_t block_num,
-			    bool active)
+static TEE_Result read_raw(struct tee_fs_fd *fdp, tee_fs_off_t offs,
+			   size_t len, void **data, size_t *bytes)
 {
-	size_t n = block_num * 2;
+	TEE_Result res;
+	struct tee_fs_rpc_operation op;
 
-	if (active == get_backup_version_of_block(meta, block_num))
-		n++;
+	res = tee_fs_rpc_read_init(&op, OPTEE_MSG_RPC_CMD_FS, fdp->fd, offs,
+				   len, data);
+	if (res != TEE_SUCCESS)
+		return res;
 
-	return sizeof(uint32_t) + meta_size() * 2 + n * block_size_raw();
+	return tee_fs_rpc_read_final(&op, bytes);
 }
 
-/*
- * encrypted_fek: as input for META_FILE and BLOCK_FILE
- */
-static TEE_Result encrypt_and_write_file(struct tee_fs_fd *fdp,
-		enum tee_fs_file_type file_type, size_t offs,
-		void *data_in, size_t data_in_size,
-		uint8_t *encrypted_fek)
+static TEE_Result write_raw(struct tee_fs_fd *fdp, tee_fs_off_t offs,
+			    const void *buf, size_t len)
 {
 	TEE_Result res;
 	struct tee_fs_rpc_operation op;
-	void *ciphertext;
-	size_t header_size = tee_fs_get_header_size(file_type);
-	size_t ciphertext_size = header_size + data_in_size;
+	void *data;
 
+	res = tee_fs_rpc_write_init(&op, OPTEE_MSG_RPC_CMD_FS, fdp->fd, offs,
+				    len, &data);
+	if (res != TEE_SUCCESS)
+		return res;
 
-	res = tee_fs_rpc_write_init(&op, OPTEE_MSG_RPC_CMD_FS, fdp->fd,
-				    offs, ciphertext_size, &ciphertext);
+	memcpy(data, buf, len);
+
+	return tee_fs_rpc_write_final(&op);
+}
+
+static TEE_Result calc_node_hash(size_t id, const struct node_image *img,
+				 uint8_t digest[TEE_SHA256_HASH_SIZE])
+{
+	TEE_Result res;
+	uint32_t algo = TEE_ALG_SHA256;
+	uint32_t id32 = id;
+	size_t ctx_size;
+	void *ctx;
+
+	res = crypto_ops.hash.get_ctx_size(algo, &ctx_size);
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = tee_fs_encrypt_file(file_type, data_in, data_in_size,
-				  ciphertext, &ciphertext_size, encrypted_fek);
+	ctx = malloc(ctx_size);
+	if (!ctx)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	/* The node number ties the image to its position in the tree */
+	res = crypto_ops.hash.init(ctx, algo);
+	if (res != TEE_SUCCESS)
+		goto out;
+	res = crypto_ops.hash.update(ctx, algo, (void *)&id32, sizeof(id32));
+	if (res != TEE_SUCCESS)
+		goto out;
+	res = crypto_ops.hash.update(ctx, algo, (void *)img, sizeof(*img));
+	if (res != TEE_SUCCESS)
+		goto out;
+	res = crypto_ops.hash.final(ctx, algo, digest, TEE_SHA256_HASH_SIZE);
+out:
+	free(ctx);
+	return res;
+}
+
+static TEE_Result crypt_head(struct tee_fs_key *key, TEE_OperationMode mode,
+			     struct head_image *img, struct head_info *info)
+{
+	size_t aad_size = offsetof(struct head_image, iv);
+
+	if (mode == TEE_MODE_ENCRYPT)
+		return tee_fs_authenc(mode, key, img->iv, img->tag, img,
+				      aad_size, info, sizeof(*info),
+				      img->info);
+
+	return tee_fs_authenc(mode, key, img->iv, img->tag, img, aad_size,
+			      img->info, sizeof(*info), info);
+}
+
+static TEE_Result write_head(struct tee_fs_fd *fdp, unsigned int vers,
+			     uint32_t counter, struct head_info *info)
+{
+	TEE_Result res;
+	struct head_image img;
+
+	memset(&img, 0, sizeof(img));
+	img.magic = REE_FS_MAGIC;
+	img.version = REE_FS_VERSION;
+	memcpy(img.encrypted_fek, fdp->encrypted_fek, sizeof(img.encrypted_fek));
+	img.counter = counter;
+
+	res = crypt_head(&fdp->key, TEE_MODE_ENCRYPT, &img, info);
 	if (res != TEE_SUCCESS)
 		return res;
 
-	return tee_fs_rpc_write_final(&op);
+	return write_raw(fdp, head_pos_raw(vers), &img, sizeof(img));
 }
 
 /*
- * encrypted_fek: as output for META_FILE
- *                as input for BLOCK_FILE
+ * Selects the valid head with the highest counter, the FEK of the selected
+ * head is unwrapped into fdp->key.
  */
-static TEE_Result read_and_decrypt_file(struct tee_fs_fd *fdp,
-		enum tee_fs_file_type file_type, size_t offs,
-		void *data_out, size_t *data_out_size,
-		uint8_t *encrypted_fek)
+static TEE_Result read_head(struct tee_fs_fd *fdp)
 {
 	TEE_Result res;
-	struct tee_fs_rpc_operation op;
+	struct head_image img;
+	struct head_info info;
+	struct tee_fs_key key;
+	unsigned int vers;
+	bool found = false;
+	bool our_format = false;
 	size_t bytes;
-	void *ciphertext;
+	void *data;
 
-	bytes = *data_out_size + tee_fs_get_header_size(file_type);
-	res = tee_fs_rpc_read_init(&op, OPTEE_MSG_RPC_CMD_FS, fdp->fd, offs,
-				   bytes, &ciphertext);
+	res = read_raw(fdp, head_pos_raw(0), 2 * sizeof(img), &data, &bytes);
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = tee_fs_rpc_read_final(&op, &bytes);
-	if (res != TEE_SUCCESS)
-		return res;
+	for (vers = 0; vers < 2; vers++) {
+		if (bytes < (vers + 1) * sizeof(img))
+			break;
+		memcpy(&img, (uint8_t *)data + vers * sizeof(img), sizeof(img));
+		if (img.magic != REE_FS_MAGIC ||
+		    img.version != REE_FS_VERSION)
+			continue;
+		our_format = true;
+		res = tee_fs_key_init(&key, img.encrypted_fek);
+		if (res != TEE_SUCCESS)
+			return res;
+		if (crypt_head(&key, TEE_MODE_DECRYPT, &img, &info) !=
+		    TEE_SUCCESS ||
+		    (found && (int32_t)(img.counter - fdp->counter) <= 0)) {
+			tee_fs_key_clear(&key);
+			continue;
+		}
 
-	if (!bytes) {
-		*data_out_size = 0;
-		return TEE_SUCCESS;
+		found = true;
+		memcpy(fdp->encrypted_fek, img.encrypted_fek,
+		       sizeof(fdp->encrypted_fek));
+		tee_fs_key_clear(&fdp->key);
+		fdp->key = key;
+		fdp->counter = img.counter;
+		fdp->head_vers = vers;
+		fdp->info = info;
 	}
 
-	res = tee_fs_decrypt_file(file_type, ciphertext, bytes, data_out,
-				  data_out_size, encrypted_fek);
-	if (res != TEE_SUCCESS)
+	if (!found && !our_format && bytes >= sizeof(img))
+		return TEE_ERROR_STORAGE_NOT_AVAILABLE;
+	if (!found)
 		return TEE_ERROR_CORRUPT_OBJECT;
+
+	fdp->length = fdp->info.length;
 	return TEE_SUCCESS;
 }
 
-static TEE_Result write_meta_file(struct tee_fs_fd *fdp,
-		struct tee_fs_file_meta *meta)
+static void free_nodes(struct node *node)
+{
+	if (node) {
+		free_nodes(node->child[0]);
+		free_nodes(node->child[1]);
+		free(node);
+	}
+}
+
+/* Frees all cached nodes after the node holding the last block */
+static void prune_nodes(struct tee_fs_fd *fdp, struct node *node,
+			size_t num_nodes)
 {
-	size_t offs = meta_pos_raw(fdp, false);
+	size_t n;
+
+	if (!node)
+		return;
+
+	if (node == fdp->root && node->id > num_nodes) {
+		free_nodes(node);
+		fdp->root = NULL;
+		return;
+	}
 
-	return encrypt_and_write_file(fdp, META_FILE, offs,
-			(void *)&meta->info, sizeof(meta->info),
-			meta->encrypted_fek);
+	for (n = 0; n < 2; n++) {
+		if (node->child[n] && node->child[n]->id > num_nodes) {
+			free_nodes(node->child[n]);
+			node->child[n] = NULL;
+		} else {
+			prune_nodes(fdp, node->child[n], num_nodes);
+		}
+	}
 }
 
-static TEE_Result write_meta_counter(struct tee_fs_fd *fdp)
+/*
+ * Reads and verifies a node, or creates an empty one if the node isn't
+ * part of the committed file.
+ */
+static TEE_Result load_node(struct tee_fs_fd *fdp, struct node *parent,
+			    size_t id, struct node **node)
 {
 	TEE_Result res;
-	struct tee_fs_rpc_operation op;
-	size_t bytes = sizeof(uint32_t);
+	uint8_t digest[TEE_SHA256_HASH_SIZE];
+	const uint8_t *hash;
+	unsigned int vers;
+	struct node *n;
+	size_t bytes;
 	void *data;
 
-	res = tee_fs_rpc_write_init(&op, OPTEE_MSG_RPC_CMD_FS, fdp->fd, 0,
-				    bytes, &data);
+	n = calloc(1, sizeof(*n));
+	if (!n)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	n->id = id;
+	n->parent = parent;
+
+	if (id <= get_num_blocks(fdp->info.length)) {
+		if (parent) {
+			vers = !!(parent->img.flags &
+				  NODE_FLAG_CHILD_VERS(id & 1));
+			hash = parent->img.child_hash[id & 1];
+		} else {
+			vers = fdp->info.root_vers;
+			hash = fdp->info.root_hash;
+		}
+
+		res = read_raw(fdp, node_pos_raw(id, vers), sizeof(n->img),
+			       &data, &bytes);
+		if (res == TEE_SUCCESS && bytes != sizeof(n->img))
+			res = TEE_ERROR_CORRUPT_OBJECT;
+		if (res == TEE_SUCCESS) {
+			memcpy(&n->img, data, sizeof(n->img));
+			res = calc_node_hash(id, &n->img, digest);
+		}
+		if (res == TEE_SUCCESS && buf_compare_ct(digest, hash,
+							 sizeof(digest)))
+			res = TEE_ERROR_CORRUPT_OBJECT;
+		if (res != TEE_SUCCESS) {
+			free(n);
+			return res;
+		}
+	}
+
+	if (parent)
+		parent->child[id & 1] = n;
+	else
+		fdp->root = n;
+	*node = n;
+	return TEE_SUCCESS;
+}
+
+/* Returns node id, loading the nodes on the path from the root if needed */
+static TEE_Result get_node(struct tee_fs_fd *fdp, size_t id,
+			   struct node **node)
+{
+	TEE_Result res;
+	struct node *n = fdp->root;
+	struct node *c;
+	size_t mask = 1;
+
+	if (!n) {
+		res = load_node(fdp, NULL, 1, &n);
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+
+	while (mask <= id / 2)
+		mask <<= 1;
+
+	for (mask >>= 1; mask; mask >>= 1) {
+		c = n->child[!!(id & mask)];
+		if (!c) {
+			res = load_node(fdp, n, n->id * 2 + !!(id & mask), &c);
+			if (res != TEE_SUCCESS)
+				return res;
+		}
+		n = c;
+	}
+
+	*node = n;
+	return TEE_SUCCESS;
+}
+
+static TEE_Result read_block(struct tee_fs_fd *fdp, size_t bnum, uint8_t *data)
+{
+	TEE_Result res;
+	struct node *node;
+	unsigned int vers;
+	uint32_t id32 = bnum + 1;
+	size_t bytes;
+	void *ct;
+
+	res = get_node(fdp, bnum + 1, &node);
 	if (res != TEE_SUCCESS)
 		return res;
 
-	memcpy(data, &fdp->meta_counter, bytes);
+	vers = !!(node->img.flags & NODE_FLAG_BLOCK_VERS);
+	res = read_raw(fdp, block_pos_raw(node->id, vers), BLOCK_SIZE, &ct,
+		       &bytes);
+	if (res != TEE_SUCCESS)
+		return res;
+	if (bytes != BLOCK_SIZE)
+		return TEE_ERROR_CORRUPT_OBJECT;
 
-	return tee_fs_rpc_write_final(&op);
+	res = tee_fs_authenc(TEE_MODE_DECRYPT, &fdp->key, node->img.iv,
+			     node->img.tag, &id32, sizeof(id32), ct, BLOCK_SIZE,
+			     data);
+	if (res != TEE_SUCCESS)
+		return TEE_ERROR_CORRUPT_OBJECT;
+	return TEE_SUCCESS;
 }
 
-static TEE_Result create_meta(struct tee_fs_fd *fdp, const char *fname)
+/*
+ * The first update of a block after a commit is written to the inactive
+ * version, following updates to the same version as that one isn't
+ * referenced by the committed file.
+ */
+static TEE_Result write_block(struct tee_fs_fd *fdp, size_t bnum,
+			      const uint8_t *data)
 {
 	TEE_Result res;
+	struct tee_fs_rpc_operation op;
+	struct node *node;
+	uint8_t iv[TEE_FS_KM_IV_LEN];
+	uint8_t tag[TEE_FS_KM_MAX_TAG_LEN];
+	uint32_t id32 = bnum + 1;
+	unsigned int vers;
+	void *ct;
+
+	res = get_node(fdp, bnum + 1, &node);
+	if (res != TEE_SUCCESS)
+		return res;
 
-	memset(fdp->meta.info.backup_version_table, 0xff,
-		sizeof(fdp->meta.info.backup_version_table));
-	fdp->meta.info.length = 0;
+	vers = !!(node->img.flags & NODE_FLAG_BLOCK_VERS);
+	if (!node->block_updated)
+		vers = !vers;
 
-	res = tee_fs_generate_fek(fdp->meta.encrypted_fek, TEE_FS_KM_FEK_SIZE);
+	res = tee_fs_rpc_write_init(&op, OPTEE_MSG_RPC_CMD_FS, fdp->fd,
+				    block_pos_raw(node->id, vers), BLOCK_SIZE,
+				    &ct);
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = tee_fs_rpc_create(OPTEE_MSG_RPC_CMD_FS, fname, &fdp->fd);
+	res = tee_fs_authenc(TEE_MODE_ENCRYPT, &fdp->key, iv, tag,
+			     &id32, sizeof(id32), data, BLOCK_SIZE, ct);
 	if (res != TEE_SUCCESS)
 		return res;
 
-	fdp->meta.counter = fdp->meta_counter;
+	res = tee_fs_rpc_write_final(&op);
+	if (res != TEE_SUCCESS)
+		return res;
 
-	res = write_meta_file(fdp, &fdp->meta);
+	memcpy(node->img.iv, iv, sizeof(iv));
+	memcpy(node->img.tag, tag, sizeof(tag));
+	if (vers)
+		node->img.flags |= NODE_FLAG_BLOCK_VERS;
+	else
+		node->img.flags &= ~NODE_FLAG_BLOCK_VERS;
+	node->block_updated = true;
+	node->dirty = true;
+	fdp->dirty = true;
+	return TEE_SUCCESS;
+}
+
+/*
+ * Writes the updated nodes below and including node, children before
+ * their parent as the hash of a child is stored in the parent.
+ */
+static TEE_Result commit_nodes(struct tee_fs_fd *fdp, struct node *node,
+			       struct head_info *info)
+{
+	TEE_Result res;
+	uint8_t *hash;
+	unsigned int vers;
+	size_t n;
+
+	for (n = 0; n < 2; n++) {
+		if (node->child[n]) {
+			res = commit_nodes(fdp, node->child[n], info);
+			if (res != TEE_SUCCESS)
+				return res;
+		}
+	}
+
+	if (!node->dirty)
+		return TEE_SUCCESS;
+
+	if (node->parent) {
+		vers = !(node->parent->img.flags &
+			 NODE_FLAG_CHILD_VERS(node->id & 1));
+		hash = node->parent->img.child_hash[node->id & 1];
+	} else {
+		vers = !info->root_vers;
+		hash = info->root_hash;
+	}
+
+	res = write_raw(fdp, node_pos_raw(node->id, vers), &node->img,
+			sizeof(node->img));
+	if (res != TEE_SUCCESS)
+		return res;
+
+	res = calc_node_hash(node->id, &node->img, hash);
 	if (res != TEE_SUCCESS)
 		return res;
-	return write_meta_counter(fdp);
+
+	if (node->parent) {
+		if (vers)
+			node->parent->img.flags |=
+				NODE_FLAG_CHILD_VERS(node->id & 1);
+		else
+			node->parent->img.flags &=
+				~NODE_FLAG_CHILD_VERS(node->id & 1);
+		node->parent->dirty = true;
+	} else {
+		info->root_vers = vers;
+	}
+
+	return TEE_SUCCESS;
+}
+
+static void clear_dirty_nodes(struct node *node)
+{
+	if (node) {
+		node->dirty = false;
+		node->block_updated = false;
+		clear_dirty_nodes(node->child[0]);
+		clear_dirty_nodes(node->child[1]);
+	}
 }
 
-static TEE_Result commit_meta_file(struct tee_fs_fd *fdp,
-				   struct tee_fs_file_meta *new_meta)
+/* Writes the updated nodes and commits them together with a new head */
+static TEE_Result commit_file(struct tee_fs_fd *fdp)
 {
 	TEE_Result res;
+	struct head_info info = fdp->info;
+
+	if (!fdp->dirty)
+		return TEE_SUCCESS;
 
-	new_meta->counter = fdp->meta_counter + 1;
+	info.length = fdp->length;
+	if (fdp->root) {
+		res = commit_nodes(fdp, fdp->root, &info);
+		if (res != TEE_SUCCESS)
+			return res;
+	} else {
+		memset(info.root_hash, 0, sizeof(info.root_hash));
+	}
 
-	res = write_meta_file(fdp, new_meta);
+	res = write_head(fdp, !fdp->head_vers, fdp->counter + 1, &info);
 	if (res != TEE_SUCCESS)
 		return res;
 
-	/*
-	 * From now on the new meta is successfully committed,
-	 * change tee_fs_fd accordingly
-	 */
-	fdp->meta = *new_meta;
-	fdp->meta_counter = fdp->meta.counter;
+	fdp->head_vers = !fdp->head_vers;
+	fdp->counter++;
+	fdp->info = info;
+	clear_dirty_nodes(fdp->root);
+	fdp->dirty = false;
+	return TEE_SUCCESS;
+}
 
-	return write_meta_counter(fdp);
+/*
+ * Discards all updates since the last commit, the nodes and blocks written
+ * in the meantime aren't referenced by the committed file.
+ */
+static void rollback_file(struct tee_fs_fd *fdp)
+{
+	if (!fdp->dirty)
+		return;
+
+	free_nodes(fdp->root);
+	fdp->root = NULL;
+	fdp->length = fdp->info.length;
+	fdp->dirty = false;
 }
 
-static TEE_Result read_meta_file(struct tee_fs_fd *fdp,
-		struct tee_fs_file_meta *meta)
+/*
+ * Called when an update of the file is complete, commits pending updates
+ * unless they're part of a transaction. Updates are never kept past the
+ * operation which made them: a commit failing later, when the file is
+ * closed, couldn't be reported to the TA.
+ */
+static TEE_Result end_update(struct tee_fs_fd *fdp)
 {
-	size_t meta_info_size = sizeof(struct tee_fs_file_info);
-	size_t offs = meta_pos_raw(fdp, true);
+	TEE_Result res;
+
+	if (fdp->in_transaction)
+		return TEE_SUCCESS;
 
-	return read_and_decrypt_file(fdp, META_FILE, offs,
-				     &meta->info, &meta_info_size,
-				     meta->encrypted_fek);
+	res = commit_file(fdp);
+	if (res != TEE_SUCCESS)
+		rollback_file(fdp);
+	return res;
 }
 
-static TEE_Result read_meta_counter(struct tee_fs_fd *fdp)
+static TEE_Result create_file(struct tee_fs_fd *fdp, const char *fname)
 {
 	TEE_Result res;
-	struct tee_fs_rpc_operation op;
-	void *data;
-	size_t bytes = sizeof(uint32_t);
 
-	res = tee_fs_rpc_read_init(&op, OPTEE_MSG_RPC_CMD_FS, fdp->fd, 0,
-				   bytes, &data);
+	res = tee_fs_generate_fek(fdp->encrypted_fek, TEE_FS_KM_FEK_SIZE);
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = tee_fs_rpc_read_final(&op, &bytes);
+	res = tee_fs_key_init(&fdp->key, fdp->encrypted_fek);
 	if (res != TEE_SUCCESS)
 		return res;
 
-	if (bytes != sizeof(uint32_t))
-		return TEE_ERROR_CORRUPT_OBJECT;
+	res = tee_fs_rpc_create(OPTEE_MSG_RPC_CMD_FS, fname, &fdp->fd);
+	if (res != TEE_SUCCESS)
+		return res;
 
-	memcpy(&fdp->meta_counter, data, bytes);
+	return write_head(fdp, fdp->head_vers, fdp->counter, &fdp->info);
+}
 
-	return TEE_SUCCESS;
+/*
+ * Files of the previous format start with a 4 byte meta counter followed
+ * by two versions of the meta data and then two versions of each block.
+ * The lowest bit of the counter selects the active meta data, which holds
+ * the length of the file and a bit per block selecting its active version.
+ * The meta data and the blocks are encrypted and authenticated with
+ * tee_fs_encrypt_file().
+ */
+#define LEGACY_NUM_BLOCKS	1024
+
+struct legacy_file_info {
+	uint64_t length;
+	uint32_t backup_version_table[LEGACY_NUM_BLOCKS / 32];
+};
+
+/* Only info is stored, but the layout depends on the size of the struct */
+struct legacy_file_meta {
+	struct legacy_file_info info;
+	uint8_t encrypted_fek[TEE_FS_KM_FEK_SIZE];
+	uint32_t counter;
+};
+
+static size_t legacy_meta_size(void)
+{
+	return tee_fs_get_header_size(META_FILE) +
+	       sizeof(struct legacy_file_meta);
+}
+
+static size_t legacy_block_size(void)
+{
+	return tee_fs_get_header_size(BLOCK_FILE) + BLOCK_SIZE;
 }
 
-static TEE_Result read_meta(struct tee_fs_fd *fdp, const char *fname)
+static TEE_Result legacy_read_raw(int fd, tee_fs_off_t offs, size_t len,
+				  void **data, size_t *bytes)
 {
 	TEE_Result res;
+	struct tee_fs_rpc_operation op;
 
-	res = tee_fs_rpc_open(OPTEE_MSG_RPC_CMD_FS, fname, &fdp->fd);
+	res = tee_fs_rpc_read_init(&op, OPTEE_MSG_RPC_CMD_FS, fd, offs, len,
+				   data);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	return tee_fs_rpc_read_final(&op, bytes);
+}
+
+/* Fails with TEE_ERROR_STORAGE_NOT_AVAILABLE if it's not such a file */
+static TEE_Result legacy_read_meta(int fd, struct legacy_file_meta *meta)
+{
+	TEE_Result res;
+	size_t info_size = sizeof(meta->info);
+	size_t len = tee_fs_get_header_size(META_FILE) + info_size;
+	tee_fs_off_t offs = sizeof(uint32_t);
+	uint32_t counter;
+	size_t bytes;
+	void *data;
+
+	res = legacy_read_raw(fd, 0, sizeof(counter), &data, &bytes);
 	if (res != TEE_SUCCESS)
 		return res;
+	if (bytes != sizeof(counter))
+		return TEE_ERROR_STORAGE_NOT_AVAILABLE;
+	memcpy(&counter, data, sizeof(counter));
+	if (counter & 1)
+		offs += legacy_meta_size();
 
-	res = read_meta_counter(fdp);
+	res = legacy_read_raw(fd, offs, len, &data, &bytes);
 	if (res != TEE_SUCCESS)
 		return res;
+	if (bytes != len ||
+	    tee_fs_decrypt_file(META_FILE, data, bytes,
+				(uint8_t *)&meta->info, &info_size,
+				meta->encrypted_fek) != TEE_SUCCESS ||
+	    info_size != sizeof(meta->info) ||
+	    meta->info.length > LEGACY_NUM_BLOCKS * BLOCK_SIZE)
+		return TEE_ERROR_STORAGE_NOT_AVAILABLE;
 
-	return read_meta_file(fdp, &fdp->meta);
+	return TEE_SUCCESS;
 }
 
-static TEE_Result read_block(struct tee_fs_fd *fdp, int bnum, uint8_t *data)
+static TEE_Result legacy_read_block(int fd, struct legacy_file_meta *meta,
+				    size_t bnum, uint8_t *data)
 {
 	TEE_Result res;
-	size_t ct_size = block_size_raw();
 	size_t out_size = BLOCK_SIZE;
-	ssize_t pos = block_pos_raw(&fdp->meta, bnum, true);
+	size_t n = bnum * 2;
 	size_t bytes;
 	void *ct;
-	struct tee_fs_rpc_operation op;
 
-	res = tee_fs_rpc_read_init(&op, OPTEE_MSG_RPC_CMD_FS, fdp->fd, pos,
-				   ct_size, &ct);
-	if (res != TEE_SUCCESS)
-		return res;
-	res = tee_fs_rpc_read_final(&op, &bytes);
+	if (meta->info.backup_version_table[bnum / 32] & BIT32(bnum % 32))
+		n++;
+
+	res = legacy_read_raw(fd, sizeof(uint32_t) + 2 * legacy_meta_size() +
+				  n * legacy_block_size(),
+			      legacy_block_size(), &ct, &bytes);
 	if (res != TEE_SUCCESS)
 		return res;
 	if (!bytes) {
 		memset(data, 0, BLOCK_SIZE);
-		return TEE_SUCCESS; /* Block does not exist */
+		return TEE_SUCCESS; /* Block was never written */
 	}
 
-	return tee_fs_decrypt_file(BLOCK_FILE, ct, bytes, data,
-				   &out_size, fdp->meta.encrypted_fek);
+	if (tee_fs_decrypt_file(BLOCK_FILE, ct, bytes, data, &out_size,
+				meta->encrypted_fek) != TEE_SUCCESS ||
+	    out_size != BLOCK_SIZE)
+		return TEE_ERROR_CORRUPT_OBJECT;
+	return TEE_SUCCESS;
 }
 
-static TEE_Result write_block(struct tee_fs_fd *fdp, size_t bnum, uint8_t *data,
-			      struct tee_fs_file_meta *new_meta)
+/*
+ * Converts the file of the previous format opened in fdp->fd. The content
+ * is copied to a new file which then replaces the old one. The new file is
+ * written under a temporary name starting with '.', like the temporary
+ * files of tee_svc_storage.c it isn't enumerated. If anything fails the
+ * old file is left as it is, to be converted on the next open. On success
+ * fdp holds the new file.
+ *
+ * Called with ree_fs_dir_mutex held.
+ */
+static TEE_Result migrate_legacy_file(struct tee_fs_fd *fdp,
+				      const char *fname)
 {
 	TEE_Result res;
-	size_t offs = block_pos_raw(new_meta, bnum, false);
+	struct legacy_file_meta meta;
+	size_t name_len = strlen(fname) + 1;
+	size_t dir_len = 0;
+	int legacy_fd = fdp->fd;
+	uint8_t *block = NULL;
+	char *tmp_name = NULL;
+	size_t bnum;
+	size_t n;
+
+	res = legacy_read_meta(legacy_fd, &meta);
+	if (res != TEE_SUCCESS) {
+		if (res == TEE_ERROR_STORAGE_NOT_AVAILABLE)
+			EMSG("Unsupported file format");
+		return res;
+	}
 
-	res = encrypt_and_write_file(fdp, BLOCK_FILE, offs, data,
-				     BLOCK_SIZE, new_meta->encrypted_fek);
+	if (name_len + 1 > TEE_FS_NAME_MAX)
+		return TEE_ERROR_STORAGE_NOT_AVAILABLE;
+	tmp_name = malloc(name_len + 1);
+	block = malloc(BLOCK_SIZE);
+	if (!tmp_name || !block) {
+		res = TEE_ERROR_OUT_OF_MEMORY;
+		goto out;
+	}
+	for (n = 0; fname[n]; n++)
+		if (fname[n] == '/')
+			dir_len = n + 1;
+	memcpy(tmp_name, fname, dir_len);
+	tmp_name[dir_len] = '.';
+	memcpy(tmp_name + dir_len + 1, fname + dir_len, name_len - dir_len);
+
+	fdp->fd = -1;
+	res = create_file(fdp, tmp_name);
+	if (res != TEE_SUCCESS)
+		goto out;
+
+	for (bnum = 0; bnum < get_num_blocks(meta.info.length); bnum++) {
+		res = legacy_read_block(legacy_fd, &meta, bnum, block);
+		if (res != TEE_SUCCESS)
+			goto out;
+		res = write_block(fdp, bnum, block);
+		if (res != TEE_SUCCESS)
+			goto out;
+	}
+	fdp->length = meta.info.length;
+	fdp->dirty = true;
+	res = commit_file(fdp);
+	if (res != TEE_SUCCESS)
+		goto out;
+
+	res = tee_fs_rpc_rename(OPTEE_MSG_RPC_CMD_FS, tmp_name, fname, true);
 	if (res == TEE_SUCCESS)
-		toggle_backup_version_of_block(new_meta, bnum);
+		DMSG("Converted %s to the current file format", fname);
+
+out:
+	if (res == TEE_SUCCESS) {
+		tee_fs_rpc_close(OPTEE_MSG_RPC_CMD_FS, legacy_fd);
+	} else {
+		if (fdp->fd != -1) {
+			tee_fs_rpc_close(OPTEE_MSG_RPC_CMD_FS, fdp->fd);
+			tee_fs_rpc_remove(OPTEE_MSG_RPC_CMD_FS, tmp_name);
+		}
+		fdp->fd = legacy_fd;
+	}
+	free(block);
+	free(tmp_name);
 	return res;
 }
 
-static TEE_Result out_of_place_write(struct tee_fs_fd *fdp, const void *buf,
-		size_t len, struct tee_fs_file_meta *new_meta)
+static TEE_Result open_file(struct tee_fs_fd *fdp, const char *fname)
 {
 	TEE_Result res;
-	int start_block_num = pos_to_block_num(fdp->pos);
-	int end_block_num = pos_to_block_num(fdp->pos + len - 1);
+
+	res = tee_fs_rpc_open(OPTEE_MSG_RPC_CMD_FS, fname, &fdp->fd);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	res = read_head(fdp);
+	if (res == TEE_ERROR_STORAGE_NOT_AVAILABLE)
+		res = migrate_legacy_file(fdp, fname);
+	return res;
+}
+
+/*
+ * Updates size bytes at offset in a block, using block as bounce buffer.
+ * If data is NULL the bytes are cleared.
+ */
+static TEE_Result update_block(struct tee_fs_fd *fdp, size_t bnum,
+			       uint8_t *block, size_t offset,
+			       const uint8_t *data, size_t size)
+{
+	TEE_Result res;
+
+	/*
+	 * A block which is completely overwritten doesn't need to be
+	 * read first, neither does a block beyond the end of the file.
+	 */
+	if (size == BLOCK_SIZE || bnum * BLOCK_SIZE >= fdp->length)
+		res = TEE_ERROR_ITEM_NOT_FOUND;
+	else
+		res = read_block(fdp, bnum, block);
+	if (res == TEE_ERROR_ITEM_NOT_FOUND)
+		memset(block, 0, BLOCK_SIZE);
+	else if (res != TEE_SUCCESS)
+		return res;
+
+	if (data)
+		memcpy(block + offset, data, size);
+	else
+		memset(block + offset, 0, size);
+
+	return write_block(fdp, bnum, block);
+}
+
+static TEE_Result out_of_place_write(struct tee_fs_fd *fdp, tee_fs_off_t pos,
+		const void *buf, size_t len)
+{
+	TEE_Result res;
+	size_t start_block_num = pos_to_block_num(pos);
+	size_t end_block_num = pos_to_block_num(pos + len - 1);
 	size_t remain_bytes = len;
 	uint8_t *data_ptr = (uint8_t *)buf;
-	uint8_t *block;
-	int orig_pos = fdp->pos;
-
-	block = malloc(BLOCK_SIZE);
-	if (!block)
-		return TEE_ERROR_OUT_OF_MEMORY;
+	uint8_t *block = NULL;
 
 	while (start_block_num <= end_block_num) {
-		int offset = fdp->pos % BLOCK_SIZE;
+		int offset = pos % BLOCK_SIZE;
 		size_t size_to_write = MIN(remain_bytes, (size_t)BLOCK_SIZE);
 
 		if (size_to_write + offset > BLOCK_SIZE)
 			size_to_write = BLOCK_SIZE - offset;
 
-		res = read_block(fdp, start_block_num, block);
-		if (res == TEE_ERROR_ITEM_NOT_FOUND)
-			memset(block, 0, BLOCK_SIZE);
-		else if (res != TEE_SUCCESS)
-			goto exit;
-
-		if (data_ptr)
-			memcpy(block + offset, data_ptr, size_to_write);
-		else
-			memset(block + offset, 0, size_to_write);
-
-		res = write_block(fdp, start_block_num, block, new_meta);
+		/* Whole blocks are encrypted directly from the caller's buffer */
+		if (data_ptr && size_to_write == BLOCK_SIZE) {
+			res = write_block(fdp, start_block_num, data_ptr);
+		} else {
+			if (!block) {
+				block = malloc(BLOCK_SIZE);
+				if (!block) {
+					res = TEE_ERROR_OUT_OF_MEMORY;
+					goto exit;
+				}
+			}
+			res = update_block(fdp, start_block_num, block, offset,
+					   data_ptr, size_to_write);
+		}
 		if (res != TEE_SUCCESS)
 			goto exit;
 
@@ -456,25 +1031,83 @@ static TEE_Result out_of_place_write(struct tee_fs_fd *fdp, const void *buf,
 			data_ptr += size_to_write;
 		remain_bytes -= size_to_write;
 		start_block_num++;
-		fdp->pos += size_to_write;
+		pos += size_to_write;
 	}
 
-	if (fdp->pos > (tee_fs_off_t)new_meta->info.length)
-		new_meta->info.length = fdp->pos;
+	if (pos > (tee_fs_off_t)fdp->length) {
+		fdp->length = pos;
+		fdp->dirty = true;
+	}
 
 exit:
 	free(block);
-	if (res != TEE_SUCCESS)
-		fdp->pos = orig_pos;
 	return res;
 }
 
+static void free_file(struct tee_fs_fd *fdp)
+{
+	free_nodes(fdp->root);
+	tee_fs_key_clear(&fdp->key);
+	mutex_destroy(&fdp->mutex);
+	free(fdp->name);
+	free(fdp);
+}
+
+/* Called with ree_fs_dir_mutex held */
+static TEE_Result new_file(const char *file, bool create,
+			   struct tee_fs_fd **ret_fdp)
+{
+	TEE_Result res;
+	struct tee_fs_fd *fdp;
+
+	fdp = calloc(1, sizeof(struct tee_fs_fd));
+	if (!fdp)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	fdp->fd = -1;
+	fdp->refcount = 1;
+	mutex_init(&fdp->mutex);
+
+	fdp->name = strdup(file);
+	if (!fdp->name) {
+		res = TEE_ERROR_OUT_OF_MEMORY;
+		goto out;
+	}
+
+	if (create) {
+		res = create_file(fdp, file);
+		if (res != TEE_SUCCESS) {
+			if (fdp->fd != -1)
+				tee_fs_rpc_close(OPTEE_MSG_RPC_CMD_FS, fdp->fd);
+			tee_fs_rpc_remove(OPTEE_MSG_RPC_CMD_FS, file);
+		}
+	} else {
+		res = open_file(fdp, file);
+		if (res != TEE_SUCCESS && fdp->fd != -1)
+			tee_fs_rpc_close(OPTEE_MSG_RPC_CMD_FS, fdp->fd);
+	}
+
+out:
+	if (res == TEE_SUCCESS) {
+		SLIST_INSERT_HEAD(&ree_fs_open_files, fdp, link);
+		*ret_fdp = fdp;
+	} else {
+		free_file(fdp);
+	}
+	return res;
+}
+
+/*
+ * All handles of a file share one struct tee_fs_fd, otherwise each
+ * would commit on top of its own view of the file and overwrite the
+ * commits of the others.
+ */
 static TEE_Result open_internal(const char *file, bool create,
 				struct tee_file_handle **fh)
 {
 	TEE_Result res;
 	size_t len;
-	struct tee_fs_fd *fdp = NULL;
+	struct ree_fs_handle *h;
+	struct tee_fs_fd *fdp;
 
 	if (!file)
 		return TEE_ERROR_BAD_PARAMETERS;
@@ -483,29 +1116,29 @@ static TEE_Result open_internal(const char *file, bool create,
 	if (len > TEE_FS_NAME_MAX)
 		return TEE_ERROR_BAD_PARAMETERS;
 
-	fdp = calloc(1, sizeof(struct tee_fs_fd));
-	if (!fdp)
+	h = calloc(1, sizeof(struct ree_fs_handle));
+	if (!h)
 		return TEE_ERROR_OUT_OF_MEMORY;
-	fdp->fd = -1;
 
-	mutex_lock(&ree_fs_mutex);
-
-	if (create)
-		res = create_meta(fdp, file);
-	else
-		res = read_meta(fdp, file);
+	mutex_lock(&ree_fs_dir_mutex);
+	fdp = find_open_file(file);
+	if (fdp && create) {
+		res = TEE_ERROR_ACCESS_CONFLICT;
+	} else if (fdp) {
+		fdp->refcount++;
+		res = TEE_SUCCESS;
+	} else {
+		res = new_file(file, create, &fdp);
+	}
+	mutex_unlock(&ree_fs_dir_mutex);
 
 	if (res == TEE_SUCCESS) {
-		*fh = (struct tee_file_handle *)fdp;
+		h->fdp = fdp;
+		*fh = (struct tee_file_handle *)h;
 	} else {
-		if (fdp->fd != -1)
-			tee_fs_rpc_close(OPTEE_MSG_RPC_CMD_FS, fdp->fd);
-		if (create)
-			tee_fs_rpc_remove(OPTEE_MSG_RPC_CMD_FS, file);
-		free(fdp);
+		free(h);
 	}
 
-	mutex_unlock(&ree_fs_mutex);
 	return res;
 }
 
@@ -521,13 +1154,39 @@ static TEE_Result ree_fs_create(const char *file, struct tee_file_handle **fh)
 
 static void ree_fs_close(struct tee_file_handle **fh)
 {
-	struct tee_fs_fd *fdp = (struct tee_fs_fd *)*fh;
-
-	if (fdp) {
+	struct ree_fs_handle *h = (struct ree_fs_handle *)*fh;
+	struct tee_fs_fd *fdp;
+
+	if (!h)
+		return;
+
+	fdp = h->fdp;
+	mutex_lock(&ree_fs_dir_mutex);
+	fdp->refcount--;
+	if (!fdp->refcount) {
+		if (fdp->name)
+			SLIST_REMOVE(&ree_fs_open_files, fdp, tee_fs_fd, link);
 		tee_fs_rpc_close(OPTEE_MSG_RPC_CMD_FS, fdp->fd);
-		free(fdp);
-		*fh = NULL;
+		free_file(fdp);
 	}
+	mutex_unlock(&ree_fs_dir_mutex);
+
+	free(h);
+	*fh = NULL;
+}
+
+/* Within a transaction of the handle the mutex is already held */
+static struct tee_fs_fd *lock_file(struct ree_fs_handle *h)
+{
+	if (!h->in_transaction)
+		mutex_lock(&h->fdp->mutex);
+	return h->fdp;
+}
+
+static void unlock_file(struct ree_fs_handle *h)
+{
+	if (!h->in_transaction)
+		mutex_unlock(&h->fdp->mutex);
 }
 
 static TEE_Result ree_fs_seek(struct tee_file_handle *fh, int32_t offset,
@@ -536,13 +1195,12 @@ static TEE_Result ree_fs_seek(struct tee_file_handle *fh, int32_t offset,
 	TEE_Result res;
 	tee_fs_off_t new_pos;
 	size_t filelen;
-	struct tee_fs_fd *fdp = (struct tee_fs_fd *)fh;
-
-	mutex_lock(&ree_fs_mutex);
+	struct ree_fs_handle *h = (struct ree_fs_handle *)fh;
+	struct tee_fs_fd *fdp = lock_file(h);
 
 	DMSG("offset=%d, whence=%d", (int)offset, whence);
 
-	filelen = fdp->meta.info.length;
+	filelen = fdp->length;
 
 	switch (whence) {
 	case TEE_DATA_SEEK_SET:
@@ -550,7 +1208,7 @@ static TEE_Result ree_fs_seek(struct tee_file_handle *fh, int32_t offset,
 		break;
 
 	case TEE_DATA_SEEK_CUR:
-		new_pos = fdp->pos + offset;
+		new_pos = h->pos + offset;
 		break;
 
 	case TEE_DATA_SEEK_END:
@@ -571,77 +1229,65 @@ static TEE_Result ree_fs_seek(struct tee_file_handle *fh, int32_t offset,
 		goto exit;
 	}
 
-	fdp->pos = new_pos;
+	h->pos = new_pos;
 	if (new_offs)
 		*new_offs = new_pos;
 	res = TEE_SUCCESS;
 exit:
-	mutex_unlock(&ree_fs_mutex);
+	unlock_file(h);
 	return res;
 }
 
 /*
- * To ensure atomic truncate operation, we can:
- *
- *  - update file length to new length
- *  - commit new meta
- *
- * To ensure atomic extend operation, we can:
+ * A truncate only changes the length, the nodes after the new last block
+ * are dropped. An extension fills the new blocks with zeroes.
  *
- *  - update file length to new length
- *  - allocate and fill zero data to new blocks
- *  - commit new meta
- *
- * Any failure before committing new meta is considered as
- * update failed, and the file content will not be updated
+ * Any failure before the file is committed is considered as update
+ * failed, and the file content will not be updated.
  */
 static TEE_Result ree_fs_ftruncate_internal(struct tee_fs_fd *fdp,
 					    tee_fs_off_t new_file_len)
 {
 	TEE_Result res;
-	size_t old_file_len = fdp->meta.info.length;
-	struct tee_fs_file_meta new_meta;
+	size_t old_file_len = fdp->length;
 
 	if (new_file_len > MAX_FILE_SIZE)
 		return TEE_ERROR_BAD_PARAMETERS;
 
-	new_meta = fdp->meta;
-	new_meta.info.length = new_file_len;
-
 	if ((size_t)new_file_len > old_file_len) {
 		size_t ext_len = new_file_len - old_file_len;
-		int orig_pos = fdp->pos;
 
-		fdp->pos = old_file_len;
-		res = out_of_place_write(fdp, NULL, ext_len, &new_meta);
-		fdp->pos = orig_pos;
+		res = out_of_place_write(fdp, old_file_len, NULL, ext_len);
 		if (res != TEE_SUCCESS)
 			return res;
+	} else if ((size_t)new_file_len < old_file_len) {
+		prune_nodes(fdp, fdp->root, get_num_blocks(new_file_len));
 	}
 
-	return commit_meta_file(fdp, &new_meta);
+	fdp->length = new_file_len;
+	fdp->dirty = true;
+	return TEE_SUCCESS;
 }
 
 static TEE_Result ree_fs_read(struct tee_file_handle *fh, void *buf,
 			      size_t *len)
 {
 	TEE_Result res;
-	int start_block_num;
-	int end_block_num;
+	size_t start_block_num;
+	size_t end_block_num;
 	size_t remain_bytes;
 	uint8_t *data_ptr = buf;
 	uint8_t *block = NULL;
-	struct tee_fs_fd *fdp = (struct tee_fs_fd *)fh;
-
-	mutex_lock(&ree_fs_mutex);
+	struct ree_fs_handle *h = (struct ree_fs_handle *)fh;
+	struct tee_fs_fd *fdp = lock_file(h);
 
 	remain_bytes = *len;
-	if ((fdp->pos + remain_bytes) < remain_bytes ||
-	    fdp->pos > (tee_fs_off_t)fdp->meta.info.length)
+	if ((h->pos + remain_bytes) < remain_bytes ||
+	    h->pos > (tee_fs_off_t)fdp->length)
 		remain_bytes = 0;
-	else if (fdp->pos + (tee_fs_off_t)remain_bytes >
-		(tee_fs_off_t)fdp->meta.info.length)
-		remain_bytes = fdp->meta.info.length - fdp->pos;
+	else if (h->pos + (tee_fs_off_t)remain_bytes >
+		(tee_fs_off_t)fdp->length)
+		remain_bytes = fdp->length - h->pos;
 
 	*len = remain_bytes;
 
@@ -650,40 +1296,42 @@ static TEE_Result ree_fs_read(struct tee_file_handle *fh, void *buf,
 		goto exit;
 	}
 
-	start_block_num = pos_to_block_num(fdp->pos);
-	end_block_num = pos_to_block_num(fdp->pos + remain_bytes - 1);
-
 	block = malloc(BLOCK_SIZE);
 	if (!block) {
 		res = TEE_ERROR_OUT_OF_MEMORY;
 		goto exit;
 	}
 
+	start_block_num = pos_to_block_num(h->pos);
+	end_block_num = pos_to_block_num(h->pos + remain_bytes - 1);
+
 	while (start_block_num <= end_block_num) {
-		tee_fs_off_t offset = fdp->pos % BLOCK_SIZE;
+		tee_fs_off_t offset = h->pos % BLOCK_SIZE;
 		size_t size_to_read = MIN(remain_bytes, (size_t)BLOCK_SIZE);
 
 		if (size_to_read + offset > BLOCK_SIZE)
 			size_to_read = BLOCK_SIZE - offset;
 
+		/*
+		 * The caller's buffer may be shared with the normal world,
+		 * so blocks are decrypted into secure memory and copied out
+		 * only once authenticated.
+		 */
 		res = read_block(fdp, start_block_num, block);
-		if (res != TEE_SUCCESS) {
-			if (res == TEE_ERROR_MAC_INVALID)
-				res = TEE_ERROR_CORRUPT_OBJECT;
+		if (res != TEE_SUCCESS)
 			goto exit;
-		}
 
 		memcpy(data_ptr, block + offset, size_to_read);
 
 		data_ptr += size_to_read;
 		remain_bytes -= size_to_read;
-		fdp->pos += size_to_read;
+		h->pos += size_to_read;
 
 		start_block_num++;
 	}
 	res = TEE_SUCCESS;
 exit:
-	mutex_unlock(&ree_fs_mutex);
+	unlock_file(h);
 	free(block);
 	return res;
 }
@@ -693,13 +1341,12 @@ exit:
  * do the following steps:
  * (The sequence of operations is very important)
  *
- *  - Create a new backup version of meta file as a copy
- *    of current meta file.
  *  - For each blocks to write:
- *    - Create new backup version for current block.
- *    - Write data to new backup version.
- *    - Update the new meta file accordingly.
- *  - Write the new meta file.
+ *    - Write data to the inactive version of the block.
+ *    - Update the node of the block accordingly.
+ *  - Write the updated nodes to their inactive versions, updating the
+ *    hashes in their parents up to the root.
+ *  - Write a new head with the new root hash.
  *
  * (Any failure in above steps is considered as update failed,
  *  and the file content will not be updated)
@@ -708,36 +1355,38 @@ static TEE_Result ree_fs_write(struct tee_file_handle *fh, const void *buf,
 			       size_t len)
 {
 	TEE_Result res;
-	struct tee_fs_file_meta new_meta;
-	struct tee_fs_fd *fdp = (struct tee_fs_fd *)fh;
+	struct ree_fs_handle *h = (struct ree_fs_handle *)fh;
+	struct tee_fs_fd *fdp;
 	size_t file_size;
 
 	if (!len)
 		return TEE_SUCCESS;
 
-	mutex_lock(&ree_fs_mutex);
+	fdp = lock_file(h);
 
-	file_size = fdp->meta.info.length;
+	file_size = fdp->length;
 
-	if ((fdp->pos + len) > MAX_FILE_SIZE || (fdp->pos + len) < len) {
+	if ((h->pos + len) > MAX_FILE_SIZE || (h->pos + len) < len) {
 		res = TEE_ERROR_BAD_PARAMETERS;
-		goto exit;
+		goto out;
 	}
 
-	if (file_size < (size_t)fdp->pos) {
-		res = ree_fs_ftruncate_internal(fdp, fdp->pos);
+	if (file_size < (size_t)h->pos) {
+		res = ree_fs_ftruncate_internal(fdp, h->pos);
 		if (res != TEE_SUCCESS)
 			goto exit;
 	}
 
-	new_meta = fdp->meta;
-	res = out_of_place_write(fdp, buf, len, &new_meta);
-	if (res != TEE_SUCCESS)
-		goto exit;
-
-	res = commit_meta_file(fdp, &new_meta);
+	res = out_of_place_write(fdp, h->pos, buf, len);
 exit:
-	mutex_unlock(&ree_fs_mutex);
+	if (res == TEE_SUCCESS)
+		res = end_update(fdp);
+	else
+		rollback_file(fdp);
+	if (res == TEE_SUCCESS)
+		h->pos += len;
+out:
+	unlock_file(h);
 	return res;
 }
 
@@ -745,11 +1394,26 @@ static TEE_Result ree_fs_rename(const char *old, const char *new,
 				bool overwrite)
 {
 	TEE_Result res;
+	struct tee_fs_fd *fdp;
+	char *new_name = strdup(new);
+
+	if (!new_name)
+		return TEE_ERROR_OUT_OF_MEMORY;
 
-	mutex_lock(&ree_fs_mutex);
+	mutex_lock(&ree_fs_dir_mutex);
 	res = tee_fs_rpc_rename(OPTEE_MSG_RPC_CMD_FS, old, new, overwrite);
-	mutex_unlock(&ree_fs_mutex);
+	if (res == TEE_SUCCESS && strcmp(old, new)) {
+		unlink_open_file(new);
+		fdp = find_open_file(old);
+		if (fdp) {
+			free(fdp->name);
+			fdp->name = new_name;
+			new_name = NULL;
+		}
+	}
+	mutex_unlock(&ree_fs_dir_mutex);
 
+	free(new_name);
 	return res;
 }
 
@@ -757,9 +1421,11 @@ static TEE_Result ree_fs_remove(const char *file)
 {
 	TEE_Result res;
 
-	mutex_lock(&ree_fs_mutex);
+	mutex_lock(&ree_fs_dir_mutex);
 	res = tee_fs_rpc_remove(OPTEE_MSG_RPC_CMD_FS, file);
-	mutex_unlock(&ree_fs_mutex);
+	if (res == TEE_SUCCESS)
+		unlink_open_file(file);
+	mutex_unlock(&ree_fs_dir_mutex);
 
 	return res;
 }
@@ -767,11 +1433,55 @@ static TEE_Result ree_fs_remove(const char *file)
 static TEE_Result ree_fs_truncate(struct tee_file_handle *fh, size_t len)
 {
 	TEE_Result res;
-	struct tee_fs_fd *fdp = (struct tee_fs_fd *)fh;
+	struct ree_fs_handle *h = (struct ree_fs_handle *)fh;
+	struct tee_fs_fd *fdp;
 
-	mutex_lock(&ree_fs_mutex);
+	if (len > MAX_FILE_SIZE)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	fdp = lock_file(h);
 	res = ree_fs_ftruncate_internal(fdp, len);
-	mutex_unlock(&ree_fs_mutex);
+	if (res == TEE_SUCCESS)
+		res = end_update(fdp);
+	else
+		rollback_file(fdp);
+	unlock_file(h);
+
+	return res;
+}
+
+/*
+ * Updates of the file between ree_fs_begin_transaction() and
+ * ree_fs_end_transaction() are committed together. If one of them fails,
+ * or the transaction is ended without commit, all updates since the last
+ * commit are discarded. The file stays locked for the whole transaction,
+ * updates through other handles of the file wait until it has ended.
+ */
+static TEE_Result ree_fs_begin_transaction(struct tee_file_handle *fh)
+{
+	struct ree_fs_handle *h = (struct ree_fs_handle *)fh;
+
+	mutex_lock(&h->fdp->mutex);
+	h->in_transaction = true;
+	h->fdp->in_transaction = true;
+
+	return TEE_SUCCESS;
+}
+
+static TEE_Result ree_fs_end_transaction(struct tee_file_handle *fh,
+					 bool commit)
+{
+	TEE_Result res = TEE_SUCCESS;
+	struct ree_fs_handle *h = (struct ree_fs_handle *)fh;
+	struct tee_fs_fd *fdp = h->fdp;
+
+	h->in_transaction = false;
+	fdp->in_transaction = false;
+	if (commit)
+		res = end_update(fdp);
+	else
+		rollback_file(fdp);
+	mutex_unlock(&fdp->mutex);
 
 	return res;
 }
@@ -784,6 +1494,8 @@ const struct tee_file_operations ree_fs_ops = {
 	.write = ree_fs_write,
 	.seek = ree_fs_seek,
 	.truncate = ree_fs_truncate,
+	.begin_transaction = ree_fs_begin_transaction,
+	.end_transaction = ree_fs_end_transaction,
 	.rename = ree_fs_rename,
 	.remove = ree_fs_remove,
 	.opendir = ree_fs_opendir_rpc,
@@ -80,6 +80,16 @@ struct rpmb_fat_entry {
 	char filename[TEE_RPMB_FS_FILENAME_LENGTH];
 };
 
+/* A write buffered by a transaction, see rpmb_fs_begin_transaction() */
+struct tx_range {
+	SIMPLEQ_ENTRY(tx_range) link;
+	size_t pos;
+	size_t size;
+	const uint8_t *data;
+};
+
+SIMPLEQ_HEAD(tx_range_head, tx_range);
+
 /**
  * FAT entry context with reference to a FAT entry and its
  * location in RPMB.
@@ -91,6 +101,17 @@ struct rpmb_file_handle {
 	uint32_t rpmb_fat_address;
 	/* Current position */
 	uint32_t pos;
+	/* Unwrapped fat_entry.fek, zero if the file isn't encrypted */
+	struct tee_fs_key key;
+	/*
+	 * Set between rpmb_fs_begin_transaction() and
+	 * rpmb_fs_end_transaction(), writes are then only added to tx_ranges
+	 */
+	bool in_transaction;
+	/* Pending writes of the transaction, in the order they were made */
+	struct tx_range_head tx_ranges;
+	/* Size of the file including the pending writes */
+	size_t tx_size;
 };
 
 /**
@@ -512,14 +533,14 @@ static bool is_zero(const uint8_t *buf, size_t size)
 }
 
 static TEE_Result encrypt_block(uint8_t *out, const uint8_t *in,
-				uint16_t blk_idx, const uint8_t *fek)
+				uint16_t blk_idx, struct tee_fs_key *fek)
 {
 	return tee_fs_crypt_block(out, in, RPMB_DATA_SIZE, blk_idx, fek,
 				  TEE_MODE_ENCRYPT);
 }
 
 static TEE_Result decrypt_block(uint8_t *out, const uint8_t *in,
-				uint16_t blk_idx, const uint8_t *fek)
+				uint16_t blk_idx, struct tee_fs_key *fek)
 {
 	return tee_fs_crypt_block(out, in, RPMB_DATA_SIZE, blk_idx, fek,
 				  TEE_MODE_DECRYPT);
@@ -528,7 +549,8 @@ static TEE_Result decrypt_block(uint8_t *out, const uint8_t *in,
 /* Decrypt/copy at most one block of data */
 static TEE_Result decrypt(uint8_t *out, const struct rpmb_data_frame *frm,
 			  size_t size, size_t offset,
-			  uint16_t blk_idx __maybe_unused, const uint8_t *fek)
+			  uint16_t blk_idx __maybe_unused,
+			  struct tee_fs_key *fek)
 {
 	uint8_t *tmp __maybe_unused;
 
@@ -539,7 +561,7 @@ static TEE_Result decrypt(uint8_t *out, const struct rpmb_data_frame *frm,
 	if (!fek) {
 		/* Block is not encrypted (not a file data block) */
 		memcpy(out, frm->data + offset, size);
-	} else if (is_zero(fek, TEE_FS_KM_FEK_SIZE)) {
+	} else if (is_zero(fek->fek, TEE_FS_KM_FEK_SIZE)) {
 		/* The file was created with encryption disabled */
 		return TEE_ERROR_SECURITY;
 	} else {
@@ -566,7 +588,7 @@ static TEE_Result decrypt(uint8_t *out, const struct rpmb_data_frame *frm,
 static TEE_Result tee_rpmb_req_pack(struct rpmb_req *req,
 				    struct rpmb_raw_data *rawdata,
 				    uint16_t nbr_frms, uint16_t dev_id,
-				    const uint8_t *fek)
+				    struct tee_fs_key *fek)
 {
 	TEE_Result res = TEE_ERROR_GENERIC;
 	int i;
@@ -664,7 +686,7 @@ func_exit:
 
 static TEE_Result data_cpy_mac_calc_1b(struct rpmb_raw_data *rawdata,
 				       struct rpmb_data_frame *frm,
-				       uint8_t *fek)
+				       struct tee_fs_key *fek)
 {
 	TEE_Result res;
 	uint8_t *data;
@@ -689,7 +711,7 @@ static TEE_Result tee_rpmb_data_cpy_mac_calc(struct rpmb_data_frame *datafrm,
 					     struct rpmb_raw_data *rawdata,
 					     uint16_t nbr_frms,
 					     struct rpmb_data_frame *lastfrm,
-					     uint8_t *fek)
+					     struct tee_fs_key *fek)
 {
 	TEE_Result res = TEE_ERROR_GENERIC;
 	int i;
@@ -789,7 +811,8 @@ func_exit:
 
 static TEE_Result tee_rpmb_resp_unpack_verify(struct rpmb_data_frame *datafrm,
 					      struct rpmb_raw_data *rawdata,
-					      uint16_t nbr_frms, uint8_t *fek)
+					      uint16_t nbr_frms,
+					      struct tee_fs_key *fek)
 {
 	TEE_Result res = TEE_ERROR_GENERIC;
 	uint16_t msg_type;
@@ -1202,10 +1225,10 @@ func_exit:
  * @addr       Byte address of data.
  * @data       Pointer to the data.
  * @len        Size of data in bytes.
- * @fek        Encrypted File Encryption Key or NULL.
+ * @fek        File Encryption Key or NULL.
  */
 static TEE_Result tee_rpmb_read(uint16_t dev_id, uint32_t addr, uint8_t *data,
-				uint32_t len, uint8_t *fek)
+				uint32_t len, struct tee_fs_key *fek)
 {
 	TEE_Result res = TEE_ERROR_GENERIC;
 	struct tee_rpmb_mem mem = { 0 };
@@ -1288,7 +1311,7 @@ func_exit:
 
 static TEE_Result tee_rpmb_write_blk(uint16_t dev_id, uint16_t blk_idx,
 				     const uint8_t *data_blks, uint16_t blkcnt,
-				     const uint8_t *fek)
+				     struct tee_fs_key *fek)
 {
 	TEE_Result res;
 	struct tee_rpmb_mem mem;
@@ -1421,11 +1444,11 @@ static bool tee_rpmb_write_is_atomic(uint16_t dev_id __unused, uint32_t addr,
  * @addr       Byte address of data.
  * @data       Pointer to the data.
  * @len        Size of data in bytes.
- * @fek        Encrypted File Encryption Key or NULL.
+ * @fek        File Encryption Key or NULL.
  */
 static TEE_Result tee_rpmb_write(uint16_t dev_id, uint32_t addr,
 				 const uint8_t *data, uint32_t len,
-				 uint8_t *fek)
+				 struct tee_fs_key *fek)
 {
 	TEE_Result res = TEE_ERROR_GENERIC;
 	uint8_t *data_tmp = NULL;
@@ -1602,6 +1625,7 @@ static struct rpmb_file_handle *alloc_file_handle(const char *filename)
 
 	if (filename)
 		strlcpy(fh->filename, filename, sizeof(fh->filename));
+	SIMPLEQ_INIT(&fh->tx_ranges);
 
 	return fh;
 }
@@ -2005,22 +2029,61 @@ static TEE_Result rpmb_fs_open_internal(const char *file, bool create,
 		}
 	}
 
+	if (!is_zero(fh->fat_entry.fek, sizeof(fh->fat_entry.fek))) {
+		res = tee_fs_key_init(&fh->key, fh->fat_entry.fek);
+		if (res != TEE_SUCCESS)
+			goto out;
+	}
+
 	res = TEE_SUCCESS;
 
 out:
-	if (res == TEE_SUCCESS)
+	if (res == TEE_SUCCESS) {
 		*ret_fh = (struct tee_file_handle *)fh;
-	else
+	} else if (fh) {
+		tee_fs_key_clear(&fh->key);
 		free(fh);
+	}
 
 	mutex_unlock(&rpmb_mutex);
 	return res;
 }
 
+static void tx_discard(struct rpmb_file_handle *fh)
+{
+	struct tx_range *r;
+
+	while ((r = SIMPLEQ_FIRST(&fh->tx_ranges))) {
+		SIMPLEQ_REMOVE_HEAD(&fh->tx_ranges, link);
+		free(r);
+	}
+	fh->tx_size = 0;
+}
+
+/* Copies the pending writes overlapping [pos, pos + size) into buf */
+static void tx_apply(struct rpmb_file_handle *fh, uint8_t *buf, size_t pos,
+		     size_t size)
+{
+	struct tx_range *r;
+	size_t lo;
+	size_t hi;
+
+	SIMPLEQ_FOREACH(r, &fh->tx_ranges, link) {
+		lo = MAX(pos, r->pos);
+		hi = MIN(pos + size, r->pos + r->size);
+		if (lo < hi)
+			memcpy(buf + lo - pos, r->data + lo - r->pos, hi - lo);
+	}
+}
+
 static void rpmb_fs_close(struct tee_file_handle **tfh)
 {
 	struct rpmb_file_handle *fh = (struct rpmb_file_handle *)*tfh;
 
+	if (fh) {
+		tee_fs_key_clear(&fh->key);
+		tx_discard(fh);
+	}
 	free(fh);
 	*tfh = NULL;
 }
@@ -2031,6 +2094,8 @@ static TEE_Result rpmb_fs_read(struct tee_file_handle *tfh, void *buf,
 	TEE_Result res;
 	struct rpmb_file_handle *fh = (struct rpmb_file_handle *)tfh;
 	size_t size = *len;
+	size_t file_size;
+	size_t n = 0;
 
 	if (!size)
 		return TEE_SUCCESS;
@@ -2043,19 +2108,31 @@ static TEE_Result rpmb_fs_read(struct tee_file_handle *tfh, void *buf,
 	if (res != TEE_SUCCESS)
 		goto out;
 
-	if (fh->pos >= fh->fat_entry.data_size) {
+	/* Pending writes of a transaction are included */
+	if (SIMPLEQ_EMPTY(&fh->tx_ranges))
+		file_size = fh->fat_entry.data_size;
+	else
+		file_size = fh->tx_size;
+
+	if (fh->pos >= file_size) {
 		*len = 0;
 		goto out;
 	}
 
-	size = MIN(size, fh->fat_entry.data_size - fh->pos);
-	if (size) {
+	size = MIN(size, file_size - fh->pos);
+	if (fh->pos < fh->fat_entry.data_size)
+		n = MIN(size, fh->fat_entry.data_size - fh->pos);
+	if (n) {
 		res = tee_rpmb_read(CFG_RPMB_FS_DEV_ID,
 				    fh->fat_entry.start_address + fh->pos, buf,
-				    size, fh->fat_entry.fek);
+				    n, &fh->key);
 		if (res != TEE_SUCCESS)
 			goto out;
 	}
+	/* Bytes skipped by a seek beyond the end read as zero */
+	if (n < size)
+		memset((uint8_t *)buf + n, 0, size - n);
+	tx_apply(fh, buf, fh->pos, size);
 	*len = size;
 	fh->pos += size;
 
@@ -2064,25 +2141,24 @@ out:
 	return res;
 }
 
-static TEE_Result rpmb_fs_write(struct tee_file_handle *tfh, const void *buf,
-				size_t size)
+/*
+ * Writes the non-empty list of ranges to the file, later ranges overriding
+ * earlier ones, must be called with rpmb_mutex held.
+ */
+static TEE_Result write_data(struct rpmb_file_handle *fh,
+			     struct tx_range_head *ranges)
 {
 	TEE_Result res;
-	struct rpmb_file_handle *fh = (struct rpmb_file_handle *)tfh;
 	tee_mm_pool_t p;
 	bool pool_result = false;
 	tee_mm_entry_t *mm;
-	size_t end;
+	struct tx_range *r;
+	size_t end = 0;
 	size_t newsize;
 	uint8_t *newbuf = NULL;
 	uintptr_t newaddr;
 	uint32_t start_addr;
 
-	if (!size)
-		return TEE_SUCCESS;
-
-	mutex_lock(&rpmb_mutex);
-
 	if (!fs_par) {
 		res = TEE_ERROR_GENERIC;
 		goto out;
@@ -2108,21 +2184,23 @@ static TEE_Result rpmb_fs_write(struct tee_file_handle *tfh, const void *buf,
 	if (fh->fat_entry.flags & FILE_IS_LAST_ENTRY)
 		panic("invalid last entry flag");
 
-	end = fh->pos + size;
-	start_addr = fh->fat_entry.start_address + fh->pos;
+	SIMPLEQ_FOREACH(r, ranges, link)
+		end = MAX(end, r->pos + r->size);
+	r = SIMPLEQ_FIRST(ranges);
+	start_addr = fh->fat_entry.start_address + r->pos;
 
-	if (end <= fh->fat_entry.data_size &&
-	    tee_rpmb_write_is_atomic(CFG_RPMB_FS_DEV_ID, start_addr, size)) {
+	if (!SIMPLEQ_NEXT(r, link) && end <= fh->fat_entry.data_size &&
+	    tee_rpmb_write_is_atomic(CFG_RPMB_FS_DEV_ID, start_addr, r->size)) {
 
 		DMSG("Updating data in-place");
-		res = tee_rpmb_write(CFG_RPMB_FS_DEV_ID, start_addr, buf,
-				     size, fh->fat_entry.fek);
+		res = tee_rpmb_write(CFG_RPMB_FS_DEV_ID, start_addr, r->data,
+				     r->size, &fh->key);
 		if (res != TEE_SUCCESS)
 			goto out;
 	} else {
 		/*
-		 * File must be extended, or update cannot be atomic: allocate,
-		 * read, update, write.
+		 * File must be extended, or update cannot be atomic or
+		 * covers several ranges: allocate, read, update, write.
 		 */
 
 		DMSG("Need to re-allocate");
@@ -2138,16 +2216,17 @@ static TEE_Result rpmb_fs_write(struct tee_file_handle *tfh, const void *buf,
 			res = tee_rpmb_read(CFG_RPMB_FS_DEV_ID,
 					    fh->fat_entry.start_address,
 					    newbuf, fh->fat_entry.data_size,
-					    fh->fat_entry.fek);
+					    &fh->key);
 			if (res != TEE_SUCCESS)
 				goto out;
 		}
 
-		memcpy(newbuf + fh->pos, buf, size);
+		SIMPLEQ_FOREACH(r, ranges, link)
+			memcpy(newbuf + r->pos, r->data, r->size);
 
 		newaddr = tee_mm_get_smem(mm);
 		res = tee_rpmb_write(CFG_RPMB_FS_DEV_ID, newaddr, newbuf,
-				     newsize, fh->fat_entry.fek);
+				     newsize, &fh->key);
 		if (res != TEE_SUCCESS)
 			goto out;
 
@@ -2158,9 +2237,7 @@ static TEE_Result rpmb_fs_write(struct tee_file_handle *tfh, const void *buf,
 			goto out;
 	}
 
-	fh->pos += size;
 out:
-	mutex_unlock(&rpmb_mutex);
 	if (pool_result)
 		tee_mm_final(&p);
 	if (newbuf)
@@ -2169,6 +2246,112 @@ out:
 	return res;
 }
 
+/*
+ * Adds a write to the pending writes of the current transaction, must be
+ * called with rpmb_mutex held. Only the written bytes are kept, the file
+ * itself is read by write_data() when the transaction is committed and
+ * only if the file has to be moved.
+ */
+static TEE_Result tx_write(struct rpmb_file_handle *fh, const void *buf,
+			   size_t size)
+{
+	TEE_Result res;
+	struct tx_range *r;
+
+	if (SIMPLEQ_EMPTY(&fh->tx_ranges)) {
+		res = read_fat(fh, NULL);
+		if (res != TEE_SUCCESS)
+			return res;
+		fh->tx_size = fh->fat_entry.data_size;
+	}
+
+	r = malloc(sizeof(*r) + size);
+	if (!r)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	r->pos = fh->pos;
+	r->size = size;
+	r->data = memcpy(r + 1, buf, size);
+	SIMPLEQ_INSERT_TAIL(&fh->tx_ranges, r, link);
+	fh->tx_size = MAX(fh->tx_size, r->pos + size);
+	return TEE_SUCCESS;
+}
+
+/*
+ * Writes the pending writes of the transaction, must be called with
+ * rpmb_mutex held. The pending writes are dropped even if this fails.
+ */
+static TEE_Result tx_commit(struct rpmb_file_handle *fh)
+{
+	TEE_Result res = TEE_SUCCESS;
+
+	if (!SIMPLEQ_EMPTY(&fh->tx_ranges))
+		res = write_data(fh, &fh->tx_ranges);
+	tx_discard(fh);
+	return res;
+}
+
+static TEE_Result rpmb_fs_write(struct tee_file_handle *tfh, const void *buf,
+				size_t size)
+{
+	TEE_Result res;
+	struct rpmb_file_handle *fh = (struct rpmb_file_handle *)tfh;
+	struct tx_range r = { .pos = fh->pos, .size = size, .data = buf };
+	struct tx_range_head ranges = SIMPLEQ_HEAD_INITIALIZER(ranges);
+
+	if (!size)
+		return TEE_SUCCESS;
+
+	mutex_lock(&rpmb_mutex);
+
+	if (fh->in_transaction) {
+		res = tx_write(fh, buf, size);
+		if (res != TEE_SUCCESS)
+			tx_discard(fh);
+	} else {
+		SIMPLEQ_INSERT_TAIL(&ranges, &r, link);
+		res = write_data(fh, &ranges);
+	}
+	if (res == TEE_SUCCESS)
+		fh->pos += size;
+
+	mutex_unlock(&rpmb_mutex);
+	return res;
+}
+
+/*
+ * Writes of the file between rpmb_fs_begin_transaction() and
+ * rpmb_fs_end_transaction() are kept in memory and written together
+ * when the transaction ends. A single write that can be done atomically in
+ * place is written in place, otherwise the file is read once, updated with
+ * all the writes and written with one RPMB write plus one write of the FAT
+ * entry. Each write would otherwise be written separately, rewriting the
+ * whole file each time the file grows. If a write fails, or the
+ * transaction is ended without commit, the pending writes are discarded.
+ */
+static TEE_Result rpmb_fs_begin_transaction(struct tee_file_handle *tfh)
+{
+	struct rpmb_file_handle *fh = (struct rpmb_file_handle *)tfh;
+
+	fh->in_transaction = true;
+	return TEE_SUCCESS;
+}
+
+static TEE_Result rpmb_fs_end_transaction(struct tee_file_handle *tfh,
+					  bool commit)
+{
+	struct rpmb_file_handle *fh = (struct rpmb_file_handle *)tfh;
+	TEE_Result res = TEE_SUCCESS;
+
+	mutex_lock(&rpmb_mutex);
+	fh->in_transaction = false;
+	if (commit)
+		res = tx_commit(fh);
+	else
+		tx_discard(fh);
+	mutex_unlock(&rpmb_mutex);
+	return res;
+}
+
 static TEE_Result rpmb_fs_seek(struct tee_file_handle *tfh, int32_t offset,
 			       TEE_Whence whence, int32_t *new_offs)
 
@@ -2193,7 +2376,10 @@ static TEE_Result rpmb_fs_seek(struct tee_file_handle *tfh, int32_t offset,
 		break;
 
 	case TEE_DATA_SEEK_END:
-		new_pos = fh->fat_entry.data_size + offset;
+		if (!SIMPLEQ_EMPTY(&fh->tx_ranges))
+			new_pos = fh->tx_size + offset;
+		else
+			new_pos = fh->fat_entry.data_size + offset;
 		break;
 
 	default:
@@ -2338,6 +2524,11 @@ static TEE_Result rpmb_fs_truncate(struct tee_file_handle *tfh, size_t length)
 	}
 	newsize = length;
 
+	/* Pending writes of a transaction are written first */
+	res = tx_commit(fh);
+	if (res != TEE_SUCCESS)
+		goto out;
+
 	res = read_fat(fh, NULL);
 	if (res != TEE_SUCCESS)
 		goto out;
@@ -2369,14 +2560,14 @@ static TEE_Result rpmb_fs_truncate(struct tee_file_handle *tfh, size_t length)
 			res = tee_rpmb_read(CFG_RPMB_FS_DEV_ID,
 					    fh->fat_entry.start_address,
 					    newbuf, fh->fat_entry.data_size,
-					    fh->fat_entry.fek);
+					    &fh->key);
 			if (res != TEE_SUCCESS)
 				goto out;
 		}
 
 		newaddr = tee_mm_get_smem(mm);
 		res = tee_rpmb_write(CFG_RPMB_FS_DEV_ID, newaddr, newbuf,
-				     newsize, fh->fat_entry.fek);
+				     newsize, &fh->key);
 		if (res != TEE_SUCCESS)
 			goto out;
 
@@ -2609,6 +2800,8 @@ const struct tee_file_operations rpmb_fs_ops = {
 	.write = rpmb_fs_write,
 	.seek = rpmb_fs_seek,
 	.truncate = rpmb_fs_truncate,
+	.begin_transaction = rpmb_fs_begin_transaction,
+	.end_transaction = rpmb_fs_end_transaction,
 	.rename = rpmb_fs_rename,
 	.remove = rpmb_fs_remove,
 	.opendir = rpmb_fs_opendir,
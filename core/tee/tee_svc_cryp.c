@@ -2149,21 +2149,10 @@ TEE_Result syscall_cryp_state_free(unsigned long state)
 	return TEE_SUCCESS;
 }
 
-TEE_Result syscall_hash_init(unsigned long state,
-			     const void *iv __maybe_unused,
-			     size_t iv_len __maybe_unused)
+static TEE_Result hash_init_state(struct user_ta_ctx *utc,
+				  struct tee_cryp_state *cs)
 {
 	TEE_Result res;
-	struct tee_cryp_state *cs;
-	struct tee_ta_session *sess;
-
-	res = tee_ta_get_current_session(&sess);
-	if (res != TEE_SUCCESS)
-		return res;
-
-	res = tee_svc_cryp_get_state(sess, tee_svc_uref_to_vaddr(state), &cs);
-	if (res != TEE_SUCCESS)
-		return res;
 
 	switch (TEE_ALG_GET_CLASS(cs->algo)) {
 	case TEE_OPERATION_DIGEST:
@@ -2178,8 +2167,7 @@ TEE_Result syscall_hash_init(unsigned long state,
 			struct tee_obj *o;
 			struct tee_cryp_obj_secret *key;
 
-			res = tee_obj_get(to_user_ta_ctx(sess->ctx),
-					  cs->key1, &o);
+			res = tee_obj_get(utc, cs->key1, &o);
 			if (res != TEE_SUCCESS)
 				return res;
 			if ((o->info.handleFlags &
@@ -2203,6 +2191,25 @@ TEE_Result syscall_hash_init(unsigned long state,
 	return TEE_SUCCESS;
 }
 
+TEE_Result syscall_hash_init(unsigned long state,
+			     const void *iv __maybe_unused,
+			     size_t iv_len __maybe_unused)
+{
+	TEE_Result res;
+	struct tee_cryp_state *cs;
+	struct tee_ta_session *sess;
+
+	res = tee_ta_get_current_session(&sess);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	res = tee_svc_cryp_get_state(sess, tee_svc_uref_to_vaddr(state), &cs);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	return hash_init_state(to_user_ta_ctx(sess->ctx), cs);
+}
+
 TEE_Result syscall_hash_update(unsigned long state, const void *chunk,
 			size_t chunk_size)
 {
@@ -2257,103 +2264,179 @@ TEE_Result syscall_hash_update(unsigned long state, const void *chunk,
 	return TEE_SUCCESS;
 }
 
+/*
+ * Feeds the last chunk and writes the digest or MAC to hash. Returns
+ * TEE_ERROR_SHORT_BUFFER if hash_len is too small, in both cases
+ * *hash_size is updated with the size of the result.
+ */
+static TEE_Result hash_final_state(struct tee_cryp_state *cs,
+				   const void *chunk, size_t chunk_size,
+				   void *hash, uint64_t hash_len,
+				   size_t *hash_size)
+{
+	TEE_Result res;
+
+	switch (TEE_ALG_GET_CLASS(cs->algo)) {
+	case TEE_OPERATION_DIGEST:
+		if (!crypto_ops.hash.update || !crypto_ops.hash.final)
+			return TEE_ERROR_NOT_IMPLEMENTED;
+		res = tee_hash_get_digest_size(cs->algo, hash_size);
+		if (res != TEE_SUCCESS)
+			return res;
+		if (hash_len < *hash_size)
+			return TEE_ERROR_SHORT_BUFFER;
+
+		if (chunk_size) {
+			res = crypto_ops.hash.update(cs->ctx, cs->algo, chunk,
+						     chunk_size);
+			if (res != TEE_SUCCESS)
+				return res;
+		}
+
+		return crypto_ops.hash.final(cs->ctx, cs->algo, hash,
+					     *hash_size);
+
+	case TEE_OPERATION_MAC:
+		if (!crypto_ops.mac.update || !crypto_ops.mac.final)
+			return TEE_ERROR_NOT_IMPLEMENTED;
+		res = tee_mac_get_digest_size(cs->algo, hash_size);
+		if (res != TEE_SUCCESS)
+			return res;
+		if (hash_len < *hash_size)
+			return TEE_ERROR_SHORT_BUFFER;
+
+		if (chunk_size) {
+			res = crypto_ops.mac.update(cs->ctx, cs->algo, chunk,
+						    chunk_size);
+			if (res != TEE_SUCCESS)
+				return res;
+		}
+
+		return crypto_ops.mac.final(cs->ctx, cs->algo, hash,
+					    *hash_size);
+
+	default:
+		return TEE_ERROR_BAD_PARAMETERS;
+	}
+}
+
+static TEE_Result check_hash_buffers(struct user_ta_ctx *utc,
+				     const void *chunk, size_t chunk_size,
+				     void *hash, uint64_t hash_len)
+{
+	TEE_Result res;
+
+	/* No data, but size provided isn't valid parameters. */
+	if (!chunk && chunk_size)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	res = tee_mmu_check_access_rights(utc,
+					  TEE_MEMORY_ACCESS_READ |
+					  TEE_MEMORY_ACCESS_ANY_OWNER,
+					  (uaddr_t)chunk, chunk_size);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	return tee_mmu_check_access_rights(utc,
+					   TEE_MEMORY_ACCESS_READ |
+					   TEE_MEMORY_ACCESS_WRITE |
+					   TEE_MEMORY_ACCESS_ANY_OWNER,
+					   (uaddr_t)hash, hash_len);
+}
+
 TEE_Result syscall_hash_final(unsigned long state, const void *chunk,
 			size_t chunk_size, void *hash, uint64_t *hash_len)
 {
 	TEE_Result res, res2;
-	size_t hash_size;
+	size_t hash_size = 0;
 	uint64_t hlen;
 	struct tee_cryp_state *cs;
 	struct tee_ta_session *sess;
 
-	/* No data, but size provided isn't valid parameters. */
-	if (!chunk && chunk_size)
-		return TEE_ERROR_BAD_PARAMETERS;
-
 	res = tee_ta_get_current_session(&sess);
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = tee_mmu_check_access_rights(to_user_ta_ctx(sess->ctx),
-					  TEE_MEMORY_ACCESS_READ |
-					  TEE_MEMORY_ACCESS_ANY_OWNER,
-					  (uaddr_t)chunk, chunk_size);
+	res = tee_svc_copy_from_user(&hlen, hash_len, sizeof(hlen));
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = tee_svc_copy_from_user(&hlen, hash_len, sizeof(hlen));
+	res = check_hash_buffers(to_user_ta_ctx(sess->ctx), chunk, chunk_size,
+				 hash, hlen);
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = tee_mmu_check_access_rights(to_user_ta_ctx(sess->ctx),
-					  TEE_MEMORY_ACCESS_READ |
-					  TEE_MEMORY_ACCESS_WRITE |
-					  TEE_MEMORY_ACCESS_ANY_OWNER,
-					  (uaddr_t)hash, hlen);
+	res = tee_svc_cryp_get_state(sess, tee_svc_uref_to_vaddr(state), &cs);
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = tee_svc_cryp_get_state(sess, tee_svc_uref_to_vaddr(state), &cs);
+	res = hash_final_state(cs, chunk, chunk_size, hash, hlen, &hash_size);
+	if (res != TEE_SUCCESS && res != TEE_ERROR_SHORT_BUFFER)
+		return res;
+
+	hlen = hash_size;
+	res2 = tee_svc_copy_to_user(hash_len, &hlen, sizeof(*hash_len));
+	if (res2 != TEE_SUCCESS)
+		return res2;
+	return res;
+}
+
+TEE_Result syscall_hash_final_batch(struct utee_hash_final_op *ops,
+				    size_t num_ops)
+{
+	TEE_Result res;
+	struct tee_ta_session *sess;
+	struct user_ta_ctx *utc;
+	struct utee_hash_final_op op;
+	struct tee_cryp_state *cs;
+	const void *chunk;
+	void *hash;
+	size_t hash_size;
+	size_t n;
+
+	res = tee_ta_get_current_session(&sess);
 	if (res != TEE_SUCCESS)
 		return res;
+	utc = to_user_ta_ctx(sess->ctx);
 
-	switch (TEE_ALG_GET_CLASS(cs->algo)) {
-	case TEE_OPERATION_DIGEST:
-		if (!crypto_ops.hash.update || !crypto_ops.hash.final)
-			return TEE_ERROR_NOT_IMPLEMENTED;
-		res = tee_hash_get_digest_size(cs->algo, &hash_size);
+	for (n = 0; n < num_ops; n++) {
+		res = tee_svc_copy_from_user(&op, ops + n, sizeof(op));
 		if (res != TEE_SUCCESS)
 			return res;
-		if (*hash_len < hash_size) {
-			res = TEE_ERROR_SHORT_BUFFER;
-			goto out;
-		}
 
-		if (chunk_size) {
-			res = crypto_ops.hash.update(cs->ctx, cs->algo, chunk,
-						     chunk_size);
-			if (res != TEE_SUCCESS)
-				return res;
-		}
-
-		res = crypto_ops.hash.final(cs->ctx, cs->algo, hash,
-					    hash_size);
+		chunk = (const void *)(vaddr_t)op.src;
+		hash = (void *)(vaddr_t)op.dst;
+		res = check_hash_buffers(utc, chunk, op.src_len, hash,
+					 op.dst_len);
 		if (res != TEE_SUCCESS)
 			return res;
-		break;
 
-	case TEE_OPERATION_MAC:
-		if (!crypto_ops.mac.update || !crypto_ops.mac.final)
-			return TEE_ERROR_NOT_IMPLEMENTED;
-		res = tee_mac_get_digest_size(cs->algo, &hash_size);
+		res = tee_svc_cryp_get_state(sess,
+					     tee_svc_uref_to_vaddr(op.state),
+					     &cs);
 		if (res != TEE_SUCCESS)
 			return res;
-		if (*hash_len < hash_size) {
-			res = TEE_ERROR_SHORT_BUFFER;
-			goto out;
-		}
 
-		if (chunk_size) {
-			res = crypto_ops.mac.update(cs->ctx, cs->algo, chunk,
-						    chunk_size);
+		hash_size = 0;
+		res = hash_final_state(cs, chunk, op.src_len, hash, op.dst_len,
+				       &hash_size);
+		if (res == TEE_SUCCESS) {
+			/* Ready for the next entry using the same state */
+			res = hash_init_state(utc, cs);
 			if (res != TEE_SUCCESS)
 				return res;
+		} else if (res != TEE_ERROR_SHORT_BUFFER) {
+			return res;
 		}
 
-		res = crypto_ops.mac.final(cs->ctx, cs->algo, hash, hash_size);
+		op.dst_len = hash_size;
+		op.res = res;
+		res = tee_svc_copy_to_user(ops + n, &op, sizeof(op));
 		if (res != TEE_SUCCESS)
 			return res;
-		break;
-
-	default:
-		return TEE_ERROR_BAD_PARAMETERS;
 	}
-out:
-	hlen = hash_size;
-	res2 = tee_svc_copy_to_user(hash_len, &hlen, sizeof(*hash_len));
-	if (res2 != TEE_SUCCESS)
-		return res2;
-	return res;
+
+	return TEE_SUCCESS;
 }
 
 TEE_Result syscall_cipher_init(unsigned long state, const void *iv,
@@ -2437,13 +2520,6 @@ static TEE_Result tee_svc_cipher_update_helper(unsigned long state,
 	if (res != TEE_SUCCESS)
 		return res;
 
-	res = tee_mmu_check_access_rights(to_user_ta_ctx(sess->ctx),
-					  TEE_MEMORY_ACCESS_READ |
-					  TEE_MEMORY_ACCESS_ANY_OWNER,
-					  (uaddr_t)src, src_len);
-	if (res != TEE_SUCCESS)
-		return res;
-
 	if (!dst_len) {
 		dlen = 0;
 	} else {
@@ -2460,6 +2536,16 @@ static TEE_Result tee_svc_cipher_update_helper(unsigned long state,
 			return res;
 	}
 
+	/* An in-place update is already covered by the check of dst above */
+	if (src != dst || src_len > dlen) {
+		res = tee_mmu_check_access_rights(to_user_ta_ctx(sess->ctx),
+						  TEE_MEMORY_ACCESS_READ |
+						  TEE_MEMORY_ACCESS_ANY_OWNER,
+						  (uaddr_t)src, src_len);
+		if (res != TEE_SUCCESS)
+			return res;
+	}
+
 	if (dlen < src_len) {
 		res = TEE_ERROR_SHORT_BUFFER;
 		goto out;
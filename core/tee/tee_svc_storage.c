@@ -93,9 +93,30 @@ struct tee_svc_storage_head {
 	uint32_t have_attrs;
 };
 
+/* Entry of the object index of a TA, see index_get() */
+struct index_entry {
+	uint32_t obj_id_len;
+	uint8_t obj_id[TEE_OBJECT_ID_MAX_LEN];
+	/* As in the head of the object, only valid with INDEX_INFO_VALID */
+	uint32_t flags;
+	uint32_t data_size;
+	uint32_t keySize;
+	uint32_t maxKeySize;
+	uint32_t objectUsage;
+	uint32_t objectType;
+	uint32_t have_attrs;
+};
+
+/*
+ * An enumeration either walks a snapshot of the object index (entries)
+ * or, for storage without an index, the directory of the TA (dir).
+ */
 struct tee_storage_enum {
 	TAILQ_ENTRY(tee_storage_enum) link;
 	struct tee_fs_dir *dir;
+	struct index_entry *entries;
+	size_t num_entries;
+	size_t pos;
 	const struct tee_file_operations *fops;
 };
 
@@ -105,6 +126,943 @@ struct tee_storage_enum {
  */
 static struct mutex ta_dir_mutex = MUTEX_INITIALIZER;
 
+/*
+ * Cache of the heads and decoded attributes of recently opened persistent
+ * objects, most recently used first. At most
+ * CFG_TEE_STORAGE_HEAD_CACHE_SIZE entries are kept per TA and
+ * CFG_TEE_STORAGE_HEAD_CACHE_TOTAL in all, and the entries of a TA are
+ * flushed when its last instance is destroyed.
+ *
+ * An entry is removed once its object has been written, renamed, replaced
+ * or deleted. Each removal also increases head_cache_gen, a head read
+ * from storage is only added if head_cache_gen is unchanged since the
+ * lookup which missed. This way a head read by one instance of a TA
+ * while another instance updates the object is never cached.
+ */
+struct head_cache_entry {
+	TAILQ_ENTRY(head_cache_entry) link;
+	TEE_UUID uuid;
+	const struct tee_file_operations *fops;
+	uint8_t obj_id[TEE_OBJECT_ID_MAX_LEN];
+	uint32_t obj_id_len;
+	struct tee_svc_storage_head head;
+	struct tee_obj *o;
+};
+
+static TAILQ_HEAD(head_cache_head, head_cache_entry) head_cache =
+	TAILQ_HEAD_INITIALIZER(head_cache);
+static uint32_t head_cache_gen;
+static struct mutex head_cache_mutex = MUTEX_INITIALIZER;
+
+static struct head_cache_entry *head_cache_find(const TEE_UUID *uuid,
+				const struct tee_file_operations *fops,
+				const void *obj_id, uint32_t obj_id_len)
+{
+	struct head_cache_entry *e;
+
+	TAILQ_FOREACH(e, &head_cache, link)
+		if (e->fops == fops && e->obj_id_len == obj_id_len &&
+		    !memcmp(&e->uuid, uuid, sizeof(TEE_UUID)) &&
+		    !memcmp(e->obj_id, obj_id, obj_id_len))
+			return e;
+	return NULL;
+}
+
+static void head_cache_free(struct head_cache_entry *e)
+{
+	tee_obj_attr_clear(e->o);
+	tee_obj_free(e->o);
+	free(e);
+}
+
+static void head_cache_remove(const TEE_UUID *uuid,
+			      const struct tee_file_operations *fops,
+			      const void *obj_id, uint32_t obj_id_len)
+{
+	struct head_cache_entry *e;
+
+	mutex_lock(&head_cache_mutex);
+	head_cache_gen++;
+	e = head_cache_find(uuid, fops, obj_id, obj_id_len);
+	if (e)
+		TAILQ_REMOVE(&head_cache, e, link);
+	mutex_unlock(&head_cache_mutex);
+
+	if (e)
+		head_cache_free(e);
+}
+
+/*
+ * Sets the type and attributes of o from the cache if found, else returns
+ * in gen what's to be passed to head_cache_add().
+ */
+static TEE_Result head_cache_get(const TEE_UUID *uuid, struct tee_obj *o,
+				 struct tee_svc_storage_head *head,
+				 uint32_t *gen)
+{
+	TEE_Result res = TEE_ERROR_ITEM_NOT_FOUND;
+	struct head_cache_entry *e;
+
+	mutex_lock(&head_cache_mutex);
+	*gen = head_cache_gen;
+	e = head_cache_find(uuid, o->pobj->fops, o->pobj->obj_id,
+			    o->pobj->obj_id_len);
+	if (!e)
+		goto out;
+
+	res = tee_obj_set_type(o, e->head.objectType, e->head.maxKeySize);
+	if (res != TEE_SUCCESS)
+		goto out;
+	res = tee_obj_attr_copy_from(o, e->o);
+	if (res != TEE_SUCCESS) {
+		tee_obj_attr_free(o);
+		free(o->attr);
+		o->attr = NULL;
+		goto out;
+	}
+
+	*head = e->head;
+	TAILQ_REMOVE(&head_cache, e, link);
+	TAILQ_INSERT_HEAD(&head_cache, e, link);
+out:
+	mutex_unlock(&head_cache_mutex);
+	return res;
+}
+
+/* Adds the head and attributes of o, any failure just leaves it out */
+static void head_cache_add(const TEE_UUID *uuid, struct tee_obj *o,
+			   const struct tee_svc_storage_head *head,
+			   uint32_t gen)
+{
+	struct head_cache_entry *e;
+	struct head_cache_entry *lru = NULL;
+	struct head_cache_entry *ta_lru = NULL;
+	size_t count = 0;
+	size_t ta_count = 0;
+
+	if (!CFG_TEE_STORAGE_HEAD_CACHE_SIZE)
+		return;
+
+	e = calloc(1, sizeof(*e));
+	if (!e)
+		return;
+	e->o = tee_obj_alloc();
+	if (!e->o)
+		goto err;
+	if (tee_obj_set_type(e->o, head->objectType, head->maxKeySize) !=
+	    TEE_SUCCESS)
+		goto err;
+	if (tee_obj_attr_copy_from(e->o, o) != TEE_SUCCESS)
+		goto err;
+
+	e->uuid = *uuid;
+	e->fops = o->pobj->fops;
+	memcpy(e->obj_id, o->pobj->obj_id, o->pobj->obj_id_len);
+	e->obj_id_len = o->pobj->obj_id_len;
+	e->head = *head;
+
+	mutex_lock(&head_cache_mutex);
+	/*
+	 * The head may be outdated if an object was updated since the
+	 * lookup, or another thread may have added the object already.
+	 */
+	if (gen != head_cache_gen ||
+	    head_cache_find(uuid, e->fops, e->obj_id, e->obj_id_len)) {
+		mutex_unlock(&head_cache_mutex);
+		goto err;
+	}
+	TAILQ_INSERT_HEAD(&head_cache, e, link);
+	TAILQ_FOREACH(e, &head_cache, link) {
+		count++;
+		lru = e;
+		if (!memcmp(&e->uuid, uuid, sizeof(TEE_UUID))) {
+			ta_count++;
+			ta_lru = e;
+		}
+	}
+	if (ta_count > CFG_TEE_STORAGE_HEAD_CACHE_SIZE)
+		lru = ta_lru;
+	else if (count <= CFG_TEE_STORAGE_HEAD_CACHE_TOTAL)
+		lru = NULL;
+	if (lru)
+		TAILQ_REMOVE(&head_cache, lru, link);
+	mutex_unlock(&head_cache_mutex);
+
+	if (lru)
+		head_cache_free(lru);
+	return;
+err:
+	if (e->o)
+		head_cache_free(e);
+	else
+		free(e);
+}
+
+void tee_svc_storage_flush_cache(const TEE_UUID *uuid)
+{
+	struct head_cache_entry *e;
+	struct head_cache_entry *next;
+	struct head_cache_head flushed = TAILQ_HEAD_INITIALIZER(flushed);
+
+	mutex_lock(&head_cache_mutex);
+	TAILQ_FOREACH_SAFE(e, &head_cache, link, next) {
+		if (!memcmp(&e->uuid, uuid, sizeof(TEE_UUID))) {
+			TAILQ_REMOVE(&head_cache, e, link);
+			TAILQ_INSERT_TAIL(&flushed, e, link);
+		}
+	}
+	mutex_unlock(&head_cache_mutex);
+
+	while ((e = TAILQ_FIRST(&flushed))) {
+		TAILQ_REMOVE(&flushed, e, link);
+		head_cache_free(e);
+	}
+}
+
+/*
+ * The object index of a TA holds the ID and the TEE_ObjectInfo of each
+ * persistent object of the TA, stored as a struct index_head followed by
+ * an array of struct index_entry in the file "/TA_uuid/index" of the same
+ * storage. It's updated when objects are created, renamed and deleted, so
+ * enumerating the objects needs neither to read the directory nor to open
+ * the objects.
+ *
+ * An update of the directory is bracketed by index_begin_update() and
+ * index_end_update(). The first marks the index as dirty in its head
+ * unless it already is, and the second writes the updated entries. The
+ * mark is only cleared when an enumeration starts, see index_clean(), so
+ * a series of updates writes the index once per update. An index found
+ * dirty when read, for instance after a power loss in the middle of an
+ * update, is reconciled with the directory: the entries of the objects
+ * still present are kept and the others dropped or added. An index which
+ * is missing or can't be read is rebuilt from the directory. If an update
+ * of the index fails the index is removed to be rebuilt at next use. The
+ * most recently used indexes are kept in memory.
+ *
+ * The data size is the only part of the TEE_ObjectInfo which changes
+ * after creation. Rewriting the index with each write growing an object
+ * would double the cost of appending, so instead the first such write
+ * clears INDEX_INFO_VALID of the entry on disk, see
+ * index_begin_data_update(), and the size is then only tracked in memory
+ * (data_sizes). The next write of the entry, by any update of the index,
+ * stores the size and sets the flag again. Entries without the flag have
+ * their object opened once when enumerated.
+ */
+#define INDEX_NAME		"index"
+#define INDEX_MAGIC		0x32786449 /* "Idx2" */
+#define INDEX_CACHE_MAX		4
+#define INDEX_INFO_VALID	BIT32(0)
+#define INDEX_SIZE_UNKNOWN	UINT32_MAX
+
+struct index_head {
+	uint32_t magic;
+	/* Non-zero while an update of the directory may be missing */
+	uint32_t dirty;
+};
+
+struct obj_index {
+	TAILQ_ENTRY(obj_index) link;
+	TEE_UUID uuid;
+	const struct tee_file_operations *fops;
+	/* Identifies this instance in index_end_update() */
+	uint32_t gen;
+	/* Number of updates between index_begin/end_update() */
+	size_t pending;
+	/* Value of dirty in the head of the file */
+	bool dirty;
+	bool have_file;
+	struct index_entry *entries;
+	/* Data size of each entry, INDEX_SIZE_UNKNOWN if not known */
+	uint32_t *data_sizes;
+	size_t num_entries;
+};
+
+static TAILQ_HEAD(obj_index_head, obj_index) obj_indexes =
+	TAILQ_HEAD_INITIALIZER(obj_indexes);
+static uint32_t index_gen;
+/* Incremented each time a data size is invalidated */
+static uint32_t index_data_gen;
+static struct mutex index_mutex = MUTEX_INITIALIZER;
+
+static TEE_Result tee_svc_storage_read_head(struct tee_ta_session *sess,
+					    struct tee_obj *o);
+
+static bool use_index(const struct tee_file_operations *fops __maybe_unused)
+{
+#ifdef CFG_RPMB_FS
+	/*
+	 * The directory of the RPMB FS is read from its FAT in secure
+	 * memory, an index would only add RPMB writes.
+	 */
+	if (fops == &rpmb_fs_ops)
+		return false;
+#endif
+	return true;
+}
+
+/* "/TA_uuid/index" */
+static char *index_filename(struct tee_ta_session *sess)
+{
+	char *dir = tee_svc_storage_create_dirname(sess);
+	size_t len;
+	char *file;
+
+	if (!dir)
+		return NULL;
+
+	len = strlen(dir);
+	file = malloc(len + 1 + sizeof(INDEX_NAME));
+	if (file) {
+		memcpy(file, dir, len);
+		file[len] = '/';
+		memcpy(file + len + 1, INDEX_NAME, sizeof(INDEX_NAME));
+	}
+	free(dir);
+	return file;
+}
+
+static void index_free(struct obj_index *idx)
+{
+	free(idx->entries);
+	free(idx->data_sizes);
+	free(idx);
+}
+
+static struct obj_index *index_find_cached(struct tee_ta_session *sess,
+				const struct tee_file_operations *fops)
+{
+	struct obj_index *idx;
+
+	TAILQ_FOREACH(idx, &obj_indexes, link)
+		if (idx->fops == fops &&
+		    !memcmp(&idx->uuid, &sess->ctx->uuid, sizeof(TEE_UUID)))
+			return idx;
+	return NULL;
+}
+
+static struct index_entry *index_find(struct obj_index *idx,
+				      const void *obj_id, uint32_t obj_id_len)
+{
+	size_t n;
+
+	for (n = 0; n < idx->num_entries; n++)
+		if (idx->entries[n].obj_id_len == obj_id_len &&
+		    !memcmp(idx->entries[n].obj_id, obj_id, obj_id_len))
+			return idx->entries + n;
+	return NULL;
+}
+
+static TEE_Result index_add_entry(struct obj_index *idx, const void *obj_id,
+				  uint32_t obj_id_len)
+{
+	struct index_entry *entries;
+	struct index_entry *ie;
+	uint32_t *data_sizes;
+
+	if (obj_id_len > TEE_OBJECT_ID_MAX_LEN)
+		return TEE_ERROR_BAD_PARAMETERS;
+
+	entries = realloc(idx->entries,
+			  (idx->num_entries + 1) * sizeof(*entries));
+	if (!entries)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	idx->entries = entries;
+	data_sizes = realloc(idx->data_sizes,
+			     (idx->num_entries + 1) * sizeof(*data_sizes));
+	if (!data_sizes)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	idx->data_sizes = data_sizes;
+
+	ie = entries + idx->num_entries;
+	memset(ie, 0, sizeof(*ie));
+	ie->obj_id_len = obj_id_len;
+	memcpy(ie->obj_id, obj_id, obj_id_len);
+	data_sizes[idx->num_entries] = INDEX_SIZE_UNKNOWN;
+	idx->num_entries++;
+	return TEE_SUCCESS;
+}
+
+/* Copies the part of the TEE_ObjectInfo of o which doesn't change */
+static void index_set_info(struct index_entry *ie, const struct tee_obj *o)
+{
+	ie->keySize = o->info.keySize;
+	ie->maxKeySize = o->info.maxKeySize;
+	ie->objectUsage = o->info.objectUsage;
+	ie->objectType = o->info.objectType;
+	ie->have_attrs = o->have_attrs;
+}
+
+/*
+ * Writes the sizes known in memory to the entries from first, which are
+ * about to be written.
+ */
+static void index_store_data_sizes(struct obj_index *idx, size_t first)
+{
+	size_t n;
+
+	for (n = first; n < idx->num_entries; n++) {
+		if (idx->data_sizes[n] == INDEX_SIZE_UNKNOWN) {
+			idx->entries[n].flags &= ~INDEX_INFO_VALID;
+		} else {
+			idx->entries[n].data_size = idx->data_sizes[n];
+			idx->entries[n].flags |= INDEX_INFO_VALID;
+		}
+	}
+}
+
+/* Writes the head and the entries from first to the end of the index */
+static TEE_Result index_write(struct tee_ta_session *sess,
+			      struct obj_index *idx, size_t first)
+{
+	TEE_Result res;
+	TEE_Result res2;
+	const struct tee_file_operations *fops = idx->fops;
+	struct tee_file_handle *fh = NULL;
+	struct index_head head = {
+		.magic = INDEX_MAGIC,
+		.dirty = idx->dirty,
+	};
+	char *file = index_filename(sess);
+
+	if (!file)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	if (idx->have_file) {
+		res = fops->open(file, &fh);
+	} else {
+		mutex_lock(&ta_dir_mutex);
+		res = fops->create(file, &fh);
+		mutex_unlock(&ta_dir_mutex);
+		first = 0;
+	}
+	if (res != TEE_SUCCESS)
+		goto out;
+	idx->have_file = true;
+	index_store_data_sizes(idx, first);
+
+	if (fops->begin_transaction) {
+		res = fops->begin_transaction(fh);
+		if (res != TEE_SUCCESS)
+			goto out;
+	}
+
+	res = fops->write(fh, &head, sizeof(head));
+	if (res != TEE_SUCCESS)
+		goto end_transaction;
+	res = fops->seek(fh, sizeof(head) + first * sizeof(struct index_entry),
+			 TEE_DATA_SEEK_SET, NULL);
+	if (res != TEE_SUCCESS)
+		goto end_transaction;
+	if (first < idx->num_entries) {
+		res = fops->write(fh, idx->entries + first,
+				  (idx->num_entries - first) *
+				  sizeof(struct index_entry));
+		if (res != TEE_SUCCESS)
+			goto end_transaction;
+	}
+	res = fops->truncate(fh, sizeof(head) +
+			     idx->num_entries * sizeof(struct index_entry));
+
+end_transaction:
+	if (fops->end_transaction) {
+		res2 = fops->end_transaction(fh, res == TEE_SUCCESS);
+		if (res == TEE_SUCCESS)
+			res = res2;
+	}
+out:
+	fops->close(&fh);
+	free(file);
+	return res;
+}
+
+/*
+ * Adds the objects found in the directory of the TA, with the info of
+ * their entry in old if any. The info of the others is read when they're
+ * first enumerated.
+ */
+static TEE_Result index_rebuild(struct tee_ta_session *sess,
+				struct obj_index *idx, struct obj_index *old)
+{
+	TEE_Result res;
+	const struct tee_file_operations *fops = idx->fops;
+	struct tee_fs_dir *dir = NULL;
+	struct tee_fs_dirent *d;
+	struct index_entry *ie;
+	uint8_t obj_id[TEE_OBJECT_ID_MAX_LEN];
+	char *dirname = tee_svc_storage_create_dirname(sess);
+	size_t hslen;
+	size_t n;
+
+	if (!dirname)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	res = fops->opendir(dirname, &dir);
+	free(dirname);
+	if (res == TEE_ERROR_ITEM_NOT_FOUND)
+		return TEE_SUCCESS; /* No objects yet */
+	if (res != TEE_SUCCESS)
+		return res;
+
+	while (true) {
+		res = fops->readdir(dir, &d);
+		if (res == TEE_ERROR_ITEM_NOT_FOUND)
+			break;
+		if (res != TEE_SUCCESS)
+			goto out;
+
+		/* Skip the index and uncommitted objects */
+		hslen = strlen(d->d_name);
+		if (!strcmp(d->d_name, INDEX_NAME) || d->d_name[0] == '.' ||
+		    TEE_HS2B_BBUF_SIZE(hslen) > sizeof(obj_id))
+			continue;
+
+		tee_hs2b((uint8_t *)d->d_name, obj_id, hslen,
+			 TEE_HS2B_BBUF_SIZE(hslen));
+		res = index_add_entry(idx, obj_id, TEE_HS2B_BBUF_SIZE(hslen));
+		if (res != TEE_SUCCESS)
+			goto out;
+
+		ie = old ? index_find(old, obj_id, TEE_HS2B_BBUF_SIZE(hslen)) :
+			   NULL;
+		if (ie) {
+			n = idx->num_entries - 1;
+			idx->entries[n] = *ie;
+			idx->data_sizes[n] = old->data_sizes[ie - old->entries];
+		}
+	}
+
+	res = index_write(sess, idx, 0);
+out:
+	fops->closedir(dir);
+	return res;
+}
+
+static TEE_Result index_read(struct tee_ta_session *sess,
+			     struct obj_index *idx)
+{
+	TEE_Result res;
+	const struct tee_file_operations *fops = idx->fops;
+	struct tee_file_handle *fh = NULL;
+	struct index_head head;
+	char *file = index_filename(sess);
+	int32_t len;
+	size_t bytes;
+	size_t n;
+
+	if (!file)
+		return TEE_ERROR_OUT_OF_MEMORY;
+
+	res = fops->open(file, &fh);
+	if (res != TEE_SUCCESS)
+		goto out;
+	idx->have_file = true;
+
+	bytes = sizeof(head);
+	res = fops->read(fh, &head, &bytes);
+	if (res != TEE_SUCCESS)
+		goto out;
+	if (bytes != sizeof(head) || head.magic != INDEX_MAGIC) {
+		res = TEE_ERROR_CORRUPT_OBJECT;
+		goto out;
+	}
+	idx->dirty = head.dirty;
+
+	res = fops->seek(fh, 0, TEE_DATA_SEEK_END, &len);
+	if (res != TEE_SUCCESS)
+		goto out;
+	len -= sizeof(head);
+	if (len % sizeof(struct index_entry)) {
+		res = TEE_ERROR_CORRUPT_OBJECT;
+		goto out;
+	}
+	res = fops->seek(fh, sizeof(head), TEE_DATA_SEEK_SET, NULL);
+	if (res != TEE_SUCCESS || !len)
+		goto out;
+
+	idx->entries = malloc(len);
+	idx->data_sizes = malloc(len / sizeof(struct index_entry) *
+				 sizeof(uint32_t));
+	if (!idx->entries || !idx->data_sizes) {
+		res = TEE_ERROR_OUT_OF_MEMORY;
+		goto out;
+	}
+	bytes = len;
+	res = fops->read(fh, idx->entries, &bytes);
+	if (res == TEE_SUCCESS && bytes != (size_t)len)
+		res = TEE_ERROR_CORRUPT_OBJECT;
+	if (res != TEE_SUCCESS)
+		goto out;
+
+	idx->num_entries = bytes / sizeof(struct index_entry);
+	for (n = 0; n < idx->num_entries; n++) {
+		if (idx->entries[n].flags & INDEX_INFO_VALID)
+			idx->data_sizes[n] = idx->entries[n].data_size;
+		else
+			idx->data_sizes[n] = INDEX_SIZE_UNKNOWN;
+	}
+out:
+	fops->close(&fh);
+	free(file);
+	return res;
+}
+
+/* Forgets the index to have it rebuilt at next use */
+static void index_drop(struct tee_ta_session *sess,
+		       const struct tee_file_operations *fops)
+{
+	struct obj_index *idx = index_find_cached(sess, fops);
+	char *file;
+
+	if (idx) {
+		TAILQ_REMOVE(&obj_indexes, idx, link);
+		index_free(idx);
+	}
+	file = index_filename(sess);
+	if (file)
+		fops->remove(file);
+	free(file);
+}
+
+/*
+ * Returns the index of the TA of the session in the storage of fops,
+ * reading or rebuilding it if needed. Must be called with index_mutex
+ * held.
+ */
+static TEE_Result index_get(struct tee_ta_session *sess,
+			    const struct tee_file_operations *fops,
+			    struct obj_index **ret)
+{
+	TEE_Result res;
+	struct obj_index *idx;
+	struct obj_index *lru = NULL;
+	struct obj_index old;
+	size_t count = 0;
+	char *file;
+
+	idx = index_find_cached(sess, fops);
+	if (idx) {
+		TAILQ_REMOVE(&obj_indexes, idx, link);
+		TAILQ_INSERT_HEAD(&obj_indexes, idx, link);
+		*ret = idx;
+		return TEE_SUCCESS;
+	}
+
+	idx = calloc(1, sizeof(*idx));
+	if (!idx)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	idx->uuid = sess->ctx->uuid;
+	idx->fops = fops;
+	index_gen++;
+	if (!index_gen)
+		index_gen++;
+	idx->gen = index_gen;
+
+	res = index_read(sess, idx);
+	if (res != TEE_SUCCESS) {
+		if (res != TEE_ERROR_ITEM_NOT_FOUND) {
+			EMSG("Object index unreadable (0x%x), rebuilding",
+			     res);
+			file = index_filename(sess);
+			if (file)
+				fops->remove(file);
+			free(file);
+		}
+		free(idx->entries);
+		idx->entries = NULL;
+		free(idx->data_sizes);
+		idx->data_sizes = NULL;
+		idx->num_entries = 0;
+		idx->have_file = false;
+		idx->dirty = false;
+		res = index_rebuild(sess, idx, NULL);
+	} else if (idx->dirty) {
+		/* Some updates of the directory may be missing */
+		old = *idx;
+		idx->entries = NULL;
+		idx->data_sizes = NULL;
+		idx->num_entries = 0;
+		idx->dirty = false;
+		res = index_rebuild(sess, idx, &old);
+		free(old.entries);
+		free(old.data_sizes);
+	}
+	if (res != TEE_SUCCESS) {
+		index_free(idx);
+		return res;
+	}
+
+	TAILQ_INSERT_HEAD(&obj_indexes, idx, link);
+	TAILQ_FOREACH(idx, &obj_indexes, link) {
+		count++;
+		/* An index with pending updates can't be evicted */
+		if (!idx->pending)
+			lru = idx;
+	}
+	if (count > INDEX_CACHE_MAX && lru &&
+	    lru != TAILQ_FIRST(&obj_indexes)) {
+		TAILQ_REMOVE(&obj_indexes, lru, link);
+		index_free(lru);
+	}
+
+	*ret = TAILQ_FIRST(&obj_indexes);
+	return TEE_SUCCESS;
+}
+
+/*
+ * Called before an object of the TA is created, renamed or deleted, with
+ * the ID of the object created if any as it may overwrite one. Returns in
+ * gen what's to be passed to index_end_update(), 0 if the index is
+ * unavailable.
+ */
+static void index_begin_update(struct tee_ta_session *sess,
+			       const struct tee_file_operations *fops,
+			       const void *new_id, uint32_t new_id_len,
+			       uint32_t *gen)
+{
+	TEE_Result res;
+	struct obj_index *idx;
+	struct index_entry *ie;
+	size_t first;
+
+	*gen = 0;
+	if (!use_index(fops))
+		return;
+
+	mutex_lock(&index_mutex);
+
+	res = index_get(sess, fops, &idx);
+	if (res == TEE_SUCCESS) {
+		idx->pending++;
+		/*
+		 * index_rebuild() keeps the entries of the objects found
+		 * in the directory, so if the end of the update is lost
+		 * the entry of an overwritten object mustn't hold its info.
+		 */
+		first = idx->num_entries;
+		ie = new_id ? index_find(idx, new_id, new_id_len) : NULL;
+		if (ie && (ie->flags & INDEX_INFO_VALID)) {
+			first = ie - idx->entries;
+			idx->data_sizes[first] = INDEX_SIZE_UNKNOWN;
+		}
+		if (!idx->dirty || first < idx->num_entries) {
+			idx->dirty = true;
+			res = index_write(sess, idx, first);
+		}
+		if (res == TEE_SUCCESS)
+			*gen = idx->gen;
+	}
+	if (res != TEE_SUCCESS) {
+		EMSG("Failed to update object index (0x%x)", res);
+		index_drop(sess, fops);
+	}
+
+	mutex_unlock(&index_mutex);
+}
+
+/*
+ * Called when the update started with index_begin_update() is done:
+ * removes the entry of old_id and adds one for new_id, either of them may
+ * be NULL. The info of new_id is taken from new_o when the object was
+ * created, else from the entry of old_id.
+ */
+static void index_end_update(struct tee_ta_session *sess,
+			     const struct tee_file_operations *fops,
+			     uint32_t gen, const void *old_id,
+			     uint32_t old_id_len, const void *new_id,
+			     uint32_t new_id_len, const struct tee_obj *new_o)
+{
+	TEE_Result res = TEE_SUCCESS;
+	struct obj_index *idx;
+	struct index_entry *ie;
+	struct index_entry old_ie;
+	uint32_t old_data_size = INDEX_SIZE_UNKNOWN;
+	bool have_old = false;
+	size_t first;
+	size_t n;
+	bool changed = false;
+
+	if (!gen)
+		return;
+
+	mutex_lock(&index_mutex);
+
+	/* Nothing to do if the index was dropped in the meantime */
+	idx = index_find_cached(sess, fops);
+	if (!idx || idx->gen != gen)
+		goto out;
+
+	first = idx->num_entries;
+	ie = old_id ? index_find(idx, old_id, old_id_len) : NULL;
+	if (ie) {
+		old_ie = *ie;
+		have_old = true;
+		/* Move the last entry into the hole */
+		first = ie - idx->entries;
+		old_data_size = idx->data_sizes[first];
+		idx->num_entries--;
+		*ie = idx->entries[idx->num_entries];
+		idx->data_sizes[first] = idx->data_sizes[idx->num_entries];
+		changed = true;
+	}
+	if (new_id) {
+		ie = index_find(idx, new_id, new_id_len);
+		if (!ie) {
+			res = index_add_entry(idx, new_id, new_id_len);
+			if (res != TEE_SUCCESS)
+				goto out;
+			ie = idx->entries + idx->num_entries - 1;
+		}
+		n = ie - idx->entries;
+		first = MIN(first, n);
+		changed = true;
+		if (new_o) {
+			index_set_info(ie, new_o);
+			idx->data_sizes[n] = new_o->info.dataSize;
+		} else if (have_old) {
+			/* Renamed, keep the info under the new ID */
+			old_ie.obj_id_len = ie->obj_id_len;
+			memcpy(old_ie.obj_id, ie->obj_id, sizeof(ie->obj_id));
+			*ie = old_ie;
+			idx->data_sizes[n] = old_data_size;
+		}
+	}
+
+	idx->pending--;
+	if (changed)
+		res = index_write(sess, idx, first);
+out:
+	if (res != TEE_SUCCESS) {
+		EMSG("Failed to update object index (0x%x)", res);
+		index_drop(sess, fops);
+	}
+	mutex_unlock(&index_mutex);
+}
+
+/*
+ * Clears the dirty mark of the index once no update is pending, so that
+ * it isn't reconciled with the directory when read again. Must be called
+ * with index_mutex held.
+ */
+static TEE_Result index_clean(struct tee_ta_session *sess,
+			      struct obj_index *idx)
+{
+	if (!idx->dirty || idx->pending)
+		return TEE_SUCCESS;
+	idx->dirty = false;
+	return index_write(sess, idx, idx->num_entries);
+}
+
+/* Must be called with index_mutex held */
+static void index_set_obj_info_locked(struct tee_ta_session *sess,
+				      const struct tee_obj *o)
+{
+	struct obj_index *idx = index_find_cached(sess, o->pobj->fops);
+	struct index_entry *ie;
+
+	/* The object may be being overwritten */
+	if (!idx || idx->pending)
+		return;
+	ie = index_find(idx, o->pobj->obj_id, o->pobj->obj_id_len);
+	if (!ie)
+		return;
+	index_set_info(ie, o);
+	idx->data_sizes[ie - idx->entries] = o->info.dataSize;
+}
+
+/*
+ * Returns what's to be passed to index_set_obj_info() once the head of an
+ * object has been read.
+ */
+static uint32_t index_get_data_gen(void)
+{
+	uint32_t gen;
+
+	mutex_lock(&index_mutex);
+	gen = index_data_gen;
+	mutex_unlock(&index_mutex);
+	return gen;
+}
+
+/*
+ * Records the info of o read from its head, unless a data size was
+ * invalidated since gen was returned by index_get_data_gen() as the head
+ * may then be outdated.
+ */
+static void index_set_obj_info(struct tee_ta_session *sess,
+			       const struct tee_obj *o, uint32_t gen)
+{
+	if (!use_index(o->pobj->fops))
+		return;
+
+	mutex_lock(&index_mutex);
+	if (gen == index_data_gen)
+		index_set_obj_info_locked(sess, o);
+	mutex_unlock(&index_mutex);
+}
+
+/*
+ * Called before a write which may grow the data of o. The data size is
+ * forgotten, and if the entry on disk holds it INDEX_INFO_VALID is
+ * cleared there first so the index never holds an outdated size. Returns
+ * what's to be passed to index_end_data_update().
+ */
+static uint32_t index_begin_data_update(struct tee_ta_session *sess,
+					const struct tee_obj *o)
+{
+	TEE_Result res;
+	const struct tee_file_operations *fops = o->pobj->fops;
+	struct obj_index *idx;
+	struct index_entry *ie;
+	uint32_t gen;
+	size_t n;
+
+	if (!use_index(fops))
+		return 0;
+
+	mutex_lock(&index_mutex);
+
+	index_data_gen++;
+	gen = index_data_gen;
+
+	res = index_get(sess, fops, &idx);
+	if (res == TEE_SUCCESS) {
+		ie = index_find(idx, o->pobj->obj_id, o->pobj->obj_id_len);
+		if (ie) {
+			n = ie - idx->entries;
+			idx->data_sizes[n] = INDEX_SIZE_UNKNOWN;
+			if (ie->flags & INDEX_INFO_VALID)
+				res = index_write(sess, idx, n);
+		}
+	}
+	if (res != TEE_SUCCESS) {
+		EMSG("Failed to update object index (0x%x)", res);
+		index_drop(sess, fops);
+	}
+
+	mutex_unlock(&index_mutex);
+	return gen;
+}
+
+/*
+ * Called when the write started with index_begin_data_update() is done,
+ * records the new data size if committed and no other write started
+ * meanwhile. Heads read before the commit are outdated, so the data size
+ * isn't taken from them.
+ */
+static void index_end_data_update(struct tee_ta_session *sess,
+				  const struct tee_obj *o, uint32_t gen,
+				  bool committed)
+{
+	if (!use_index(o->pobj->fops))
+		return;
+
+	mutex_lock(&index_mutex);
+	if (committed && gen == index_data_gen)
+		index_set_obj_info_locked(sess, o);
+	index_data_gen++;
+	mutex_unlock(&index_mutex);
+}
+
 static TEE_Result tee_svc_storage_get_enum(struct user_ta_ctx *utc,
 					   uint32_t enum_id,
 					   struct tee_storage_enum **e_out)
@@ -128,12 +1086,13 @@ static TEE_Result tee_svc_close_enum(struct user_ta_ctx *utc,
 
 	TAILQ_REMOVE(&utc->storage_enums, e, link);
 
-	if (e->fops)
+	if (e->fops && e->dir)
 		e->fops->closedir(e->dir);
 
 	e->dir = NULL;
 	e->fops = NULL;
 
+	free(e->entries);
 	free(e);
 
 	return TEE_SUCCESS;
@@ -196,6 +1155,9 @@ static TEE_Result tee_svc_storage_remove_corrupt_obj(
 	TEE_Result res;
 	char *file = NULL;
 	const struct tee_file_operations *fops = o->pobj->fops;
+	uint8_t obj_id[TEE_OBJECT_ID_MAX_LEN];
+	uint32_t obj_id_len = o->pobj->obj_id_len;
+	uint32_t gen;
 
 	file = tee_svc_storage_create_filename(sess,
 					       o->pobj->obj_id,
@@ -206,8 +1168,15 @@ static TEE_Result tee_svc_storage_remove_corrupt_obj(
 		goto exit;
 	}
 
+	memcpy(obj_id, o->pobj->obj_id, obj_id_len);
 	tee_obj_close(to_user_ta_ctx(sess->ctx), o);
-	fops->remove(file);
+	index_begin_update(sess, fops, NULL, 0, &gen);
+	if (fops->remove(file) == TEE_SUCCESS)
+		index_end_update(sess, fops, gen, obj_id, obj_id_len, NULL, 0,
+				 NULL);
+	else
+		index_end_update(sess, fops, gen, NULL, 0, NULL, 0, NULL);
+	head_cache_remove(&sess->ctx->uuid, fops, obj_id, obj_id_len);
 	free(file);
 
 	res = TEE_SUCCESS;
@@ -225,6 +1194,7 @@ static TEE_Result tee_svc_storage_read_head(struct tee_ta_session *sess,
 	char *file = NULL;
 	const struct tee_file_operations *fops;
 	void *attr = NULL;
+	uint32_t gen;
 
 	if (o == NULL || o->pobj == NULL)
 		return TEE_ERROR_BAD_PARAMETERS;
@@ -245,6 +1215,10 @@ static TEE_Result tee_svc_storage_read_head(struct tee_ta_session *sess,
 	if (res != TEE_SUCCESS)
 		goto exit;
 
+	/* The file is still opened above as the data stream is read from it */
+	if (head_cache_get(&sess->ctx->uuid, o, &head, &gen) == TEE_SUCCESS)
+		goto set_info;
+
 	/* read head */
 	bytes = sizeof(struct tee_svc_storage_head);
 	res = fops->read(o->fh, &head, &bytes);
@@ -283,6 +1257,9 @@ static TEE_Result tee_svc_storage_read_head(struct tee_ta_session *sess,
 	if (res != TEE_SUCCESS)
 		goto exit;
 
+	head_cache_add(&sess->ctx->uuid, o, &head, gen);
+
+set_info:
 	o->info.dataSize = head.ds_size;
 	o->info.keySize = head.keySize;
 	o->info.objectUsage = head.objectUsage;
@@ -331,6 +1308,7 @@ static TEE_Result tee_svc_storage_init_file(struct tee_ta_session *sess,
 					    uint32_t len)
 {
 	TEE_Result res = TEE_SUCCESS;
+	TEE_Result res2;
 	struct tee_svc_storage_head head;
 	char *tmpfile = NULL;
 	const struct tee_file_operations *fops;
@@ -400,15 +1378,22 @@ static TEE_Result tee_svc_storage_init_file(struct tee_ta_session *sess,
 	head.objectType = o->info.objectType;
 	head.have_attrs = o->have_attrs;
 
+	/* Commit head, meta and init data together if supported */
+	if (fops->begin_transaction) {
+		res = fops->begin_transaction(o->fh);
+		if (res != TEE_SUCCESS)
+			goto exit;
+	}
+
 	/* write head */
 	res = fops->write(o->fh, &head, sizeof(struct tee_svc_storage_head));
 	if (res != TEE_SUCCESS)
-		goto exit;
+		goto end_transaction;
 
 	/* write meta */
 	res = fops->write(o->fh, attr, attr_size);
 	if (res != TEE_SUCCESS)
-		goto exit;
+		goto end_transaction;
 
 	/* write init data */
 	o->info.dataSize = len;
@@ -417,6 +1402,13 @@ static TEE_Result tee_svc_storage_init_file(struct tee_ta_session *sess,
 	if (data && len)
 		res = fops->write(o->fh, data, len);
 
+end_transaction:
+	if (fops->end_transaction) {
+		res2 = fops->end_transaction(o->fh, res == TEE_SUCCESS);
+		if (res == TEE_SUCCESS)
+			res = res2;
+	}
+
 exit:
 	free(attr);
 	free(tmpfile);
@@ -437,6 +1429,7 @@ TEE_Result syscall_storage_obj_open(unsigned long storage_id, void *object_id,
 	struct user_ta_ctx *utc;
 	const struct tee_file_operations *fops = file_ops(storage_id);
 	size_t attr_size;
+	uint32_t data_gen;
 
 	if (!fops) {
 		res = TEE_ERROR_ITEM_NOT_FOUND;
@@ -479,6 +1472,7 @@ TEE_Result syscall_storage_obj_open(unsigned long storage_id, void *object_id,
 	o->pobj = po;
 	tee_obj_add(utc, o);
 
+	data_gen = index_get_data_gen();
 	res = tee_svc_storage_read_head(sess, o);
 	if (res != TEE_SUCCESS) {
 		if (res == TEE_ERROR_CORRUPT_OBJECT) {
@@ -487,6 +1481,7 @@ TEE_Result syscall_storage_obj_open(unsigned long storage_id, void *object_id,
 		}
 		goto oclose;
 	}
+	index_set_obj_info(sess, o, data_gen);
 
 	res = tee_svc_copy_kaddr_to_uref(obj, o);
 	if (res != TEE_SUCCESS)
@@ -534,6 +1529,7 @@ TEE_Result syscall_storage_obj_create(unsigned long storage_id, void *object_id,
 	struct user_ta_ctx *utc;
 	const struct tee_file_operations *fops = file_ops(storage_id);
 	size_t attr_size;
+	uint32_t gen;
 
 	if (!fops)
 		return TEE_ERROR_ITEM_NOT_FOUND;
@@ -610,9 +1606,15 @@ TEE_Result syscall_storage_obj_create(unsigned long storage_id, void *object_id,
 	}
 
 	/* rename temporary persistent object filename */
+	index_begin_update(sess, fops, object_id, object_id_len, &gen);
 	res = fops->rename(tmpfile, file, !!(flags & TEE_DATA_FLAG_OVERWRITE));
-	if (res != TEE_SUCCESS)
+	head_cache_remove(&po->uuid, fops, po->obj_id, po->obj_id_len);
+	if (res != TEE_SUCCESS) {
+		index_end_update(sess, fops, gen, NULL, 0, NULL, 0, NULL);
 		goto rmfile;
+	}
+	index_end_update(sess, fops, gen, NULL, 0, object_id, object_id_len,
+			 o);
 
 	res = fops->open(file, &o->fh);
 	if (res != TEE_SUCCESS)
@@ -668,6 +1670,9 @@ TEE_Result syscall_storage_obj_del(unsigned long obj)
 	char *file;
 	struct user_ta_ctx *utc;
 	const struct tee_file_operations *fops;
+	uint8_t obj_id[TEE_OBJECT_ID_MAX_LEN];
+	uint32_t obj_id_len;
+	uint32_t gen;
 
 	res = tee_ta_get_current_session(&sess);
 	if (res != TEE_SUCCESS)
@@ -690,10 +1695,19 @@ TEE_Result syscall_storage_obj_del(unsigned long obj)
 		return TEE_ERROR_OUT_OF_MEMORY;
 
 	fops = o->pobj->fops;
+	obj_id_len = o->pobj->obj_id_len;
+	memcpy(obj_id, o->pobj->obj_id, obj_id_len);
 	tee_obj_close(utc, o);
 
+	index_begin_update(sess, fops, NULL, 0, &gen);
 	res = fops->remove(file);
 	free(file);
+	head_cache_remove(&sess->ctx->uuid, fops, obj_id, obj_id_len);
+	if (res == TEE_SUCCESS)
+		index_end_update(sess, fops, gen, obj_id, obj_id_len, NULL, 0,
+				 NULL);
+	else
+		index_end_update(sess, fops, gen, NULL, 0, NULL, 0, NULL);
 	return res;
 }
 
@@ -708,6 +1722,7 @@ TEE_Result syscall_storage_obj_rename(unsigned long obj, void *object_id,
 	char *old_file = NULL;
 	struct user_ta_ctx *utc;
 	const struct tee_file_operations *fops;
+	uint32_t gen;
 
 	if (object_id_len > TEE_OBJECT_ID_MAX_LEN)
 		return TEE_ERROR_BAD_PARAMETERS;
@@ -767,7 +1782,17 @@ TEE_Result syscall_storage_obj_rename(unsigned long obj, void *object_id,
 		goto exit;
 
 	/* move */
+	index_begin_update(sess, fops, NULL, 0, &gen);
 	res = fops->rename(old_file, new_file, false /* no overwrite */);
+	head_cache_remove(&o->pobj->uuid, fops, o->pobj->obj_id,
+			  o->pobj->obj_id_len);
+	head_cache_remove(&po->uuid, fops, po->obj_id, po->obj_id_len);
+	if (res == TEE_SUCCESS)
+		index_end_update(sess, fops, gen, o->pobj->obj_id,
+				 o->pobj->obj_id_len, object_id,
+				 object_id_len, NULL);
+	else
+		index_end_update(sess, fops, gen, NULL, 0, NULL, 0, NULL);
 	if (res == TEE_ERROR_GENERIC)
 		goto exit;
 
@@ -802,6 +1827,9 @@ TEE_Result syscall_storage_alloc_enum(uint32_t *obj_enum)
 		return TEE_ERROR_OUT_OF_MEMORY;
 
 	e->dir = NULL;
+	e->entries = NULL;
+	e->num_entries = 0;
+	e->pos = 0;
 	e->fops = NULL;
 	TAILQ_INSERT_TAIL(&utc->storage_enums, e, link);
 
@@ -843,9 +1871,14 @@ TEE_Result syscall_storage_reset_enum(unsigned long obj_enum)
 	if (res != TEE_SUCCESS)
 		return res;
 
-	e->fops->closedir(e->dir);
+	if (e->fops && e->dir)
+		e->fops->closedir(e->dir);
 	e->fops = NULL;
 	e->dir = NULL;
+	free(e->entries);
+	e->entries = NULL;
+	e->num_entries = 0;
+	e->pos = 0;
 
 	return TEE_SUCCESS;
 }
@@ -880,6 +1913,47 @@ exit:
 
 }
 
+/* Takes a snapshot of the object index for the enumeration */
+static TEE_Result start_index_enum(struct tee_ta_session *sess,
+				   struct tee_storage_enum *e)
+{
+	TEE_Result res;
+	struct obj_index *idx;
+	size_t sz;
+
+	mutex_lock(&index_mutex);
+	res = index_get(sess, e->fops, &idx);
+	if (res == TEE_SUCCESS) {
+		res = index_clean(sess, idx);
+		if (res != TEE_SUCCESS) {
+			EMSG("Failed to update object index (0x%x)", res);
+			index_drop(sess, e->fops);
+			res = index_get(sess, e->fops, &idx);
+		}
+	}
+	if (res != TEE_SUCCESS)
+		goto out;
+
+	e->num_entries = idx->num_entries;
+	e->pos = 0;
+	if (!e->num_entries)
+		goto out;
+
+	sz = e->num_entries * sizeof(struct index_entry);
+	e->entries = malloc(sz);
+	if (!e->entries) {
+		e->num_entries = 0;
+		res = TEE_ERROR_OUT_OF_MEMORY;
+		goto out;
+	}
+	memcpy(e->entries, idx->entries, sz);
+out:
+	mutex_unlock(&index_mutex);
+	if (res != TEE_SUCCESS)
+		e->fops = NULL;
+	return res;
+}
+
 TEE_Result syscall_storage_start_enum(unsigned long obj_enum,
 				      unsigned long storage_id)
 {
@@ -902,19 +1976,125 @@ TEE_Result syscall_storage_start_enum(unsigned long obj_enum,
 		return TEE_ERROR_ITEM_NOT_FOUND;
 
 	e->fops = fops;
+	assert(!e->dir && !e->entries);
+
+	if (use_index(fops))
+		return start_index_enum(sess, e);
+
 	dir = tee_svc_storage_create_dirname(sess);
 	if (dir == NULL) {
 		res = TEE_ERROR_OUT_OF_MEMORY;
 		goto exit;
 	}
 
-	assert(!e->dir);
 	res = fops->opendir(dir, &e->dir);
 	free(dir);
 exit:
 	return res;
 }
 
+/* Reads the TEE_ObjectInfo of an object from its head */
+static TEE_Result read_obj_info(struct tee_ta_session *sess,
+				const struct tee_file_operations *fops,
+				struct index_entry *ie, TEE_ObjectInfo *info)
+{
+	TEE_Result res;
+	struct tee_obj *o;
+	struct tee_pobj pobj;
+	uint32_t data_gen;
+
+	memset(&pobj, 0, sizeof(pobj));
+	pobj.obj_id = ie->obj_id;
+	pobj.obj_id_len = ie->obj_id_len;
+	pobj.fops = fops;
+
+	o = tee_obj_alloc();
+	if (!o)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	o->info.handleFlags = TEE_HANDLE_FLAG_PERSISTENT |
+			      TEE_HANDLE_FLAG_INITIALIZED;
+	o->pobj = &pobj;
+
+	data_gen = index_get_data_gen();
+	res = tee_svc_storage_read_head(sess, o);
+	if (res == TEE_SUCCESS) {
+		memcpy(info, &o->info, sizeof(TEE_ObjectInfo));
+		index_set_obj_info(sess, o, data_gen);
+	}
+	fops->close(&o->fh);
+	tee_obj_free(o);
+	return res;
+}
+
+/*
+ * Returns the TEE_ObjectInfo of the object of ie from the index, or from
+ * the head of the object if its data size isn't known. Returns
+ * TEE_ERROR_ITEM_NOT_FOUND if the object was deleted since the
+ * enumeration started.
+ */
+static TEE_Result get_obj_info(struct tee_ta_session *sess,
+			       const struct tee_file_operations *fops,
+			       struct index_entry *ie, TEE_ObjectInfo *info)
+{
+	TEE_Result res;
+	struct obj_index *idx;
+	struct index_entry *cur;
+	uint32_t data_size = INDEX_SIZE_UNKNOWN;
+
+	mutex_lock(&index_mutex);
+	res = index_get(sess, fops, &idx);
+	if (res == TEE_SUCCESS) {
+		cur = index_find(idx, ie->obj_id, ie->obj_id_len);
+		if (!cur) {
+			res = TEE_ERROR_ITEM_NOT_FOUND;
+			goto out;
+		}
+		data_size = idx->data_sizes[cur - idx->entries];
+		if (data_size != INDEX_SIZE_UNKNOWN) {
+			memset(info, 0, sizeof(*info));
+			info->objectType = cur->objectType;
+			info->objectUsage = cur->objectUsage;
+			info->keySize = cur->keySize;
+			info->maxKeySize = cur->maxKeySize;
+			info->dataSize = data_size;
+			info->handleFlags = TEE_HANDLE_FLAG_PERSISTENT |
+					    TEE_HANDLE_FLAG_INITIALIZED;
+		}
+	}
+out:
+	mutex_unlock(&index_mutex);
+
+	if (res == TEE_ERROR_ITEM_NOT_FOUND || data_size != INDEX_SIZE_UNKNOWN)
+		return res;
+	return read_obj_info(sess, fops, ie, info);
+}
+
+static TEE_Result next_index_enum(struct tee_ta_session *sess,
+				  struct tee_storage_enum *e,
+				  TEE_ObjectInfo *info, void *obj_id,
+				  uint64_t *len)
+{
+	TEE_Result res;
+	struct index_entry *ie;
+	uint64_t l;
+
+	/* Objects deleted since the enumeration started are skipped */
+	do {
+		if (e->pos >= e->num_entries)
+			return TEE_ERROR_ITEM_NOT_FOUND;
+		ie = e->entries + e->pos;
+		e->pos++;
+		res = get_obj_info(sess, e->fops, ie, info);
+	} while (res == TEE_ERROR_ITEM_NOT_FOUND);
+	if (res != TEE_SUCCESS)
+		return res;
+
+	memcpy(obj_id, ie->obj_id, ie->obj_id_len);
+
+	l = ie->obj_id_len;
+	return tee_svc_copy_to_user(len, &l, sizeof(*len));
+}
+
 TEE_Result syscall_storage_next_enum(unsigned long obj_enum,
 			TEE_ObjectInfo *info, void *obj_id, uint64_t *len)
 {
@@ -958,6 +2138,11 @@ TEE_Result syscall_storage_next_enum(unsigned long obj_enum,
 		goto exit;
 	}
 
+	if (!e->dir) {
+		res = next_index_enum(sess, e, info, obj_id, len);
+		goto exit;
+	}
+
 	res = e->fops->readdir(e->dir, &d);
 	if (res != TEE_SUCCESS)
 		goto exit;
@@ -1061,9 +2246,15 @@ exit:
 TEE_Result syscall_storage_obj_write(unsigned long obj, void *data, size_t len)
 {
 	TEE_Result res;
+	TEE_Result res2;
+	const struct tee_file_operations *fops;
 	struct tee_ta_session *sess;
 	struct tee_obj *o;
 	struct user_ta_ctx *utc;
+	int32_t old_off;
+	size_t new_pos;
+	bool grow;
+	uint32_t data_gen = 0;
 
 	res = tee_ta_get_current_session(&sess);
 	if (res != TEE_SUCCESS)
@@ -1092,17 +2283,51 @@ TEE_Result syscall_storage_obj_write(unsigned long obj, void *data, size_t len)
 	if (res != TEE_SUCCESS)
 		goto exit;
 
-	res = o->pobj->fops->write(o->fh, data, len);
+	fops = o->pobj->fops;
+	new_pos = o->info.dataPosition + len;
+
+	/* Remember the file position in case the update has to be undone */
+	res = fops->seek(o->fh, 0, TEE_DATA_SEEK_CUR, &old_off);
 	if (res != TEE_SUCCESS)
 		goto exit;
 
-	o->info.dataPosition += len;
-	if (o->info.dataPosition > o->info.dataSize) {
-		res = tee_svc_storage_update_head(o, o->info.dataPosition);
+	grow = new_pos > o->info.dataSize;
+	if (grow)
+		data_gen = index_begin_data_update(sess, o);
+
+	/* Commit the data and the updated head together if supported */
+	if (fops->begin_transaction) {
+		res = fops->begin_transaction(o->fh);
 		if (res != TEE_SUCCESS)
-			goto exit;
-		o->info.dataSize = o->info.dataPosition;
+			goto end_data_update;
+	}
+
+	res = fops->write(o->fh, data, len);
+	if (res == TEE_SUCCESS && grow)
+		res = tee_svc_storage_update_head(o, new_pos);
+
+	if (fops->end_transaction) {
+		res2 = fops->end_transaction(o->fh, res == TEE_SUCCESS);
+		if (res == TEE_SUCCESS)
+			res = res2;
 	}
+	/* The cached head is dropped once the new one is committed */
+	if (grow)
+		head_cache_remove(&o->pobj->uuid, fops, o->pobj->obj_id,
+				  o->pobj->obj_id_len);
+	if (res != TEE_SUCCESS) {
+		/* Nothing was committed, keep the position where it was */
+		fops->seek(o->fh, old_off, TEE_DATA_SEEK_SET, NULL);
+		goto end_data_update;
+	}
+
+	o->info.dataPosition = new_pos;
+	if (o->info.dataPosition > o->info.dataSize)
+		o->info.dataSize = o->info.dataPosition;
+
+end_data_update:
+	if (grow)
+		index_end_data_update(sess, o, data_gen, res == TEE_SUCCESS);
 
 exit:
 	return res;
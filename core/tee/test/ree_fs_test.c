@@ -0,0 +1,1040 @@
+/*
+ * Copyright (c) 2017, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Host regression and fuzz test of the REE FS file format in
+ * core/tee/tee_ree_fs.c, see Makefile in this directory.
+ *
+ * tee_ree_fs.c is linked with stubs: the files of the normal world are
+ * kept in memory and the authenticated encryption is replaced by an XOR
+ * stream and a keyed FNV-1a hash as tag. That detects any change of a
+ * file, which is what's tested here, but is of course not secure.
+ *
+ * The test applies random writes, truncates and transactions to a file
+ * and compares it with a model after each of them, both through the open
+ * handle and after reopening the file. Writes to the normal world fail at
+ * random to check that a failed update leaves the file as of the last
+ * commit. Then the file is updated through two handles at once. Then
+ * single bits of the file are flipped, the file must then fail to open
+ * or read, or read as of the current or the previous commit.
+ * Last, files of the previous format must be converted when opened, and
+ * other files without the format magic must be reported as
+ * TEE_ERROR_STORAGE_NOT_AVAILABLE and be left unchanged.
+ *
+ * With -b the throughput of reading and writing a 1 MiB file in whole
+ * blocks is measured instead, that is the path where blocks are encrypted
+ * directly from the caller's buffer when written. With the stubbed crypto
+ * and RPC this is the overhead of tee_ree_fs.c itself, not what a device
+ * achieves.
+ */
+
+#include <kernel/mutex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tee/tee_cryp_provider.h>
+#include <tee/tee_fs.h>
+#include <tee/tee_fs_key_manager.h>
+#include <tee/tee_fs_rpc.h>
+#include <time.h>
+#include <trace.h>
+
+#define MAX_FILES	4
+#define MAX_LEN		(256 * 1024)
+
+struct ree_file {
+	char name[64];
+	uint8_t *data;
+	size_t len;
+	bool used;
+};
+
+static struct ree_file files[MAX_FILES];
+
+/* Number of writes to the normal world left before one fails, or -1 */
+static int fail_countdown = -1;
+
+/* Current RPC, there's only one at a time */
+static int rpc_fd;
+static tee_fs_off_t rpc_offs;
+static size_t rpc_len;
+static uint8_t *rpc_buf;
+
+static uint32_t rand_state = 1;
+
+static uint32_t rnd(void)
+{
+	/* xorshift32 */
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+	return rand_state;
+}
+
+/*
+ * Stubs of the core
+ */
+
+void mutex_init(struct mutex *m __unused)
+{
+}
+
+void mutex_destroy(struct mutex *m __unused)
+{
+}
+
+void mutex_lock(struct mutex *m __unused)
+{
+}
+
+void mutex_unlock(struct mutex *m __unused)
+{
+}
+
+void trace_printf(const char *func __unused, int line __unused,
+		  int level __unused, bool level_ok __unused,
+		  const char *fmt __unused, ...)
+{
+}
+
+int buf_compare_ct(const void *s1, const void *s2, size_t n)
+{
+	return !!memcmp(s1, s2, n);
+}
+
+static int find_file(const char *name)
+{
+	int n;
+
+	for (n = 0; n < MAX_FILES; n++)
+		if (files[n].used && !strcmp(files[n].name, name))
+			return n;
+	return -1;
+}
+
+TEE_Result tee_fs_rpc_open(uint32_t id __unused, const char *fname, int *fd)
+{
+	*fd = find_file(fname);
+	if (*fd < 0)
+		return TEE_ERROR_ITEM_NOT_FOUND;
+	return TEE_SUCCESS;
+}
+
+TEE_Result tee_fs_rpc_create(uint32_t id __unused, const char *fname,
+			     int *fd)
+{
+	int n = find_file(fname);
+
+	if (n < 0) {
+		for (n = 0; n < MAX_FILES && files[n].used; n++)
+			;
+		if (n == MAX_FILES)
+			return TEE_ERROR_STORAGE_NO_SPACE;
+	}
+	files[n].used = true;
+	snprintf(files[n].name, sizeof(files[n].name), "%s", fname);
+	free(files[n].data);
+	files[n].data = NULL;
+	files[n].len = 0;
+	*fd = n;
+	return TEE_SUCCESS;
+}
+
+TEE_Result tee_fs_rpc_close(uint32_t id __unused, int fd __unused)
+{
+	return TEE_SUCCESS;
+}
+
+TEE_Result tee_fs_rpc_remove(uint32_t id __unused, const char *fname)
+{
+	int n = find_file(fname);
+
+	if (n < 0)
+		return TEE_ERROR_ITEM_NOT_FOUND;
+	files[n].used = false;
+	return TEE_SUCCESS;
+}
+
+TEE_Result tee_fs_rpc_rename(uint32_t id __unused, const char *old_fname,
+			     const char *new_fname, bool overwrite)
+{
+	int o = find_file(old_fname);
+	int n = find_file(new_fname);
+
+	if (o < 0)
+		return TEE_ERROR_ITEM_NOT_FOUND;
+	if (n >= 0) {
+		if (!overwrite)
+			return TEE_ERROR_ACCESS_CONFLICT;
+		files[n].used = false;
+	}
+	snprintf(files[o].name, sizeof(files[o].name), "%s", new_fname);
+	return TEE_SUCCESS;
+}
+
+TEE_Result tee_fs_rpc_opendir(uint32_t id __unused, const char *name __unused,
+			      struct tee_fs_dir **d __unused)
+{
+	return TEE_ERROR_NOT_SUPPORTED;
+}
+
+TEE_Result tee_fs_rpc_closedir(uint32_t id __unused,
+			       struct tee_fs_dir *d __unused)
+{
+	return TEE_SUCCESS;
+}
+
+TEE_Result tee_fs_rpc_readdir(uint32_t id __unused,
+			      struct tee_fs_dir *d __unused,
+			      struct tee_fs_dirent **ent __unused)
+{
+	return TEE_ERROR_NOT_SUPPORTED;
+}
+
+static TEE_Result rpc_init(int fd, tee_fs_off_t offs, size_t len,
+			   void **data)
+{
+	uint8_t *buf = realloc(rpc_buf, len ? len : 1);
+
+	if (!buf)
+		return TEE_ERROR_OUT_OF_MEMORY;
+	rpc_buf = buf;
+	rpc_fd = fd;
+	rpc_offs = offs;
+	rpc_len = len;
+	*data = buf;
+	return TEE_SUCCESS;
+}
+
+TEE_Result tee_fs_rpc_read_init(struct tee_fs_rpc_operation *op __unused,
+				uint32_t id __unused, int fd,
+				tee_fs_off_t offset, size_t data_len,
+				void **out_data)
+{
+	return rpc_init(fd, offset, data_len, out_data);
+}
+
+TEE_Result tee_fs_rpc_read_final(struct tee_fs_rpc_operation *op __unused,
+				 size_t *data_len)
+{
+	struct ree_file *f = files + rpc_fd;
+	size_t n = 0;
+
+	if ((size_t)rpc_offs < f->len)
+		n = MIN(rpc_len, f->len - rpc_offs);
+	memcpy(rpc_buf, f->data + rpc_offs, n);
+	*data_len = n;
+	return TEE_SUCCESS;
+}
+
+TEE_Result tee_fs_rpc_write_init(struct tee_fs_rpc_operation *op __unused,
+				 uint32_t id __unused, int fd,
+				 tee_fs_off_t offset, size_t data_len,
+				 void **data)
+{
+	return rpc_init(fd, offset, data_len, data);
+}
+
+TEE_Result tee_fs_rpc_write_final(struct tee_fs_rpc_operation *op __unused)
+{
+	struct ree_file *f = files + rpc_fd;
+	size_t end = rpc_offs + rpc_len;
+	uint8_t *data;
+
+	if (!fail_countdown)
+		return TEE_ERROR_GENERIC;
+	if (fail_countdown > 0)
+		fail_countdown--;
+
+	if (end > f->len) {
+		data = realloc(f->data, end);
+		if (!data)
+			return TEE_ERROR_OUT_OF_MEMORY;
+		memset(data + f->len, 0, end - f->len);
+		f->data = data;
+		f->len = end;
+	}
+	memcpy(f->data + rpc_offs, rpc_buf, rpc_len);
+	return TEE_SUCCESS;
+}
+
+static void fnv1a(uint64_t *h, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	size_t n;
+
+	for (n = 0; n < len; n++) {
+		*h ^= p[n];
+		*h *= 1099511628211ULL;
+	}
+}
+
+static TEE_Result hash_get_ctx_size(uint32_t algo __unused, size_t *size)
+{
+	*size = sizeof(uint64_t);
+	return TEE_SUCCESS;
+}
+
+static TEE_Result hash_init(void *ctx, uint32_t algo __unused)
+{
+	*(uint64_t *)ctx = 14695981039346656037ULL;
+	return TEE_SUCCESS;
+}
+
+static TEE_Result hash_update(void *ctx, uint32_t algo __unused,
+			      const uint8_t *data, size_t len)
+{
+	fnv1a(ctx, data, len);
+	return TEE_SUCCESS;
+}
+
+static TEE_Result hash_final(void *ctx, uint32_t algo __unused,
+			     uint8_t *digest, size_t len)
+{
+	uint64_t h = *(uint64_t *)ctx;
+	size_t n;
+
+	for (n = 0; n < len; n++) {
+		digest[n] = h >> ((n % 8) * 8);
+		if (n % 8 == 7)
+			fnv1a(&h, &n, sizeof(n));
+	}
+	return TEE_SUCCESS;
+}
+
+const struct crypto_ops crypto_ops = {
+	.hash = {
+		.get_ctx_size = hash_get_ctx_size,
+		.init = hash_init,
+		.update = hash_update,
+		.final = hash_final,
+	},
+};
+
+TEE_Result tee_fs_generate_fek(uint8_t *encrypted_fek, int fek_size)
+{
+	int n;
+
+	for (n = 0; n < fek_size; n++)
+		encrypted_fek[n] = rnd();
+	return TEE_SUCCESS;
+}
+
+TEE_Result tee_fs_key_init(struct tee_fs_key *key,
+			   const uint8_t *encrypted_fek)
+{
+	memset(key, 0, sizeof(*key));
+	memcpy(key->fek, encrypted_fek, sizeof(key->fek));
+	key->fek[0] ^= 0xa5;
+	return TEE_SUCCESS;
+}
+
+void tee_fs_key_clear(struct tee_fs_key *key)
+{
+	memset(key, 0, sizeof(*key));
+}
+
+TEE_Result tee_fs_authenc(TEE_OperationMode mode, struct tee_fs_key *key,
+			  uint8_t *iv, uint8_t *tag, const void *aad,
+			  size_t aad_size, const void *in, size_t size,
+			  void *out)
+{
+	static uint32_t iv_counter;
+	const uint8_t *src = in;
+	uint8_t *dst = out;
+	const uint8_t *ct;
+	uint64_t h = 1;
+	size_t n;
+
+	if (mode == TEE_MODE_ENCRYPT) {
+		iv_counter++;
+		memset(iv, 0, TEE_FS_KM_IV_LEN);
+		memcpy(iv, &iv_counter, sizeof(iv_counter));
+		ct = out;
+	} else {
+		ct = in;
+	}
+
+	/* The tag covers the ciphertext, compute it before it's overwritten */
+	fnv1a(&h, key->fek, sizeof(key->fek));
+	fnv1a(&h, iv, TEE_FS_KM_IV_LEN);
+	fnv1a(&h, aad, aad_size);
+	if (mode == TEE_MODE_DECRYPT) {
+		fnv1a(&h, ct, size);
+		if (memcmp(tag, &h, sizeof(h)))
+			return TEE_ERROR_MAC_INVALID;
+	}
+
+	for (n = 0; n < size; n++)
+		dst[n] = src[n] ^ (uint8_t)(iv[0] + iv[1] * 7 + n);
+
+	if (mode == TEE_MODE_ENCRYPT) {
+		fnv1a(&h, ct, size);
+		memset(tag, 0, TEE_FS_KM_MAX_TAG_LEN);
+		memcpy(tag, &h, sizeof(h));
+	}
+	return TEE_SUCCESS;
+}
+
+/*
+ * Crypto of the previous file format, tee_fs_encrypt_file() is only used
+ * by the test to write such files. The header of META_FILE holds the
+ * encrypted FEK, an IV and a tag, the one of BLOCK_FILE an IV and a tag.
+ */
+
+size_t tee_fs_get_header_size(enum tee_fs_file_type type)
+{
+	if (type == META_FILE)
+		return sizeof(struct meta_header);
+	return sizeof(struct block_header);
+}
+
+static void legacy_crypt(uint8_t *dst, const uint8_t *src, size_t size,
+			 const uint8_t *iv)
+{
+	size_t n;
+
+	for (n = 0; n < size; n++)
+		dst[n] = src[n] ^ (uint8_t)(iv[0] + n * 3);
+}
+
+static uint64_t legacy_tag(const uint8_t *encrypted_fek, const uint8_t *iv,
+			   const uint8_t *ct, size_t size)
+{
+	uint64_t h = 2;
+
+	fnv1a(&h, encrypted_fek, TEE_FS_KM_FEK_SIZE);
+	fnv1a(&h, iv, TEE_FS_KM_IV_LEN);
+	fnv1a(&h, ct, size);
+	return h;
+}
+
+TEE_Result tee_fs_encrypt_file(enum tee_fs_file_type file_type,
+		const uint8_t *plaintext, size_t plaintext_size,
+		uint8_t *ciphertext, size_t *ciphertext_size,
+		const uint8_t *encrypted_fek)
+{
+	size_t header_size = tee_fs_get_header_size(file_type);
+	struct common_header *ch = (void *)ciphertext;
+	uint64_t tag;
+
+	if (file_type == META_FILE) {
+		memcpy(ciphertext, encrypted_fek, TEE_FS_KM_FEK_SIZE);
+		ch = (void *)(ciphertext + TEE_FS_KM_FEK_SIZE);
+	}
+	memset(ch, 0, sizeof(*ch));
+	ch->iv[0] = rnd();
+	legacy_crypt(ciphertext + header_size, plaintext, plaintext_size,
+		     ch->iv);
+	tag = legacy_tag(encrypted_fek, ch->iv, ciphertext + header_size,
+			 plaintext_size);
+	memcpy(ch->tag, &tag, sizeof(tag));
+	*ciphertext_size = header_size + plaintext_size;
+	return TEE_SUCCESS;
+}
+
+TEE_Result tee_fs_decrypt_file(enum tee_fs_file_type file_type,
+		const uint8_t *data_in, size_t data_in_size,
+		uint8_t *plaintext, size_t *plaintext_size,
+		uint8_t *encrypted_fek)
+{
+	size_t header_size = tee_fs_get_header_size(file_type);
+	const struct common_header *ch = (const void *)data_in;
+	const uint8_t *fek = encrypted_fek;
+	uint64_t tag;
+	size_t size;
+
+	if (data_in_size < header_size ||
+	    data_in_size - header_size > *plaintext_size)
+		return TEE_ERROR_BAD_PARAMETERS;
+	size = data_in_size - header_size;
+
+	if (file_type == META_FILE) {
+		fek = data_in;
+		ch = (const void *)(data_in + TEE_FS_KM_FEK_SIZE);
+	}
+	tag = legacy_tag(fek, ch->iv, data_in + header_size, size);
+	if (memcmp(ch->tag, &tag, sizeof(tag)))
+		return TEE_ERROR_MAC_INVALID;
+
+	legacy_crypt(plaintext, data_in + header_size, size, ch->iv);
+	if (file_type == META_FILE)
+		memcpy(encrypted_fek, data_in, TEE_FS_KM_FEK_SIZE);
+	*plaintext_size = size;
+	return TEE_SUCCESS;
+}
+
+/*
+ * Tests
+ */
+
+static uint8_t model[MAX_LEN];
+static size_t model_len;
+static uint8_t read_buf[MAX_LEN];
+
+static void model_write(size_t pos, const uint8_t *data, size_t len)
+{
+	if (pos > model_len)
+		memset(model + model_len, 0, pos - model_len);
+	memcpy(model + pos, data, len);
+	model_len = MAX(model_len, pos + len);
+}
+
+static void model_truncate(size_t len)
+{
+	if (len > model_len)
+		memset(model + model_len, 0, len - model_len);
+	model_len = len;
+}
+
+static void fail(const char *msg, TEE_Result res)
+{
+	printf("FAIL: %s (0x%x)\n", msg, res);
+	exit(1);
+}
+
+static bool file_equals(const uint8_t *buf, size_t len)
+{
+	return len == model_len && !memcmp(buf, model, len);
+}
+
+static void check_file(struct tee_file_handle *fh, const char *what)
+{
+	TEE_Result res;
+	size_t len = sizeof(read_buf);
+
+	res = ree_fs_ops.seek(fh, 0, TEE_DATA_SEEK_SET, NULL);
+	if (res != TEE_SUCCESS)
+		fail("seek", res);
+	res = ree_fs_ops.read(fh, read_buf, &len);
+	if (res != TEE_SUCCESS)
+		fail(what, res);
+	if (!file_equals(read_buf, len))
+		fail(what, TEE_ERROR_GENERIC);
+}
+
+/*
+ * Reads the file through a second handle, which shares the state of the
+ * first one. Each successful update must have been committed.
+ */
+static void check_committed(uint8_t *committed, size_t *committed_len)
+{
+	struct tee_file_handle *fh;
+	TEE_Result res;
+	size_t len = sizeof(read_buf);
+
+	res = ree_fs_ops.open("obj", &fh);
+	if (res != TEE_SUCCESS)
+		fail("open committed", res);
+	res = ree_fs_ops.read(fh, read_buf, &len);
+	if (res != TEE_SUCCESS)
+		fail("read committed", res);
+	ree_fs_ops.close(&fh);
+
+	if (file_equals(read_buf, len)) {
+		memcpy(committed, model, model_len);
+		*committed_len = model_len;
+		return;
+	}
+	fail("committed file", TEE_ERROR_GENERIC);
+}
+
+static void reopen(struct tee_file_handle **fh)
+{
+	TEE_Result res;
+
+	ree_fs_ops.close(fh);
+	res = ree_fs_ops.open("obj", fh);
+	if (res != TEE_SUCCESS)
+		fail("reopen", res);
+}
+
+static TEE_Result random_write(struct tee_file_handle *fh, size_t max_len,
+			       size_t *pos, uint8_t *data, size_t *len)
+{
+	TEE_Result res;
+	size_t n;
+
+	*pos = rnd() % (MAX_LEN / 2);
+	*len = 1 + rnd() % max_len;
+	for (n = 0; n < *len; n++)
+		data[n] = rnd();
+
+	res = ree_fs_ops.seek(fh, *pos, TEE_DATA_SEEK_SET, NULL);
+	if (res != TEE_SUCCESS)
+		return res;
+	return ree_fs_ops.write(fh, data, *len);
+}
+
+static void test_random_updates(struct tee_file_handle **fh,
+				unsigned int iterations)
+{
+	static uint8_t committed[MAX_LEN];
+	static uint8_t data[MAX_LEN / 4];
+	size_t committed_len = 0;
+	unsigned int it;
+	TEE_Result res;
+	TEE_Result res2;
+	size_t pos;
+	size_t len;
+	size_t tlen;
+	uint32_t op;
+
+	for (it = 0; it < iterations; it++) {
+		if (!(rnd() % 8))
+			fail_countdown = rnd() % 20;
+
+		op = rnd() % 10;
+		if (op < 6) {
+			res = random_write(*fh, sizeof(data), &pos, data, &len);
+			if (res == TEE_SUCCESS)
+				model_write(pos, data, len);
+		} else if (op < 8) {
+			tlen = rnd() % (MAX_LEN / 2 + MAX_LEN / 4);
+			res = ree_fs_ops.truncate(*fh, tlen);
+			if (res == TEE_SUCCESS)
+				model_truncate(tlen);
+		} else if (op == 8) {
+			/* Both updates are committed, or none */
+			ree_fs_ops.begin_transaction(*fh);
+			tlen = rnd() % (MAX_LEN / 2 + MAX_LEN / 4);
+			res = ree_fs_ops.truncate(*fh, tlen);
+			if (res == TEE_SUCCESS)
+				res = random_write(*fh, sizeof(data) / 4, &pos,
+						   data, &len);
+			res2 = ree_fs_ops.end_transaction(*fh,
+							  res == TEE_SUCCESS);
+			if (res == TEE_SUCCESS)
+				res = res2;
+			if (res == TEE_SUCCESS) {
+				model_truncate(tlen);
+				model_write(pos, data, len);
+			}
+		} else {
+			fail_countdown = -1;
+			reopen(fh);
+			res = TEE_SUCCESS;
+		}
+		fail_countdown = -1;
+
+		/* A failed update rolls back to the last commit */
+		if (res != TEE_SUCCESS) {
+			memcpy(model, committed, committed_len);
+			model_len = committed_len;
+		}
+		check_file(*fh, "read back");
+		if (res != TEE_SUCCESS || !(rnd() % 5)) {
+			reopen(fh);
+			check_file(*fh, "read back after reopen");
+		}
+		check_committed(committed, &committed_len);
+	}
+}
+
+/*
+ * Updates through two handles of the file, each must keep the updates of
+ * the other when it commits.
+ */
+static void test_two_handles(unsigned int iterations)
+{
+	static uint8_t data[MAX_LEN / 4];
+	struct tee_file_handle *fh[2];
+	unsigned int it;
+	TEE_Result res;
+	size_t pos;
+	size_t len;
+
+	res = ree_fs_ops.open("obj", &fh[0]);
+	if (res == TEE_SUCCESS)
+		res = ree_fs_ops.open("obj", &fh[1]);
+	if (res != TEE_SUCCESS)
+		fail("open two handles", res);
+
+	for (it = 0; it < iterations; it++) {
+		res = random_write(fh[it & 1], sizeof(data), &pos, data, &len);
+		if (res != TEE_SUCCESS)
+			fail("write through two handles", res);
+		model_write(pos, data, len);
+	}
+	check_file(fh[0], "read back through first handle");
+	check_file(fh[1], "read back through second handle");
+	ree_fs_ops.close(&fh[0]);
+	ree_fs_ops.close(&fh[1]);
+
+	res = ree_fs_ops.open("obj", &fh[0]);
+	if (res != TEE_SUCCESS)
+		fail("reopen after two handles", res);
+	check_file(fh[0], "read back after two handles");
+	ree_fs_ops.close(&fh[0]);
+}
+
+/*
+ * The file keeps the previous commit until the next one, so a modified
+ * head may leave the file as of that commit. Any other outcome than an
+ * error, the current or the previous content is a failure.
+ */
+static void test_tampering(unsigned int count)
+{
+	static uint8_t prev[MAX_LEN];
+	static uint8_t data[MAX_LEN / 4];
+	struct tee_file_handle *fh;
+	struct ree_file *f;
+	unsigned int detected = 0;
+	unsigned int rolled_back = 0;
+	size_t prev_len = model_len;
+	unsigned int n;
+	TEE_Result res;
+	uint8_t bit;
+	size_t offs;
+	size_t len;
+	size_t pos;
+
+	memcpy(prev, model, model_len);
+	res = ree_fs_ops.open("obj", &fh);
+	if (res == TEE_SUCCESS)
+		res = random_write(fh, sizeof(data), &pos, data, &len);
+	if (res != TEE_SUCCESS)
+		fail("update before modification", res);
+	model_write(pos, data, len);
+	ree_fs_ops.close(&fh);
+
+	f = files + find_file("obj");
+	for (n = 0; n < count; n++) {
+		offs = rnd() % f->len;
+		bit = 1 << (rnd() % 8);
+		f->data[offs] ^= bit;
+
+		res = ree_fs_ops.open("obj", &fh);
+		if (res == TEE_SUCCESS) {
+			len = sizeof(read_buf);
+			res = ree_fs_ops.read(fh, read_buf, &len);
+			ree_fs_ops.close(&fh);
+		}
+		if (res == TEE_SUCCESS && !file_equals(read_buf, len)) {
+			if (len != prev_len || memcmp(read_buf, prev, len))
+				fail("undetected modification", res);
+			rolled_back++;
+		}
+		if (res != TEE_SUCCESS) {
+			if (res != TEE_ERROR_CORRUPT_OBJECT &&
+			    res != TEE_ERROR_STORAGE_NOT_AVAILABLE)
+				fail("unexpected error", res);
+			detected++;
+		}
+
+		f->data[offs] ^= bit;
+	}
+	printf("  %u/%u detected, %u as of previous commit, others unused\n",
+	       detected, count, rolled_back);
+}
+
+static void test_foreign_format(void)
+{
+	struct tee_file_handle *fh;
+	static uint8_t image[8192];
+	TEE_Result res;
+	int fd;
+	size_t n;
+
+	/* Like a file of the previous format, but the meta data is invalid */
+	for (n = 0; n < sizeof(image); n++)
+		image[n] = rnd();
+	memset(image, 0, 4);
+	res = tee_fs_rpc_create(0, "legacy", &fd);
+	if (res != TEE_SUCCESS)
+		fail("create legacy", res);
+	files[fd].data = malloc(sizeof(image));
+	if (!files[fd].data)
+		fail("malloc", TEE_ERROR_OUT_OF_MEMORY);
+	memcpy(files[fd].data, image, sizeof(image));
+	files[fd].len = sizeof(image);
+
+	res = ree_fs_ops.open("legacy", &fh);
+	if (res != TEE_ERROR_STORAGE_NOT_AVAILABLE)
+		fail("open of a file of another format", res);
+	if (files[fd].len != sizeof(image) ||
+	    memcmp(files[fd].data, image, sizeof(image)))
+		fail("file of another format modified", TEE_ERROR_GENERIC);
+
+	/* A truncated file is corrupt */
+	files[fd].len = 16;
+	res = ree_fs_ops.open("legacy", &fh);
+	if (res != TEE_ERROR_CORRUPT_OBJECT)
+		fail("open of a truncated file", res);
+	tee_fs_rpc_remove(0, "legacy");
+}
+
+/* Layout of the previous format, see tee_ree_fs.c */
+#define LEGACY_BLOCK_SIZE	4096
+
+struct legacy_file_info {
+	uint64_t length;
+	uint32_t backup_version_table[1024 / 32];
+};
+
+struct legacy_file_meta {
+	struct legacy_file_info info;
+	uint8_t encrypted_fek[TEE_FS_KM_FEK_SIZE];
+	uint32_t counter;
+};
+
+/*
+ * Writes the model as a file of the previous format, the inactive
+ * versions of the meta data and the blocks are random.
+ */
+static void write_legacy_file(const char *name)
+{
+	size_t meta_size = sizeof(struct meta_header) +
+			   sizeof(struct legacy_file_meta);
+	size_t block_size = sizeof(struct block_header) + LEGACY_BLOCK_SIZE;
+	size_t num_blocks = (model_len + LEGACY_BLOCK_SIZE - 1) /
+			    LEGACY_BLOCK_SIZE;
+	static uint8_t block[LEGACY_BLOCK_SIZE];
+	struct legacy_file_info info;
+	uint8_t fek[TEE_FS_KM_FEK_SIZE];
+	uint32_t counter = rnd();
+	struct ree_file *f;
+	TEE_Result res;
+	size_t ct_size;
+	size_t offs;
+	size_t n;
+	int fd;
+
+	res = tee_fs_rpc_create(0, name, &fd);
+	if (res != TEE_SUCCESS)
+		fail("create legacy", res);
+	f = files + fd;
+	f->len = sizeof(counter) + 2 * meta_size + 2 * num_blocks * block_size;
+	f->data = malloc(f->len);
+	if (!f->data)
+		fail("malloc", TEE_ERROR_OUT_OF_MEMORY);
+	for (n = 0; n < f->len; n++)
+		f->data[n] = rnd();
+	tee_fs_generate_fek(fek, sizeof(fek));
+
+	memset(&info, 0, sizeof(info));
+	info.length = model_len;
+	for (n = 0; n < num_blocks; n++) {
+		memset(block, 0, sizeof(block));
+		memcpy(block, model + n * LEGACY_BLOCK_SIZE,
+		       MIN(model_len - n * LEGACY_BLOCK_SIZE,
+			   (size_t)LEGACY_BLOCK_SIZE));
+		offs = sizeof(counter) + 2 * meta_size + 2 * n * block_size;
+		if (rnd() & 1) {
+			info.backup_version_table[n / 32] |= 1 << (n % 32);
+			offs += block_size;
+		}
+		tee_fs_encrypt_file(BLOCK_FILE, block, sizeof(block),
+				    f->data + offs, &ct_size, fek);
+	}
+
+	memcpy(f->data, &counter, sizeof(counter));
+	offs = sizeof(counter) + (counter & 1) * meta_size;
+	tee_fs_encrypt_file(META_FILE, (uint8_t *)&info, sizeof(info),
+			    f->data + offs, &ct_size, fek);
+}
+
+/*
+ * A file of the previous format is converted when opened, a conversion
+ * which fails leaves it as it was.
+ */
+static void test_legacy_migration(void)
+{
+	static uint8_t saved[MAX_LEN];
+	struct tee_file_handle *fh;
+	size_t saved_len;
+	TEE_Result res;
+	size_t n;
+	int fd;
+
+	model_len = rnd() % (MAX_LEN / 2) + 1;
+	for (n = 0; n < model_len; n++)
+		model[n] = rnd();
+	write_legacy_file("/ta/legacy");
+
+	fd = find_file("/ta/legacy");
+	saved_len = files[fd].len;
+	memcpy(saved, files[fd].data, saved_len);
+	fail_countdown = rnd() % 3;
+	res = ree_fs_ops.open("/ta/legacy", &fh);
+	fail_countdown = -1;
+	if (res == TEE_SUCCESS)
+		fail("conversion with failing writes", res);
+	fd = find_file("/ta/legacy");
+	if (fd < 0 || files[fd].len != saved_len ||
+	    memcmp(files[fd].data, saved, saved_len))
+		fail("old file modified by failed conversion", res);
+	if (find_file("/ta/.legacy") >= 0)
+		fail("temporary file left by failed conversion", res);
+
+	res = ree_fs_ops.open("/ta/legacy", &fh);
+	if (res != TEE_SUCCESS)
+		fail("open of a file of the previous format", res);
+	check_file(fh, "read back converted file");
+	ree_fs_ops.close(&fh);
+	if (find_file("/ta/.legacy") >= 0)
+		fail("temporary file left by conversion", TEE_ERROR_GENERIC);
+
+	res = ree_fs_ops.open("/ta/legacy", &fh);
+	if (res != TEE_SUCCESS)
+		fail("reopen converted file", res);
+	check_file(fh, "read back after reopen of converted file");
+	ree_fs_ops.close(&fh);
+	tee_fs_rpc_remove(0, "/ta/legacy");
+}
+
+#define BENCH_FILE_SIZE		(1024 * 1024)
+#define BENCH_BLOCK_SIZE	4096	/* BLOCK_SIZE in tee_ree_fs.c */
+#define BENCH_ROUNDS		16
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static double mb_per_s(uint64_t ns)
+{
+	return (double)BENCH_FILE_SIZE * 1000 / ns;
+}
+
+/* Writes or reads the whole file in chunks, returns the fastest round */
+static uint64_t bench_file(struct tee_file_handle *fh, uint8_t *buf,
+			   size_t chunk, bool write)
+{
+	uint64_t best = UINT64_MAX;
+	uint64_t t;
+	unsigned int round;
+	TEE_Result res;
+	size_t pos;
+	size_t len;
+
+	for (round = 0; round < BENCH_ROUNDS; round++) {
+		res = ree_fs_ops.seek(fh, 0, TEE_DATA_SEEK_SET, NULL);
+		if (res != TEE_SUCCESS)
+			fail("seek", res);
+
+		t = now_ns();
+		for (pos = 0; pos < BENCH_FILE_SIZE; pos += chunk) {
+			if (write) {
+				res = ree_fs_ops.write(fh, buf + pos, chunk);
+			} else {
+				len = chunk;
+				res = ree_fs_ops.read(fh, buf + pos, &len);
+				if (res == TEE_SUCCESS && len != chunk)
+					res = TEE_ERROR_CORRUPT_OBJECT;
+			}
+			if (res != TEE_SUCCESS)
+				fail(write ? "write" : "read", res);
+		}
+		best = MIN(best, now_ns() - t);
+	}
+	return best;
+}
+
+static int bench(void)
+{
+	static const size_t chunks[] = {
+		BENCH_BLOCK_SIZE, 16 * BENCH_BLOCK_SIZE, BENCH_FILE_SIZE
+	};
+	struct tee_file_handle *fh;
+	uint64_t write_ns;
+	uint64_t read_ns;
+	TEE_Result res;
+	uint8_t *buf;
+	size_t n;
+
+	buf = malloc(BENCH_FILE_SIZE);
+	if (!buf)
+		fail("malloc", TEE_ERROR_OUT_OF_MEMORY);
+	for (n = 0; n < BENCH_FILE_SIZE; n++)
+		buf[n] = rnd();
+
+	res = ree_fs_ops.create("bench", &fh);
+	if (res == TEE_SUCCESS)
+		res = ree_fs_ops.write(fh, buf, BENCH_FILE_SIZE);
+	if (res != TEE_SUCCESS)
+		fail("create", res);
+
+	printf("%u KiB file in whole blocks, best of %u\n",
+	       BENCH_FILE_SIZE / 1024, BENCH_ROUNDS);
+	printf("%10s %12s %12s\n", "chunk", "write MB/s", "read MB/s");
+	for (n = 0; n < ARRAY_SIZE(chunks); n++) {
+		write_ns = bench_file(fh, buf, chunks[n], true);
+		read_ns = bench_file(fh, buf, chunks[n], false);
+		printf("%10zu %12.1f %12.1f\n", chunks[n], mb_per_s(write_ns),
+		       mb_per_s(read_ns));
+	}
+
+	ree_fs_ops.close(&fh);
+	free(buf);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct tee_file_handle *fh;
+	unsigned int iterations = 3000;
+	TEE_Result res;
+
+	if (argc == 2 && !strcmp(argv[1], "-b"))
+		return bench();
+	if (argc > 1)
+		rand_state = strtoul(argv[1], NULL, 0) | 1;
+	if (argc > 2)
+		iterations = strtoul(argv[2], NULL, 0);
+	if (argc > 3 || !iterations) {
+		printf("usage: %s [seed [iterations]] | -b\n", argv[0]);
+		return 1;
+	}
+
+	printf("seed %u, %u iterations\n", rand_state, iterations);
+	res = ree_fs_ops.create("obj", &fh);
+	if (res != TEE_SUCCESS)
+		fail("create", res);
+
+	printf("random updates with failing writes\n");
+	test_random_updates(&fh, iterations);
+	ree_fs_ops.close(&fh);
+
+	printf("updates through two handles\n");
+	test_two_handles(100);
+
+	printf("modified file\n");
+	test_tampering(500);
+
+	printf("file of the previous format\n");
+	test_legacy_migration();
+
+	printf("file of another format\n");
+	test_foreign_format();
+
+	printf("OK\n");
+	return 0;
+}
@@ -0,0 +1,2 @@
+srcs-$(CFG_ARM64_$(sm)) += mpa_a64.S
+cppflags-lib-$(CFG_ARM64_$(sm)) += -DMPA_USE_A64_ASM
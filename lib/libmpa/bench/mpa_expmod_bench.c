@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2017, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Host benchmark of mpa_exp_mod() and mpa_exp_mod_public(), see
+ * lib/libmpa/bench/Makefile.
+ *
+ * For each modulus size a random odd modulus, base and full length
+ * exponent are generated and the results of mpa_exp_mod(),
+ * mpa_exp_mod_public(), both with a scratch pool too small for a window
+ * table, and plain binary square-and-multiply are compared. The time per
+ * operation of each variant is then printed.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "mpa.h"
+
+#define MAX_BITS	4096
+#define NUM_ITER	8
+
+/* Temporary variables of MAX_BITS + 2 words, see alloc_table() */
+#define TEMP_BITS	(MAX_BITS + 2 * MPA_WORD_SIZE)
+#define VAR_U32		mpa_StaticVarSizeInU32(TEMP_BITS)
+
+static uint32_t big_pool[mpa_scratch_mem_size_in_U32(80, TEMP_BITS)];
+/* Room for the three variables of the fallback but not for a table */
+static uint32_t small_pool[mpa_scratch_mem_size_in_U32(4, TEMP_BITS)];
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ULL;
+
+static mpa_word_t rand_word(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return (mpa_word_t)rng_state;
+}
+
+static mpanum new_var(void)
+{
+	mpanum v = calloc(VAR_U32, sizeof(uint32_t));
+
+	if (!v) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	mpa_init_static(v, VAR_U32);
+	return v;
+}
+
+static void set_random(mpanum v, int bits)
+{
+	int words = bits / MPA_WORD_SIZE;
+	int i;
+
+	for (i = 0; i < words; i++)
+		v->d[i] = rand_word();
+	v->d[words - 1] |= (mpa_word_t)1 << (MPA_WORD_SIZE - 1);
+	v->size = words;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* The exponentiation used before the window variants, as reference */
+static void exp_mod_binary(mpanum dest, const mpanum op1, const mpanum op2,
+			   const mpanum n, const mpanum r_modn,
+			   const mpanum r2_modn, mpa_word_t n_inv,
+			   mpa_scratch_mem pool)
+{
+	mpanum A;
+	mpanum B;
+	mpanum x;
+	mpanum t;
+	int idx;
+
+	mpa_alloc_static_temp_var(&A, pool);
+	mpa_alloc_static_temp_var(&B, pool);
+	mpa_alloc_static_temp_var(&x, pool);
+	__mpa_set_unused_digits_to_zero(A);
+	__mpa_set_unused_digits_to_zero(B);
+
+	__mpa_montgomery_mul(x, op1, r2_modn, n, n_inv);
+	mpa_copy(A, r_modn);
+	for (idx = mpa_highest_bit_index(op2); idx >= 0; idx--) {
+		__mpa_montgomery_mul(B, A, A, n, n_inv);
+		if (mpa_get_bit(op2, idx)) {
+			__mpa_montgomery_mul(A, B, x, n, n_inv);
+		} else {
+			t = A;
+			A = B;
+			B = t;
+		}
+	}
+	__mpa_montgomery_mul(B, (const mpanum)&const_one, A, n, n_inv);
+	mpa_copy(dest, B);
+
+	mpa_free_static_temp_var(&x, pool);
+	mpa_free_static_temp_var(&B, pool);
+	mpa_free_static_temp_var(&A, pool);
+}
+
+typedef void (*exp_mod_fn)(mpanum dest, const mpanum op1, const mpanum op2,
+			   const mpanum n, const mpanum r_modn,
+			   const mpanum r2_modn, const mpa_word_t n_inv,
+			   mpa_scratch_mem pool);
+
+static const struct {
+	const char *name;
+	exp_mod_fn fn;
+	bool small_pool;
+} variants[] = {
+	{ "binary", exp_mod_binary, false },
+	{ "exp_mod", mpa_exp_mod, false },
+	{ "exp_mod_public", mpa_exp_mod_public, false },
+	{ "exp_mod no table", mpa_exp_mod, true },
+	{ "exp_mod_public no table", mpa_exp_mod_public, true },
+};
+
+int main(void)
+{
+	static const int sizes[] = { 1024, 2048, 3072, 4096 };
+	mpa_scratch_mem big = (mpa_scratch_mem)big_pool;
+	mpa_scratch_mem small = (mpa_scratch_mem)small_pool;
+	mpanum n = new_var();
+	mpanum r_modn = new_var();
+	mpanum r2_modn = new_var();
+	mpanum base = new_var();
+	mpanum exp = new_var();
+	mpanum ref = new_var();
+	mpanum res = new_var();
+	mpa_word_t n_inv;
+	uint64_t t;
+	size_t s;
+	size_t v;
+	int i;
+	int ret = 0;
+
+	mpa_init_scratch_mem(big, sizeof(big_pool), TEMP_BITS);
+	mpa_init_scratch_mem(small, sizeof(small_pool), TEMP_BITS);
+
+	for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+		set_random(n, sizes[s]);
+		n->d[0] |= 1;
+		set_random(base, sizes[s]);
+		base->d[__mpanum_size(base) - 1] >>= 1; /* base < n */
+		set_random(exp, sizes[s]);
+
+		if (mpa_compute_fmm_context(n, r_modn, r2_modn, &n_inv,
+					    big)) {
+			fprintf(stderr, "mpa_compute_fmm_context failed\n");
+			return 1;
+		}
+
+		exp_mod_binary(ref, base, exp, n, r_modn, r2_modn, n_inv,
+			       big);
+
+		for (v = 0; v < sizeof(variants) / sizeof(variants[0]); v++) {
+			mpa_scratch_mem pool = variants[v].small_pool ?
+					       small : big;
+
+			t = now_ns();
+			for (i = 0; i < NUM_ITER; i++)
+				variants[v].fn(res, base, exp, n, r_modn,
+					       r2_modn, n_inv, pool);
+			t = now_ns() - t;
+
+			if (mpa_cmp(res, ref)) {
+				printf("%d bits %s: MISMATCH\n", sizes[s],
+				       variants[v].name);
+				ret = 1;
+				continue;
+			}
+			printf("%d bits %-24s %8" PRIu64 " us/op\n", sizes[s],
+			       variants[v].name, t / NUM_ITER / 1000);
+		}
+	}
+
+	free(res);
+	free(ref);
+	free(exp);
+	free(base);
+	free(r2_modn);
+	free(r_modn);
+	free(n);
+	return ret;
+}
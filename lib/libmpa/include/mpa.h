@@ -228,6 +228,20 @@ void __mpa_montgomery_mul_add(mpanum dest, mpanum src, mpa_word_t w);
 void __mpa_montgomery_mul(mpanum dest,
 			  mpanum op1, mpanum op2, mpanum n, mpa_word_t n_inv);
 
+void __mpa_montgomery_mul_c(mpanum dest,
+			    mpanum op1, mpanum op2, mpanum n, mpa_word_t n_inv);
+
+/*
+ * Implemented in arch/arm/mpa_a64.S, only in AArch64 builds. t = a * b /
+ * 2^(64 * s) mod n with a, b and n s 64-bit limbs long, a, b < n and
+ * n_inv = -n^-1 mod 2^64.
+ */
+void __mpa_montgomery_mul_a64(mpa_word_t *t, const mpa_word_t *a,
+			      const mpa_word_t *b, const mpa_word_t *n,
+			      size_t s, uint64_t n_inv);
+
+void __mpa_montgomery_sqr(mpanum dest, mpanum op, mpanum n, mpa_word_t n_inv);
+
 /*------------------------------------------------------------
  *
  *  From mpa_misc.c
@@ -372,6 +372,13 @@ MPALIB_EXPORT void mpa_exp_mod(mpanum dest, const mpanum op1, const mpanum op2,
 			       const mpanum r2_modn, const mpa_word_t n_inv,
 			       mpa_scratch_mem pool);
 
+MPALIB_EXPORT void mpa_exp_mod_public(mpanum dest, const mpanum op1,
+				      const mpanum op2, const mpanum n,
+				      const mpanum r_modn,
+				      const mpanum r2_modn,
+				      const mpa_word_t n_inv,
+				      mpa_scratch_mem pool);
+
 /*
  * From mpa_misc.c
  */
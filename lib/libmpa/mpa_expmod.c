@@ -26,12 +26,245 @@
  */
 #include "mpa.h"
 
+/*
+ * Largest window used, 2^MPA_EXPMOD_MAX_WINDOW precomputed values has to
+ * fit in the scratch memory pool next to the operands.
+ */
+#define MPA_EXPMOD_MAX_WINDOW	6
+
+/*
+ * Window size giving the least number of multiplications for an exponent
+ * of @bits bits, see HAC 14.85.
+ */
+static int window_size(int bits)
+{
+	if (bits > 671)
+		return 6;
+	if (bits > 239)
+		return 5;
+	if (bits > 79)
+		return 4;
+	if (bits > 23)
+		return 3;
+	if (bits > 7)
+		return 2;
+	return 1;
+}
+
+static void free_table(mpanum *table, int count, mpa_scratch_mem pool)
+{
+	/* Temporary variables are released in reverse allocation order */
+	while (count)
+		mpa_free_static_temp_var(table + --count, pool);
+}
+
+/*
+ * Returns true if @count temporary variables of the default size can
+ * still be allocated from the pool.
+ */
+static bool have_temp_vars(int count, mpa_scratch_mem pool)
+{
+	mpanum vars[3];
+	int i;
+
+	for (i = 0; i < count; i++)
+		if (!mpa_alloc_static_temp_var(vars + i, pool))
+			break;
+	free_table(vars, i, pool);
+	return i == count;
+}
+
+/*
+ * Allocates a table of 1 << (*wsize - shift) values of the size of n from
+ * the pool, leaving room for @extra temporary variables of the default
+ * size. If the pool is too small for it, the window size is reduced until
+ * the table fits. Returns false if not even a window of 1 fits.
+ */
+static bool alloc_table(mpanum *table, int *wsize, const mpanum n,
+			int shift, int extra, mpa_scratch_mem pool)
+{
+	int bits = WORDS_TO_BITS(__mpanum_size(n) + 2);
+	int count;
+	int i;
+
+	for (; *wsize > 0; (*wsize)--) {
+		count = 1 << (*wsize - shift);
+		for (i = 0; i < count; i++) {
+			if (!mpa_alloc_static_temp_var_size(bits, table + i,
+							    pool))
+				break;
+			__mpa_set_unused_digits_to_zero(table[i]);
+		}
+		if (i == count && have_temp_vars(extra, pool))
+			return true;
+		free_table(table, i, pool);
+	}
+	return false;
+}
+
+/*
+ * dest = op1 * op2 in Montgomery space, *tmp is used as destination and
+ * swapped with *dest as __mpa_montgomery_mul() can't work in place.
+ */
+static void mont_mul(mpanum *dest, mpanum *tmp, const mpanum op1,
+		     const mpanum op2, const mpanum n, const mpa_word_t n_inv)
+{
+	mpanum swapper;
+
+	__mpa_montgomery_mul(*tmp, op1, op2, n, n_inv);
+	swapper = *dest;
+	*dest = *tmp;
+	*tmp = swapper;
+}
+
+/* dest = dest * dest in Montgomery space, see mont_mul() */
+static void mont_sqr(mpanum *dest, mpanum *tmp, const mpanum n,
+		     const mpa_word_t n_inv)
+{
+	mpanum swapper;
+
+	__mpa_montgomery_sqr(*tmp, *dest, n, n_inv);
+	swapper = *dest;
+	*dest = *tmp;
+	*tmp = swapper;
+}
+
+/* Returns the @len bits of @src from bit @idx and up */
+static uint32_t get_bits(const mpanum src, int idx, int len)
+{
+	uint32_t v = 0;
+	int i;
+
+	for (i = len - 1; i >= 0; i--) {
+		mpa_usize_t w = (idx + i) >> LOG_OF_WORD_SIZE;
+		uint32_t b = 0;
+
+		if (w < __mpanum_size(src))
+			b = (src->d[w] >> ((idx + i) & (WORD_SIZE - 1))) & 1;
+		v = (v << 1) | b;
+	}
+	return v;
+}
+
+/*
+ * dest = table[idx], reading all entries of the table so that the memory
+ * access pattern doesn't depend on idx.
+ */
+static void ct_select(mpanum dest, const mpanum *table, uint32_t count,
+		      uint32_t idx, mpa_usize_t nwords)
+{
+	mpa_usize_t size = 0;
+	mpa_usize_t n;
+	uint32_t diff;
+	mpa_word_t mask;
+	uint32_t i;
+
+	mpa_wipe(dest);
+	for (i = 0; i < count; i++) {
+		diff = i ^ idx;
+		/* mask is all ones if diff is 0, else 0 */
+		mask = (mpa_word_t)(((diff | (0 - diff)) >> 31) - 1);
+		size |= table[i]->size & (mpa_usize_t)mask;
+		for (n = 0; n < nwords; n++)
+			dest->d[n] |= table[i]->d[n] & mask;
+	}
+	dest->size = size;
+}
+
+/*
+ * dest = op1 ^ op2 mod n by square-and-multiply, used when the pool has no
+ * room for a table. op1 isn't converted to Montgomery space as that would
+ * need one more temporary variable, instead each multiplication by op1 is
+ * followed by one by r2_modn.
+ */
+static void exp_mod_no_table_public(mpanum dest, const mpanum op1,
+				    const mpanum op2, const mpanum n,
+				    const mpanum r_modn, const mpanum r2_modn,
+				    const mpa_word_t n_inv,
+				    mpa_scratch_mem pool)
+{
+	mpanum A;
+	mpanum B;
+	int idx;
+
+	mpa_alloc_static_temp_var(&A, pool);
+	mpa_alloc_static_temp_var(&B, pool);
+	__mpa_set_unused_digits_to_zero(A);
+	__mpa_set_unused_digits_to_zero(B);
+
+	mpa_copy(A, r_modn);
+	for (idx = mpa_highest_bit_index(op2); idx >= 0; idx--) {
+		mont_sqr(&A, &B, n, n_inv);
+		if (get_bits(op2, idx, 1)) {
+			__mpa_montgomery_mul(B, A, op1, n, n_inv);
+			__mpa_montgomery_mul(A, B, r2_modn, n, n_inv);
+		}
+	}
+
+	/* transform back form Montgomery space */
+	__mpa_montgomery_mul(B, (const mpanum)&const_one, A, n, n_inv);
+	mpa_copy(dest, B);
+
+	mpa_free_static_temp_var(&B, pool);
+	mpa_free_static_temp_var(&A, pool);
+}
+
+/*
+ * Same as exp_mod_no_table_public() but the multiplication is done for
+ * each bit of op2 and its result selected in constant time, so the
+ * sequence of operations only depends on the bit length of op2.
+ */
+static void exp_mod_no_table(mpanum dest, const mpanum op1,
+			     const mpanum op2, const mpanum n,
+			     const mpanum r_modn, const mpanum r2_modn,
+			     const mpa_word_t n_inv, mpa_scratch_mem pool)
+{
+	mpanum A;
+	mpanum B;
+	mpanum T;
+	mpanum sel[2];
+	int idx;
+
+	mpa_alloc_static_temp_var(&A, pool);
+	mpa_alloc_static_temp_var(&B, pool);
+	mpa_alloc_static_temp_var(&T, pool);
+	__mpa_set_unused_digits_to_zero(A);
+	__mpa_set_unused_digits_to_zero(B);
+	__mpa_set_unused_digits_to_zero(T);
+
+	mpa_copy(A, r_modn);
+	for (idx = mpa_highest_bit_index(op2); idx >= 0; idx--) {
+		mont_sqr(&A, &B, n, n_inv);
+		/* T = A * op1 in Montgomery space */
+		__mpa_montgomery_mul(B, A, op1, n, n_inv);
+		__mpa_montgomery_mul(T, B, r2_modn, n, n_inv);
+		sel[0] = A;
+		sel[1] = T;
+		ct_select(B, sel, 2, get_bits(op2, idx, 1), __mpanum_size(n));
+		sel[0] = A;
+		A = B;
+		B = sel[0];
+	}
+
+	/* transform back form Montgomery space */
+	__mpa_montgomery_mul(B, (const mpanum)&const_one, A, n, n_inv);
+	mpa_copy(dest, B);
+
+	mpa_free_static_temp_var(&T, pool);
+	mpa_free_static_temp_var(&B, pool);
+	mpa_free_static_temp_var(&A, pool);
+}
+
 /*------------------------------------------------------------
  *
  *  mpa_exp_mod
  *
  *  Calculates dest = op1 ^ op2 mod n
  *
+ *  Fixed window exponentiation, the sequence of Montgomery
+ *  multiplications and the table access pattern only depend on the
+ *  bit length of op2. Used for secret exponents.
+ *
  */
 void mpa_exp_mod(mpanum dest,
 		const mpanum op1,
@@ -41,45 +274,147 @@ void mpa_exp_mod(mpanum dest,
 		const mpanum r2_modn,
 		const mpa_word_t n_inv, mpa_scratch_mem pool)
 {
+	mpanum table[1 << MPA_EXPMOD_MAX_WINDOW];
 	mpanum A;
 	mpanum B;
-	mpanum xtilde;
-	mpanum *ptr_a;
-	mpanum *ptr_b;
-	mpanum *swapper;
+	mpanum T;
+	uint32_t count;
+	uint32_t i;
+	int wsize;
 	int idx;
+	int k;
+
+	idx = mpa_highest_bit_index(op2) + 1;
+	wsize = window_size(idx);
+	if (!alloc_table(table, &wsize, n, 0, 3, pool)) {
+		exp_mod_no_table(dest, op1, op2, n, r_modn, r2_modn, n_inv,
+				 pool);
+		return;
+	}
+	count = 1 << wsize;
 
 	mpa_alloc_static_temp_var(&A, pool);
 	mpa_alloc_static_temp_var(&B, pool);
-	mpa_alloc_static_temp_var(&xtilde, pool);
+	mpa_alloc_static_temp_var(&T, pool);
+	__mpa_set_unused_digits_to_zero(A);
+	__mpa_set_unused_digits_to_zero(B);
+	__mpa_set_unused_digits_to_zero(T);
 
-	/* transform to Montgomery space */
-	/* use internal version since xtidle is big enough */
-	__mpa_montgomery_mul(xtilde, op1, r2_modn, n, n_inv);
+	/* table[i] = op1^i in Montgomery space */
+	mpa_copy(table[0], r_modn);
+	__mpa_montgomery_mul(table[1], op1, r2_modn, n, n_inv);
+	for (i = 2; i < count; i++)
+		__mpa_montgomery_mul(table[i], table[i - 1], table[1], n,
+				     n_inv);
 
-	mpa_copy(A, r_modn);
-	ptr_a = &A;
-	ptr_b = &B;
+	/* Round down to a multiple of the window, the top window is short */
+	idx = __MAX(((idx + wsize - 1) / wsize - 1) * wsize, 0);
+	ct_select(A, table, count, get_bits(op2, idx, wsize),
+		  __mpanum_size(n));
+	for (idx -= wsize; idx >= 0; idx -= wsize) {
+		for (k = 0; k < wsize; k++)
+			mont_sqr(&A, &B, n, n_inv);
+		ct_select(T, table, count, get_bits(op2, idx, wsize),
+			  __mpanum_size(n));
+		mont_mul(&A, &B, A, T, n, n_inv);
+	}
+
+	/* transform back form Montgomery space */
+	__mpa_montgomery_mul(B, (const mpanum)&const_one, A, n, n_inv);
+	mpa_copy(dest, B);
+
+	mpa_free_static_temp_var(&T, pool);
+	mpa_free_static_temp_var(&B, pool);
+	mpa_free_static_temp_var(&A, pool);
+	free_table(table, count, pool);
+}
+
+/*------------------------------------------------------------
+ *
+ *  mpa_exp_mod_public
+ *
+ *  Calculates dest = op1 ^ op2 mod n
+ *
+ *  Sliding window exponentiation, faster than mpa_exp_mod() but its
+ *  timing depends on the value of op2. Only for public exponents.
+ *
+ */
+void mpa_exp_mod_public(mpanum dest,
+		const mpanum op1,
+		const mpanum op2,
+		const mpanum n,
+		const mpanum r_modn,
+		const mpanum r2_modn,
+		const mpa_word_t n_inv, mpa_scratch_mem pool)
+{
+	mpanum table[1 << (MPA_EXPMOD_MAX_WINDOW - 1)];
+	mpanum A;
+	mpanum B;
+	uint32_t count;
+	uint32_t i;
+	bool started = false;
+	int wsize;
+	int idx;
+	int low;
+	int k;
+
+	/*
+	 * table[i] = op1^(2 * i + 1) in Montgomery space, with a window of
+	 * 1 this is only op1 itself.
+	 */
+	wsize = window_size(mpa_highest_bit_index(op2) + 1);
+	if (!alloc_table(table, &wsize, n, 1, 2, pool)) {
+		exp_mod_no_table_public(dest, op1, op2, n, r_modn, r2_modn,
+					n_inv, pool);
+		return;
+	}
+	count = 1 << (wsize - 1);
+
+	mpa_alloc_static_temp_var(&A, pool);
+	mpa_alloc_static_temp_var(&B, pool);
 	__mpa_set_unused_digits_to_zero(A);
 	__mpa_set_unused_digits_to_zero(B);
-	for (idx = mpa_highest_bit_index(op2); idx >= 0; idx--) {
-		__mpa_montgomery_mul(*ptr_b, *ptr_a, *ptr_a, n, n_inv);
-		if (mpa_get_bit(op2, idx) == 1) {
-			__mpa_montgomery_mul(*ptr_a, *ptr_b, xtilde, n, n_inv);
+
+	__mpa_montgomery_mul(table[0], op1, r2_modn, n, n_inv);
+	if (count > 1)
+		__mpa_montgomery_mul(B, table[0], table[0], n, n_inv);
+	for (i = 1; i < count; i++)
+		__mpa_montgomery_mul(table[i], table[i - 1], B, n, n_inv);
+
+	mpa_copy(A, r_modn);
+	idx = mpa_highest_bit_index(op2);
+	while (idx >= 0) {
+		if (!get_bits(op2, idx, 1)) {
+			if (started)
+				mont_sqr(&A, &B, n, n_inv);
+			idx--;
+			continue;
+		}
+
+		/* Longest window of at most wsize bits ending with a 1 */
+		low = __MAX(idx - wsize + 1, 0);
+		while (!get_bits(op2, low, 1))
+			low++;
+
+		if (started) {
+			for (k = low; k <= idx; k++)
+				mont_sqr(&A, &B, n, n_inv);
+			mont_mul(&A, &B, A,
+				 table[get_bits(op2, low, idx - low + 1) >> 1],
+				 n, n_inv);
 		} else {
-			swapper = ptr_a;
-			ptr_a = ptr_b;
-			ptr_b = swapper;
+			mpa_copy(A,
+				 table[get_bits(op2, low, idx - low + 1) >> 1]);
+			started = true;
 		}
+		idx = low - 1;
 	}
 
 	/* transform back form Montgomery space */
-	__mpa_montgomery_mul(*ptr_b, (const mpanum)&const_one, *ptr_a,
-			     n, n_inv);
-
-	mpa_copy(dest, *ptr_b);
+	__mpa_montgomery_mul(B, (const mpanum)&const_one, A, n, n_inv);
+	mpa_copy(dest, B);
 
-	mpa_free_static_temp_var(&A, pool);
 	mpa_free_static_temp_var(&B, pool);
-	mpa_free_static_temp_var(&xtilde, pool);
+	mpa_free_static_temp_var(&A, pool);
+	free_table(table, count, pool);
 }
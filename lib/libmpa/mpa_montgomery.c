@@ -25,6 +25,7 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 #include "mpa.h"
+#include <sys/cdefs.h>
 
 /*************************************************************
  *
@@ -124,16 +125,264 @@ void __mpa_montgomery_sub_ack(mpanum dest, mpanum src)
 
 #endif /* USE_ARM_ASM */
 
+/* Sets the size of dest to at most size words, skipping leading zeroes */
+static void set_size(mpanum dest, mpa_usize_t size)
+{
+	while (size > 0 && dest->d[size - 1] == 0)
+		size--;
+	dest->size = size;
+}
+
+/* t = t - n if t (with top as extra most significant word) >= n */
+static void sub_if_ge(mpa_word_t *t, mpa_word_t top, const mpa_word_t *n,
+		      mpa_usize_t s)
+{
+	mpa_dword_t x;
+	mpa_word_t borrow = 0;
+	mpa_usize_t j;
+
+	if (!top) {
+		for (j = s - 1; j >= 0; j--) {
+			if (t[j] != n[j])
+				break;
+		}
+		if (j >= 0 && t[j] < n[j])
+			return;
+	}
+
+	for (j = 0; j < s; j++) {
+		x = (mpa_dword_t)t[j] - n[j] - borrow;
+		t[j] = (mpa_word_t)x;
+		borrow = (mpa_word_t)(x >> WORD_SIZE) & 1;
+	}
+}
+
+/*
+ * Coarsely integrated operand scanning (CIOS) Montgomery multiplication,
+ * t = a * b / R mod n with a, b and n all s words long. The
+ * multiplication by a[i] and the reduction are done in the same pass over
+ * t and the top word is kept in a local, so t only needs s words.
+ *
+ * Always inlined so that the callers with a constant s get a specialized
+ * and unrolled copy.
+ */
+static __always_inline void mont_mul_words(mpa_word_t *t,
+					   const mpa_word_t *a,
+					   const mpa_word_t *b,
+					   const mpa_word_t *n,
+					   const mpa_usize_t s,
+					   const mpa_word_t n_inv)
+{
+	mpa_word_t top = 0;
+	mpa_word_t c1;
+	mpa_word_t c2;
+	mpa_word_t m;
+	mpa_dword_t x;
+	mpa_dword_t y;
+	mpa_usize_t i;
+	mpa_usize_t j;
+
+	for (j = 0; j < s; j++)
+		t[j] = 0;
+
+	for (i = 0; i < s; i++) {
+		x = (mpa_dword_t)a[i] * b[0] + t[0];
+		c1 = (mpa_word_t)(x >> WORD_SIZE);
+		m = (mpa_word_t)x * n_inv;
+		/* The low word of y is 0 by the choice of m */
+		y = (mpa_dword_t)m * n[0] + (mpa_word_t)x;
+		c2 = (mpa_word_t)(y >> WORD_SIZE);
+
+		for (j = 1; j < s; j++) {
+			x = (mpa_dword_t)a[i] * b[j] + t[j] + c1;
+			c1 = (mpa_word_t)(x >> WORD_SIZE);
+			y = (mpa_dword_t)m * n[j] + (mpa_word_t)x + c2;
+			c2 = (mpa_word_t)(y >> WORD_SIZE);
+			t[j - 1] = (mpa_word_t)y;
+		}
+
+		x = (mpa_dword_t)top + c1 + c2;
+		t[s - 1] = (mpa_word_t)x;
+		top = (mpa_word_t)(x >> WORD_SIZE);
+	}
+
+	sub_if_ge(t, top, n, s);
+}
+
+/*
+ * Montgomery squaring, t = a * a / R mod n with a and n s words long and
+ * room for 2 * s + 1 words in t. Each product a[i] * a[j] with i != j is
+ * only computed once and then doubled, followed by a separate word by
+ * word reduction. That is 1.5 * s^2 word multiplications instead of
+ * 2 * s^2 for mont_mul_words().
+ */
+static __always_inline void mont_sqr_words(mpa_word_t *t,
+					   const mpa_word_t *a,
+					   const mpa_word_t *n,
+					   const mpa_usize_t s,
+					   const mpa_word_t n_inv)
+{
+	mpa_word_t c;
+	mpa_word_t m;
+	mpa_word_t w;
+	mpa_dword_t x;
+	mpa_usize_t i;
+	mpa_usize_t j;
+
+	for (j = 0; j <= 2 * s; j++)
+		t[j] = 0;
+
+	/* Products above the diagonal */
+	for (i = 0; i < s - 1; i++) {
+		c = 0;
+		for (j = i + 1; j < s; j++) {
+			x = (mpa_dword_t)a[i] * a[j] + t[i + j] + c;
+			t[i + j] = (mpa_word_t)x;
+			c = (mpa_word_t)(x >> WORD_SIZE);
+		}
+		t[i + s] = c;
+	}
+
+	/* Double them */
+	c = 0;
+	for (j = 0; j < 2 * s; j++) {
+		w = t[j];
+		t[j] = (w << 1) | c;
+		c = w >> (WORD_SIZE - 1);
+	}
+
+	/* Add the diagonal */
+	c = 0;
+	for (i = 0; i < s; i++) {
+		x = (mpa_dword_t)a[i] * a[i] + t[2 * i] + c;
+		t[2 * i] = (mpa_word_t)x;
+		x = (mpa_dword_t)t[2 * i + 1] + (mpa_word_t)(x >> WORD_SIZE);
+		t[2 * i + 1] = (mpa_word_t)x;
+		c = (mpa_word_t)(x >> WORD_SIZE);
+	}
+
+	/* Reduce, t + m * n < 2 * R * n so t[2 * s] is the only extra word */
+	for (i = 0; i < s; i++) {
+		m = t[i] * n_inv;
+		c = 0;
+		for (j = 0; j < s; j++) {
+			x = (mpa_dword_t)m * n[j] + t[i + j] + c;
+			t[i + j] = (mpa_word_t)x;
+			c = (mpa_word_t)(x >> WORD_SIZE);
+		}
+		for (j = i + s; c; j++) {
+			x = (mpa_dword_t)t[j] + c;
+			t[j] = (mpa_word_t)x;
+			c = (mpa_word_t)(x >> WORD_SIZE);
+		}
+	}
+
+	sub_if_ge(t + s, t[2 * s], n, s);
+	for (j = 0; j < s; j++)
+		t[j] = t[j + s];
+	for (j = s; j <= 2 * s; j++)
+		t[j] = 0;
+}
+
+/*
+ * Specialized copies for the common RSA and DH modulus sizes, 1024, 2048,
+ * 3072 and 4096 bits, the generic copy handles all other sizes.
+ */
+#define MONT_FIXED_SIZE(bits)	((bits) / WORD_SIZE)
+
+static void mont_mul_dispatch(mpa_word_t *t, const mpa_word_t *a,
+			      const mpa_word_t *b, const mpa_word_t *n,
+			      mpa_usize_t s, mpa_word_t n_inv)
+{
+	switch (s) {
+	case MONT_FIXED_SIZE(1024):
+		mont_mul_words(t, a, b, n, MONT_FIXED_SIZE(1024), n_inv);
+		break;
+	case MONT_FIXED_SIZE(2048):
+		mont_mul_words(t, a, b, n, MONT_FIXED_SIZE(2048), n_inv);
+		break;
+	case MONT_FIXED_SIZE(3072):
+		mont_mul_words(t, a, b, n, MONT_FIXED_SIZE(3072), n_inv);
+		break;
+	case MONT_FIXED_SIZE(4096):
+		mont_mul_words(t, a, b, n, MONT_FIXED_SIZE(4096), n_inv);
+		break;
+	default:
+		mont_mul_words(t, a, b, n, s, n_inv);
+		break;
+	}
+}
+
+static void mont_sqr_dispatch(mpa_word_t *t, const mpa_word_t *a,
+			      const mpa_word_t *n, mpa_usize_t s,
+			      mpa_word_t n_inv)
+{
+	switch (s) {
+	case MONT_FIXED_SIZE(1024):
+		mont_sqr_words(t, a, n, MONT_FIXED_SIZE(1024), n_inv);
+		break;
+	case MONT_FIXED_SIZE(2048):
+		mont_sqr_words(t, a, n, MONT_FIXED_SIZE(2048), n_inv);
+		break;
+	case MONT_FIXED_SIZE(3072):
+		mont_sqr_words(t, a, n, MONT_FIXED_SIZE(3072), n_inv);
+		break;
+	case MONT_FIXED_SIZE(4096):
+		mont_sqr_words(t, a, n, MONT_FIXED_SIZE(4096), n_inv);
+		break;
+	default:
+		mont_sqr_words(t, a, n, s, n_inv);
+		break;
+	}
+}
+
+#if defined(MPA_USE_A64_ASM)
+/*
+ * Montgomery multiplication on 64-bit limbs. As long as n has an even
+ * number of words R = 2^(WORD_SIZE * size of n) is the same for 32- and
+ * 64-bit limbs so the result is identical. Operands shorter than n are
+ * left to the generic code as the kernel reads all words of them.
+ */
+static bool montgomery_mul_a64(mpanum dest, mpanum op1, mpanum op2,
+			       mpanum n, mpa_word_t n_inv)
+{
+	mpa_usize_t size = __mpanum_size(n);
+	uint64_t n_lsw;
+	uint64_t inv;
+
+	if ((size & 1) || __mpanum_size(op1) != size ||
+	    __mpanum_size(op2) != size)
+		return false;
+
+	/*
+	 * n_inv is -n^-1 mod 2^32, one Newton step lifts n^-1 to
+	 * mod 2^64.
+	 */
+	n_lsw = n->d[0] | ((uint64_t)n->d[1] << 32);
+	inv = (mpa_word_t)(0 - n_inv);
+	inv *= 2 - n_lsw * inv;
+
+	mpa_wipe(dest);
+	__mpa_montgomery_mul_a64(dest->d, op1->d, op2->d, n->d, size / 2,
+				 0 - inv);
+	set_size(dest, size);
+	return true;
+}
+#endif
+
 /*------------------------------------------------------------
  *
- *  __mpa_montgomery_mul
+ *  __mpa_montgomery_mul_c
+ *
+ *  __mpa_montgomery_mul() without the assembly kernels, the
+ *  reference they're tested against.
  *
  *  NOTE:
  *  Dest need to be able to hold one more word than the size of n
  *
  */
-void __mpa_montgomery_mul(mpanum dest, mpanum op1, mpanum op2, mpanum n,
-			  mpa_word_t n_inv)
+void __mpa_montgomery_mul_c(mpanum dest, mpanum op1, mpanum op2, mpanum n,
+			    mpa_word_t n_inv)
 {
 	mpa_word_t u;
 	mpa_usize_t idx;
@@ -141,6 +390,15 @@ void __mpa_montgomery_mul(mpanum dest, mpanum op1, mpanum op2, mpanum n,
 	/* set dest to zero (with all unused digits to zero as well) */
 	mpa_wipe(dest);
 
+	/* Operands as long as n, the common case, take the fused path */
+	if (__mpanum_size(op1) == __mpanum_size(n) &&
+	    __mpanum_size(op2) == __mpanum_size(n)) {
+		mont_mul_dispatch(dest->d, op1->d, op2->d, n->d,
+				  __mpanum_size(n), n_inv);
+		set_size(dest, __mpanum_size(n));
+		return;
+	}
+
 	for (idx = 0; idx < n->size; idx++) {
 		u = (dest->d[0] +
 		     __mpanum_get_word(idx, op1) *
@@ -162,6 +420,61 @@ void __mpa_montgomery_mul(mpanum dest, mpanum op1, mpanum op2, mpanum n,
 		__mpa_montgomery_sub_ack(dest, n);
 }
 
+/*------------------------------------------------------------
+ *
+ *  __mpa_montgomery_mul
+ *
+ *  NOTE:
+ *  Dest need to be able to hold one more word than the size of n
+ *
+ */
+void __mpa_montgomery_mul(mpanum dest, mpanum op1, mpanum op2, mpanum n,
+			  mpa_word_t n_inv)
+{
+#if defined(MPA_USE_A64_ASM)
+	if (montgomery_mul_a64(dest, op1, op2, n, n_inv))
+		return;
+#endif
+	__mpa_montgomery_mul_c(dest, op1, op2, n, n_inv);
+}
+
+/*------------------------------------------------------------
+ *
+ *  __mpa_montgomery_sqr
+ *
+ *  Calculates dest = op * op / R mod n
+ *
+ *  NOTE:
+ *  Dest need to be able to hold one more word than the size of n,
+ *  the dedicated squaring is only used if it can hold twice the size
+ *  of n plus one word.
+ *
+ */
+void __mpa_montgomery_sqr(mpanum dest, mpanum op, mpanum n,
+			  mpa_word_t n_inv)
+{
+	mpa_usize_t s = __mpanum_size(n);
+
+#if defined(MPA_USE_A64_ASM)
+	/*
+	 * The 64-bit limb multiplication does a quarter of the word
+	 * multiplications and beats a 32-bit squaring.
+	 */
+	if (montgomery_mul_a64(dest, op, op, n, n_inv))
+		return;
+#endif
+
+	if (__mpanum_size(op) != s ||
+	    __mpanum_alloced(dest) < (mpa_asize_t)(2 * s + 1)) {
+		__mpa_montgomery_mul(dest, op, op, n, n_inv);
+		return;
+	}
+
+	mpa_wipe(dest);
+	mont_sqr_dispatch(dest->d, op->d, n->d, s, n_inv);
+	set_size(dest, s);
+}
+
 /*************************************************************
  *
  *   LIB FUNCTIONS
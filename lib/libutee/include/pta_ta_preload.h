@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2017, Linaro Limited
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef __PTA_TA_PRELOAD_H
+#define __PTA_TA_PRELOAD_H
+
+/*
+ * Interface to the TA preload pseudo-TA, used by the normal world to load
+ * user TAs before their first session is opened. Only available with
+ * CFG_TA_PRELOAD=y.
+ */
+
+#define PTA_TA_PRELOAD_UUID { 0x6b6f7e0e, 0x6d52, 0x4a4d, { \
+			      0x9a, 0x3c, 0x5f, 0x0b, 0x1e, 0x7d, 0x4c, 0x22 } }
+
+/*
+ * Load an instance of a TA into the preload pool
+ *
+ * [in] memref[0]: UUID of the TA, 16 bytes in RFC 4122 octet order
+ */
+#define PTA_TA_PRELOAD_LOAD		0
+
+/*
+ * Drop the instances of a TA still waiting in the preload pool
+ *
+ * [in] memref[0]: UUID of the TA, 16 bytes in RFC 4122 octet order
+ */
+#define PTA_TA_PRELOAD_EVICT		1
+
+/*
+ * Load the TAs listed by the platform configuration
+ *
+ * [out] value[0].a: number of TAs successfully preloaded
+ */
+#define PTA_TA_PRELOAD_PLATFORM		2
+
+/*
+ * Report the instances waiting in the preload pool
+ *
+ * [out] value[0].a: number of instances
+ * [out] value[0].b: secure memory they hold, in bytes
+ */
+#define PTA_TA_PRELOAD_GET_STATS	3
+
+#endif /* __PTA_TA_PRELOAD_H */
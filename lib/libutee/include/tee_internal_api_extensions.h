@@ -56,4 +56,33 @@ TEE_Result TEE_CacheClean(char *buf, size_t len);
 TEE_Result TEE_CacheFlush(char *buf, size_t len);
 TEE_Result TEE_CacheInvalidate(char *buf, size_t len);
 
+/*
+ * Batched digest and MAC computation
+ *
+ * TEE_DigestMACComputeFinalBatch() completes a number of digest and MAC
+ * operations with as few calls into the TEE Core as possible. Each entry
+ * is processed as TEE_DigestDoFinal() or TEE_MACComputeFinal() with
+ * @message as the last chunk. The result of each entry is stored in
+ * @result, either TEE_SUCCESS or TEE_ERROR_SHORT_BUFFER, and @outLen is
+ * updated as for the single call.
+ *
+ * Unlike TEE_MACComputeFinal() a MAC operation is left initialized with
+ * its key after each entry, so the same operation can be used in several
+ * entries of a batch without calling TEE_MACInit() in between.
+ *
+ * Returns TEE_ERROR_SHORT_BUFFER if any entry got TEE_ERROR_SHORT_BUFFER,
+ * else TEE_SUCCESS. Any other error panics the TA.
+ */
+struct tee_digest_mac_final {
+	TEE_OperationHandle operation;
+	const void *message;
+	uint32_t messageLen;
+	void *out;
+	uint32_t outLen;
+	TEE_Result result;
+};
+
+TEE_Result TEE_DigestMACComputeFinalBatch(struct tee_digest_mac_final *ops,
+					  size_t num_ops);
+
 #endif
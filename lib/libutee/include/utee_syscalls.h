@@ -112,6 +112,12 @@ TEE_Result utee_hash_update(unsigned long state, const void *chunk,
 			    size_t chunk_size);
 TEE_Result utee_hash_final(unsigned long state, const void *chunk,
 			   size_t chunk_size, void *hash, uint64_t *hash_len);
+/*
+ * Does utee_hash_final() on each entry in ops and then resets the state
+ * as utee_hash_init() would, so a state may occur in several entries.
+ */
+TEE_Result utee_hash_final_batch(struct utee_hash_final_op *ops,
+				 size_t num_ops);
 
 TEE_Result utee_cipher_init(unsigned long state, const void *iv, size_t iv_len);
 TEE_Result utee_cipher_update(unsigned long state, const void *src,
@@ -69,4 +69,14 @@ struct utee_attribute {
 	uint32_t attribute_id;
 };
 
+/* One digest or MAC operation completed by utee_hash_final_batch() */
+struct utee_hash_final_op {
+	uint64_t state;
+	uint64_t src;		/* pointer to the last chunk */
+	uint64_t src_len;
+	uint64_t dst;		/* pointer to the digest or MAC buffer */
+	uint64_t dst_len;	/* in: size of dst, out: size of result */
+	uint32_t res;		/* out: TEE_SUCCESS or TEE_ERROR_SHORT_BUFFER */
+};
+
 #endif /* UTEE_TYPES_H */
@@ -858,6 +858,45 @@ void TEE_CipherInit(TEE_OperationHandle operation, const void *IV,
 	operation->info.handleState |= TEE_HANDLE_FLAG_INITIALIZED;
 }
 
+/*
+ * Updating in place while data is buffered: the output would start
+ * buffer_offs bytes ahead of the input and overwrite input that isn't
+ * consumed yet. Instead the input is moved up and the buffered bytes put
+ * in front of it, so all complete blocks are processed in place in one
+ * call. Returns false if the update has to take the normal path.
+ */
+static bool tee_buffer_update_in_place(
+		TEE_OperationHandle op,
+		TEE_Result(*update_func)(unsigned long state, const void *src,
+				size_t slen, void *dst, uint64_t *dlen),
+		uint8_t *data, size_t slen, size_t dlen, uint64_t *dest_len)
+{
+	TEE_Result res;
+	uint8_t tail[TEE_AES_BLOCK_SIZE];
+	size_t offs = op->buffer_offs;
+	size_t r = (offs + slen) % op->block_size;
+	size_t n = offs + slen - r;
+	uint64_t tmp_dlen = dlen;
+
+	if (!offs || op->buffer_two_blocks || !n || dlen < n ||
+	    op->block_size > sizeof(tail))
+		return false;
+
+	/* The trailing partial block is overwritten by the move below */
+	memcpy(tail, data + slen - r, r);
+	memmove(data + offs, data, slen - r);
+	memcpy(data, op->buffer, offs);
+
+	res = update_func(op->state, data, n, data, &tmp_dlen);
+	if (res != TEE_SUCCESS)
+		TEE_Panic(res);
+
+	memcpy(op->buffer, tail, r);
+	op->buffer_offs = r;
+	*dest_len = tmp_dlen;
+	return true;
+}
+
 static TEE_Result tee_buffer_update(
 		TEE_OperationHandle op,
 		TEE_Result(*update_func)(unsigned long state, const void *src,
@@ -882,6 +921,11 @@ static TEE_Result tee_buffer_update(
 		goto out;
 	}
 
+	if (src == dst &&
+	    tee_buffer_update_in_place(op, update_func, dst, slen, dlen,
+				       dest_len))
+		return TEE_SUCCESS;
+
 	if (op->buffer_two_blocks) {
 		buffer_size = op->block_size * 2;
 		buffer_left = 1;
@@ -1257,6 +1301,84 @@ out:
 	return res;
 }
 
+/* Number of entries passed to the TEE Core per syscall */
+#define DIGEST_MAC_BATCH_SIZE	16
+
+static void check_digest_mac_final(const struct tee_digest_mac_final *op)
+{
+	TEE_OperationHandle operation = op->operation;
+
+	if (operation == TEE_HANDLE_NULL ||
+	    (!op->message && op->messageLen) || !op->out)
+		TEE_Panic(0);
+
+	switch (operation->info.operationClass) {
+	case TEE_OPERATION_DIGEST:
+		break;
+	case TEE_OPERATION_MAC:
+		if (!(operation->info.handleState &
+		      TEE_HANDLE_FLAG_INITIALIZED) ||
+		    operation->operationState != TEE_OPERATION_STATE_ACTIVE)
+			TEE_Panic(0);
+		break;
+	default:
+		TEE_Panic(0);
+	}
+}
+
+TEE_Result TEE_DigestMACComputeFinalBatch(struct tee_digest_mac_final *ops,
+					  size_t num_ops)
+{
+	struct utee_hash_final_op uops[DIGEST_MAC_BATCH_SIZE];
+	TEE_Result res = TEE_SUCCESS;
+	TEE_Result res2;
+	struct tee_digest_mac_final *op;
+	size_t n;
+	size_t m;
+	size_t l;
+
+	if (!ops && num_ops)
+		TEE_Panic(0);
+
+	for (n = 0; n < num_ops; n += l) {
+		l = MIN(num_ops - n, ARRAY_SIZE(uops));
+
+		for (m = 0; m < l; m++) {
+			op = ops + n + m;
+			check_digest_mac_final(op);
+			uops[m].state = op->operation->state;
+			uops[m].src = (uintptr_t)op->message;
+			uops[m].src_len = op->messageLen;
+			uops[m].dst = (uintptr_t)op->out;
+			uops[m].dst_len = op->outLen;
+		}
+
+		res2 = utee_hash_final_batch(uops, l);
+		if (res2 != TEE_SUCCESS)
+			TEE_Panic(res2);
+
+		for (m = 0; m < l; m++) {
+			op = ops + n + m;
+			op->outLen = uops[m].dst_len;
+			op->result = uops[m].res;
+			if (op->result != TEE_SUCCESS) {
+				res = TEE_ERROR_SHORT_BUFFER;
+				continue;
+			}
+
+			/* The TEE Core has already reinitialized the state */
+			if (op->operation->info.operationClass ==
+			    TEE_OPERATION_DIGEST) {
+				op->operation->buffer_offs = 0;
+				op->operation->operationState =
+					TEE_OPERATION_STATE_INITIAL;
+			}
+		}
+	}
+
+	return res;
+}
+
 /* Cryptographic Operations API - Authenticated Encryption Functions */
 
 TEE_Result TEE_AEInit(TEE_OperationHandle operation, const void *nonce,
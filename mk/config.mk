@@ -143,6 +143,13 @@ CFG_RPMB_WRITE_KEY ?= n
 # SQL FS stores its data in a SQLite database, accessed by normal world
 CFG_SQL_FS ?= n
 
+# Number of persistent object heads and attributes kept in memory per TA, to
+# avoid reading and decoding them again when an object is reopened. 0
+# disables the cache.
+CFG_TEE_STORAGE_HEAD_CACHE_SIZE ?= 8
+# Maximum number of persistent object heads kept in memory for all TAs.
+CFG_TEE_STORAGE_HEAD_CACHE_TOTAL ?= 32
+
 # Embed public part of this key in OP-TEE OS
 TA_SIGN_KEY ?= keys/default_ta.pem
 
@@ -167,9 +174,33 @@ ifeq ($(CFG_TEE_CORE_DEBUG),y)
 CFG_CORE_UNWIND ?= y
 endif
 
+# Asynchronous standard calls (OPTEE_SMC_CALL_WITH_ARG_ASYNC): normal world
+# gets a ticket back as soon as the call is accepted and resumes it from any
+# context, the caller isn't pinned until the call completes. Completed
+# tickets are collected with OPTEE_SMC_GET_ASYNC_COMPLETION. A platform can
+# define CFG_CORE_ASYNC_NOTIF_SGI to the non-secure SGI (0-7) to raise as a
+# doorbell each time an asynchronous call completes.
+CFG_CORE_ASYNC_CALLS ?= n
+
 # Enable support for dynamically loaded user TAs
 CFG_WITH_USER_TA ?= y
 
+# Pool of user TA instances loaded before their first session is opened.
+# TAs are fetched through tee-supplicant so the pool can't be filled at boot,
+# instead the normal world fills it through the ta_preload pseudo TA (see
+# lib/libutee/include/pta_ta_preload.h). A session to a pooled UUID takes
+# over the waiting instance instead of loading the TA.
+# CFG_TA_PRELOAD_MAX_SIZE is the maximum amount of secure memory held by
+# waiting instances, older instances are evicted first. Waiting instances are
+# also evicted when a TA load runs out of secure DDR.
+CFG_TA_PRELOAD ?= n
+CFG_TA_PRELOAD_MAX_SIZE ?= 0x100000
+ifeq ($(CFG_TA_PRELOAD),y)
+ifneq ($(CFG_WITH_USER_TA),y)
+$(error CFG_TA_PRELOAD requires CFG_WITH_USER_TA)
+endif
+endif
+
 # Use small pages to map user TAs
 CFG_SMALL_PAGE_USER_TA ?= y
 